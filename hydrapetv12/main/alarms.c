@@ -1,6 +1,7 @@
 // alarms.c
 
 #include "alarms.h"
+#include "config.h"
 #include "mqtt.h"
 #include "hx711.h"
 #include "motor.h"
@@ -10,14 +11,85 @@
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "nvs_journal.h"
+#include "time_sync.h"
+#include "time_format.h"
+#include "topics.h"
+#include "publisher.h"
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <sys/time.h>
 
 static const char *TAG = "ALARMS";
 
+/** @brief Label of the NVS partition holding the alarms journal */
+#define ALARMS_PARTITION "alarms"
+
+/** @brief NVS namespace of the alarms journal */
+#define ALARMS_NAMESPACE "alarms"
+
+/** @brief Format version of the journal records, bump on layout changes */
+#define ALARMS_JOURNAL_VERSION 2
+
+/** @brief Number of journal records after which the journal is compacted */
+#define ALARMS_COMPACT_THRESHOLD 128
+
+/** @brief log2 of the size of the alarm ID index */
+#define ALARMS_INDEX_BITS 11
+
+/** @brief Size of the alarm ID index, a power of two at least twice `MAX_ALARMS` */
+#define ALARMS_INDEX_SIZE (1 << ALARMS_INDEX_BITS)
+
+/** @brief Marker of an empty alarm ID index entry */
+#define ALARMS_INDEX_EMPTY -1
+
+/** @brief Interval in milliseconds at which a streamed listing checks for room in the bulk queue */
+#define ALARMS_STREAM_POLL_MS 200
+
+/** @brief Room kept at the end of an alarms page for `], "next_cursor": <id>}` */
+#define ALARMS_PAGE_TRAILER_MAX 48
+
+/**
+ * @brief Compact in-memory representation of an alarm rule.
+ *
+ * Only the next occurrence is stored; following occurrences are computed
+ * lazily from the recurrence fields when the rule fires.
+ */
+typedef struct {
+    time_t next;              /**< @brief Next occurrence, seconds since the epoch */
+    uint32_t id;              /**< @brief Stable ID of the alarm */
+    int32_t target_weight;    /**< @brief Target weight to achieve */
+    uint32_t repeat_interval; /**< @brief Seconds between occurrences, 0 if not used */
+    uint8_t repeat_days;      /**< @brief Allowed days of week (bit 0 = Sunday), 0 if not used */
+} alarm_slot_t;
+
+/** @brief Operations recorded in the alarms journal */
+typedef enum {
+    ALARM_RECORD_ADD = 1,   /**< @brief Alarm appended to the list */
+    ALARM_RECORD_DELETE,    /**< @brief Alarm removed from the list */
+    ALARM_RECORD_SET,       /**< @brief Alarm updated or moved to its next occurrence */
+} alarm_record_op_t;
+
+/**
+ * @brief Journal record describing one change of the alarms list.
+ */
+typedef struct {
+    uint8_t op;          /**< @brief One of `alarm_record_op_t` */
+    alarm_slot_t slot;   /**< @brief Alarm after the change; only `id` is used for deletes */
+} alarm_record_t;
+
+/**
+ * @brief Replay progress of the alarms snapshot.
+ */
+typedef struct {
+    size_t offset;       /**< @brief Number of snapshot bytes restored so far */
+} alarm_replay_t;
+
 /** @brief List of alarms */
-static Alarm_t alarms_list[MAX_ALARMS];
+static alarm_slot_t alarms_list[MAX_ALARMS];
 
 /** @brief Current count of alarms in the list */
 static int alarms_count = 0;
@@ -25,32 +97,432 @@ static int alarms_count = 0;
 /** @brief Mutex to protect access to the alarms list */
 static SemaphoreHandle_t alarms_mutex = NULL;
 
+/** @brief Handle of the alarms task, woken by notifications */
+static TaskHandle_t alarms_task_handle = NULL;
+
+/** @brief One-shot timer armed for the earliest due alarm */
+static esp_timer_handle_t alarms_timer = NULL;
+
+/** @brief Journal persisting the alarms list in NVS */
+static nvs_journal_t alarms_journal;
+
+/** @brief Whether the alarms journal could be opened */
+static bool alarms_persistent = false;
+
+/** @brief Open-addressing index mapping alarm IDs to positions in `alarms_list` */
+static int16_t alarms_index[ALARMS_INDEX_SIZE];
+
+/** @brief Latest due alarm waiting for the fill rate limit, owned by `alarms_task` */
+static alarm_slot_t pending_fill;
+
+/** @brief Whether `pending_fill` holds an alarm to fire */
+static bool fill_pending = false;
+
+/** @brief Monotonic time of the last alarm-triggered fill in microseconds, or -1 if none */
+static int64_t last_fill_us = -1;
+
+/** @brief Whether recurring alarms must be rewound after the clock jumped back; guarded by `clock_lock` */
+static bool rewind_pending = false;
+
+/** @brief Spinlock guarding `rewind_pending`, set from the tasks changing the clock */
+static portMUX_TYPE clock_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief ID after which the next streamed page starts, or -1 if no listing is streamed; guarded by `alarms_mutex` */
+static int64_t stream_after = -1;
+
+/** @brief Maximum number of alarms per streamed page, guarded by `alarms_mutex` */
+static int stream_limit = ALARMS_PAGE_SIZE;
+
 /** @brief Forward declaration of the fill_water_to function */
 extern void fill_water_to(int32_t target_weight);
 
 /**
- * @brief Compares two time structures for equality.
+ * @brief Returns the current wall-clock time in microseconds.
+ *
+ * @return Microseconds since the epoch.
+ */
+static int64_t now_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/**
+ * @brief Checks whether the local day of week of a time is allowed by a bitmask.
+ *
+ * @param t Time in seconds since the epoch.
+ * @param days Bitmask of allowed days of week (bit 0 = Sunday).
+ * @return `true` if the day is allowed or the mask is empty, `false` otherwise.
+ */
+static bool is_day_allowed(time_t t, uint8_t days) {
+    if (days == 0) {
+        return true;
+    }
+    struct tm tm_t;
+    localtime_r(&t, &tm_t);
+    return (days & (1 << tm_t.tm_wday)) != 0;
+}
+
+/**
+ * @brief Returns the local midnight of the day following a given time.
+ *
+ * @param t Time in seconds since the epoch.
+ * @return Start of the next local day in seconds since the epoch.
+ */
+static time_t next_local_midnight(time_t t) {
+    struct tm tm_t;
+    localtime_r(&t, &tm_t);
+    tm_t.tm_mday += 1;
+    tm_t.tm_hour = 0;
+    tm_t.tm_min = 0;
+    tm_t.tm_sec = 0;
+    tm_t.tm_isdst = -1;
+    return mktime(&tm_t);
+}
+
+/**
+ * @brief Computes the first occurrence of a rule strictly after a given time.
+ *
+ * Interval rules step in multiples of `repeat_interval` from the current occurrence,
+ * skipping days not allowed by `repeat_days`. Day-of-week rules repeat at the same
+ * local time of day on every allowed day.
+ *
+ * @param slot The alarm rule, `next` being its current occurrence.
+ * @param after Time after which the next occurrence must fall.
+ * @param next Pointer where the next occurrence is stored.
+ * @return `true` if an occurrence exists, `false` if the rule never fires again.
+ */
+static bool next_occurrence(const alarm_slot_t *slot, time_t after, time_t *next) {
+    if (slot->repeat_interval > 0) {
+        time_t n = slot->next;
+        if (n <= after) {
+            n += ((after - n) / slot->repeat_interval + 1) * slot->repeat_interval;
+        }
+        // At most 7 distinct days can be visited before the pattern repeats
+        for (int i = 0; i < 8; i++) {
+            if (is_day_allowed(n, slot->repeat_days)) {
+                *next = n;
+                return true;
+            }
+            time_t midnight = next_local_midnight(n);
+            n += ((midnight - n + slot->repeat_interval - 1) / slot->repeat_interval) * slot->repeat_interval;
+        }
+        return false;
+    }
+
+    if (slot->repeat_days != 0) {
+        struct tm time_of_day;
+        localtime_r(&slot->next, &time_of_day);
+
+        struct tm candidate;
+        time_t start = (slot->next > after) ? slot->next : after;
+        localtime_r(&start, &candidate);
+        for (int i = 0; i < 8; i++) {
+            candidate.tm_hour = time_of_day.tm_hour;
+            candidate.tm_min = time_of_day.tm_min;
+            candidate.tm_sec = time_of_day.tm_sec;
+            candidate.tm_isdst = -1;
+            time_t n = mktime(&candidate);
+            if (n > after && (slot->repeat_days & (1 << candidate.tm_wday))) {
+                *next = n;
+                return true;
+            }
+            candidate.tm_mday += 1;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Returns the home bucket of an alarm ID in the index.
+ *
+ * @param id Alarm ID.
+ * @return Index bucket where probing for the ID starts.
+ */
+static uint32_t index_home(uint32_t id) {
+    return (id * 2654435761u) >> (32 - ALARMS_INDEX_BITS);
+}
+
+/**
+ * @brief Finds the index bucket holding an alarm ID.
+ *
+ * Must be called with `alarms_mutex` held.
+ *
+ * @param id Alarm ID.
+ * @return Bucket holding the ID, or -1 if the ID is unknown.
+ */
+static int index_bucket_locked(uint32_t id) {
+    uint32_t b = index_home(id);
+    while (alarms_index[b] != ALARMS_INDEX_EMPTY) {
+        if (alarms_list[alarms_index[b]].id == id) {
+            return b;
+        }
+        b = (b + 1) & (ALARMS_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+/**
+ * @brief Finds the position of an alarm in the list by its ID, in O(1).
+ *
+ * Must be called with `alarms_mutex` held.
+ *
+ * @param id Alarm ID.
+ * @return Position of the alarm in `alarms_list`, or -1 if not found.
+ */
+static int find_alarm_locked(uint32_t id) {
+    int b = index_bucket_locked(id);
+    return (b < 0) ? -1 : alarms_index[b];
+}
+
+/**
+ * @brief Records the position of an alarm in the index.
+ *
+ * Must be called with `alarms_mutex` held, after the alarm is stored at position `i`.
+ *
+ * @param i Position of the alarm in `alarms_list`.
+ */
+static void index_insert_locked(int i) {
+    uint32_t b = index_home(alarms_list[i].id);
+    while (alarms_index[b] != ALARMS_INDEX_EMPTY) {
+        b = (b + 1) & (ALARMS_INDEX_SIZE - 1);
+    }
+    alarms_index[b] = i;
+}
+
+/**
+ * @brief Removes an alarm ID from the index.
+ *
+ * Uses backward-shift deletion so no tombstones are left behind.
+ * Must be called with `alarms_mutex` held.
+ *
+ * @param id Alarm ID.
+ */
+static void index_remove_locked(uint32_t id) {
+    int hole = index_bucket_locked(id);
+    if (hole < 0) {
+        return;
+    }
+
+    uint32_t b = hole;
+    while (1) {
+        b = (b + 1) & (ALARMS_INDEX_SIZE - 1);
+        if (alarms_index[b] == ALARMS_INDEX_EMPTY) {
+            break;
+        }
+        // Move the entry into the hole unless its home lies cyclically in (hole, b]
+        uint32_t home = index_home(alarms_list[alarms_index[b]].id);
+        uint32_t dist_home = (b - home) & (ALARMS_INDEX_SIZE - 1);
+        uint32_t dist_hole = (b - hole) & (ALARMS_INDEX_SIZE - 1);
+        if (dist_home >= dist_hole) {
+            alarms_index[hole] = alarms_index[b];
+            hole = b;
+        }
+    }
+    alarms_index[hole] = ALARMS_INDEX_EMPTY;
+}
+
+/**
+ * @brief Rebuilds the index from the alarms list.
+ *
+ * Must be called with `alarms_mutex` held.
+ */
+static void index_rebuild_locked(void) {
+    for (int b = 0; b < ALARMS_INDEX_SIZE; b++) {
+        alarms_index[b] = ALARMS_INDEX_EMPTY;
+    }
+    for (int i = 0; i < alarms_count; i++) {
+        index_insert_locked(i);
+    }
+}
+
+/**
+ * @brief Draws a new unique, non-zero alarm ID.
+ *
+ * Must be called with `alarms_mutex` held.
+ *
+ * @return The new alarm ID.
+ */
+static uint32_t new_alarm_id_locked(void) {
+    uint32_t id;
+    do {
+        id = esp_random();
+    } while (id == ALARM_ID_NONE || index_bucket_locked(id) >= 0);
+    return id;
+}
+
+/**
+ * @brief Appends an alarm to the list and the index.
+ *
+ * Must be called with `alarms_mutex` held and room left in the list.
+ *
+ * @param slot The alarm to append.
+ */
+static void append_alarm_locked(const alarm_slot_t *slot) {
+    alarms_list[alarms_count] = *slot;
+    index_insert_locked(alarms_count);
+    alarms_count++;
+}
+
+/**
+ * @brief Removes an alarm from the list in O(1) by moving the last alarm into its place.
+ *
+ * Must be called with `alarms_mutex` held.
+ *
+ * @param i Position of the alarm to remove.
+ */
+static void remove_alarm_locked(int i) {
+    int last = alarms_count - 1;
+
+    index_remove_locked(alarms_list[i].id);
+    if (i != last) {
+        int b = index_bucket_locked(alarms_list[last].id);
+        alarms_list[i] = alarms_list[last];
+        alarms_index[b] = i;
+    }
+    alarms_count--;
+}
+
+/**
+ * @brief Appends a change of the alarms list to the journal.
  *
- * This function checks if all components of the provided `struct tm` instances are equal.
+ * Must be called with `alarms_mutex` held so records keep the order of changes.
+ *
+ * @param op One of `alarm_record_op_t`.
+ * @param slot The alarm after the change.
+ */
+static void journal_locked(alarm_record_op_t op, const alarm_slot_t *slot) {
+    if (!alarms_persistent) {
+        return;
+    }
+    // Cleared first so the padding stored in NVS is deterministic
+    alarm_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.op = op;
+    memcpy(&record.slot, slot, sizeof(record.slot));
+    nvs_journal_append(&alarms_journal, &record, sizeof(record));
+}
+
+/**
+ * @brief Restores the alarms list from a part of the journal snapshot.
  *
- * @param a Pointer to the first time structure.
- * @param b Pointer to the second time structure.
- * @return `true` if both times are equal, `false` otherwise.
+ * @param data Pointer to the snapshot part.
+ * @param len Length of the part in bytes.
+ * @param ctx Pointer to the `alarm_replay_t` progress.
+ * @return `ESP_OK`, or `ESP_ERR_INVALID_SIZE` if the snapshot does not fit the alarms list.
  */
-static bool is_time_equal(const struct tm *a, const struct tm *b) {
-    return (a->tm_year == b->tm_year) &&
-           (a->tm_mon == b->tm_mon) &&
-           (a->tm_mday == b->tm_mday) &&
-           (a->tm_hour == b->tm_hour) &&
-           (a->tm_min == b->tm_min) &&
-           (a->tm_sec == b->tm_sec);
+static esp_err_t replay_snapshot(const void *data, size_t len, void *ctx) {
+    alarm_replay_t *replay = ctx;
+    if (replay->offset + len > sizeof(alarms_list)) {
+        ESP_LOGE(TAG, "Alarms snapshot larger than the alarms list");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy((uint8_t *)alarms_list + replay->offset, data, len);
+    replay->offset += len;
+
+    // Index the alarms completed by this part
+    while (alarms_count < (int)(replay->offset / sizeof(alarm_slot_t))) {
+        index_insert_locked(alarms_count);
+        alarms_count++;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Applies one journal record to the alarms list.
+ *
+ * @param data Pointer to the record.
+ * @param len Length of the record in bytes.
+ * @param ctx Unused.
+ * @return `ESP_OK`; records that cannot be applied are skipped.
+ */
+static esp_err_t replay_record(const void *data, size_t len, void *ctx) {
+    alarm_record_t record;
+    if (len != sizeof(record)) {
+        ESP_LOGE(TAG, "Skipping journal record of unexpected size %u", (unsigned)len);
+        return ESP_OK;
+    }
+    memcpy(&record, data, sizeof(record));
+
+    int i = find_alarm_locked(record.slot.id);
+    switch (record.op) {
+        case ALARM_RECORD_ADD:
+            if (i < 0 && alarms_count < MAX_ALARMS) {
+                append_alarm_locked(&record.slot);
+            }
+            break;
+        case ALARM_RECORD_DELETE:
+            if (i >= 0) {
+                remove_alarm_locked(i);
+            }
+            break;
+        case ALARM_RECORD_SET:
+            if (i >= 0) {
+                alarms_list[i] = record.slot;
+            }
+            break;
+        default:
+            ESP_LOGE(TAG, "Skipping unknown journal record %u", record.op);
+            break;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Loads the alarms persisted in NVS.
+ *
+ * Replays the journal snapshot and the records appended after it, in O(n). If the
+ * replay fails the journal is left untouched: the alarms start empty and are not
+ * persisted, since compacting would replace the stored alarms with the empty list.
+ */
+static void load_alarms(void) {
+    if (nvs_journal_open(&alarms_journal, ALARMS_PARTITION, ALARMS_NAMESPACE, ALARMS_JOURNAL_VERSION) != ESP_OK) {
+        ESP_LOGE(TAG, "Alarms journal unavailable, alarms will not persist");
+        return;
+    }
+
+    alarm_replay_t replay = { 0 };
+    if (nvs_journal_replay(&alarms_journal, replay_snapshot, replay_record, &replay) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to replay alarms journal, stored alarms NOT loaded; "
+                      "alarms will not persist until the \"%s\" partition is erased", ALARMS_PARTITION);
+        alarms_count = 0;
+        index_rebuild_locked();
+        return;
+    }
+    alarms_persistent = true;
+    ESP_LOGI(TAG, "Loaded %d alarms from NVS", alarms_count);
+}
+
+/**
+ * @brief Folds the alarms journal into a new snapshot once it grows too long.
+ */
+static void compact_alarms_journal(void) {
+    if (!alarms_persistent || nvs_journal_length(&alarms_journal) < ALARMS_COMPACT_THRESHOLD) {
+        return;
+    }
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
+        nvs_journal_compact(&alarms_journal, alarms_list, alarms_count * sizeof(alarm_slot_t));
+        xSemaphoreGive(alarms_mutex);
+    }
+}
+
+/**
+ * @brief Callback of the one-shot alarms timer.
+ *
+ * Runs in the esp_timer task and only notifies the alarms task.
+ *
+ * @param arg Argument passed to the callback (unused).
+ */
+static void alarms_timer_cb(void *arg) {
+    xTaskNotifyGive(alarms_task_handle);
 }
 
 /**
  * @brief Initializes the alarms module.
  *
- * This function creates a mutex to protect the alarms list and starts the FreeRTOS task
- * responsible for monitoring and triggering alarms.
+ * This function creates a mutex to protect the alarms list, restores the alarms persisted
+ * in NVS, creates the one-shot timer used to wake up on the earliest due alarm, and starts
+ * the FreeRTOS task responsible for monitoring and triggering alarms.
  */
 void alarms_init(void) {
     // Create mutex
@@ -60,185 +532,718 @@ void alarms_init(void) {
         return;
     }
 
+    // Restore persisted alarms
+    index_rebuild_locked();
+    load_alarms();
+
+    // Create wakeup timer for the earliest due alarm
+    const esp_timer_create_args_t timer_args = {
+        .callback = alarms_timer_cb,
+        .name = "alarms_timer",
+    };
+    if (esp_timer_create(&timer_args, &alarms_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create alarms_timer");
+        return;
+    }
+
     // Start alarms monitoring task
-    xTaskCreate(alarms_task, "alarms_task", 4096, NULL, 5, NULL);
+    xTaskCreate(alarms_task, "alarms_task", 4096, NULL, 5, &alarms_task_handle);
     ESP_LOGI(TAG, "Alarms module initialized.");
 }
 
 /**
- * @brief Adds an alarm to the alarms list.
+ * @brief Wakes the alarms task to recompute the next wakeup time.
  *
- * This function adds a new alarm to the `alarms_list` if there is space available.
- * It ensures thread-safe access using a mutex.
+ * Must be called whenever the alarms list changes; clock changes go through `alarms_clock_changed()`.
+ */
+void alarms_reschedule(void) {
+    if (alarms_task_handle != NULL) {
+        xTaskNotifyGive(alarms_task_handle);
+    }
+}
+
+/**
+ * @brief Converts an alarm to its stored form.
  *
- * @param alarm Pointer to the `Alarm_t` structure to be added.
- * @return `true` if the alarm was successfully added, `false` if the list is full or an error occurred.
+ * Recurring alarms whose first timestamp falls on a day not allowed by `repeat_days`
+ * start on the first allowed day instead.
+ *
+ * @param alarm Pointer to the alarm.
+ * @param slot Pointer where the stored form is written; `id` is left untouched.
+ * @return `true` on success, `false` if the timestamp is invalid or the rule never fires.
  */
-bool add_alarm(const Alarm_t *alarm) {
-    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
-        if (alarms_count >= MAX_ALARMS) {
-            ESP_LOGE(TAG, "Alarms list full, cannot add alarm.");
-            xSemaphoreGive(alarms_mutex);
-            return false;
+static bool make_slot(const Alarm_t *alarm, alarm_slot_t *slot) {
+    struct tm first = alarm->timestamp;
+    slot->next = mktime(&first);
+    slot->target_weight = alarm->target_weight;
+    slot->repeat_interval = alarm->repeat_interval;
+    slot->repeat_days = alarm->repeat_days & ALARM_REPEAT_EVERY_DAY;
+    if (slot->next == -1) {
+        ESP_LOGE(TAG, "Invalid alarm timestamp.");
+        return false;
+    }
+    if (!is_day_allowed(slot->next, slot->repeat_days) &&
+        !next_occurrence(slot, slot->next, &slot->next)) {
+        ESP_LOGE(TAG, "Alarm rule never fires.");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies one alarm operation.
+ *
+ * Must be called with `alarms_mutex` held.
+ *
+ * @param op Pointer to the operation.
+ * @return ID of the affected alarm, or `ALARM_ID_NONE` if the operation failed.
+ */
+static uint32_t apply_op_locked(const alarm_op_t *op) {
+    alarm_slot_t slot = { 0 };
+    int i;
+
+    switch (op->type) {
+        case ALARM_OP_ADD:
+            if (alarms_count >= MAX_ALARMS) {
+                ESP_LOGE(TAG, "Alarms list full, cannot add alarm.");
+                return ALARM_ID_NONE;
+            }
+            if (!make_slot(&op->alarm, &slot)) {
+                return ALARM_ID_NONE;
+            }
+            slot.id = new_alarm_id_locked();
+            append_alarm_locked(&slot);
+            journal_locked(ALARM_RECORD_ADD, &slot);
+            return slot.id;
+
+        case ALARM_OP_UPDATE:
+            i = find_alarm_locked(op->id);
+            if (i < 0) {
+                ESP_LOGE(TAG, "Alarm %lu not found for update.", (unsigned long)op->id);
+                return ALARM_ID_NONE;
+            }
+            if (!make_slot(&op->alarm, &slot)) {
+                return ALARM_ID_NONE;
+            }
+            slot.id = op->id;
+            alarms_list[i] = slot;
+            journal_locked(ALARM_RECORD_SET, &slot);
+            return slot.id;
+
+        case ALARM_OP_DELETE:
+            i = find_alarm_locked(op->id);
+            if (i < 0) {
+                ESP_LOGE(TAG, "Alarm %lu not found for deletion.", (unsigned long)op->id);
+                return ALARM_ID_NONE;
+            }
+            slot = alarms_list[i];
+            remove_alarm_locked(i);
+            journal_locked(ALARM_RECORD_DELETE, &slot);
+            return slot.id;
+
+        case ALARM_OP_INVALID:
+            ESP_LOGE(TAG, "Invalid alarm operation skipped.");
+            return ALARM_ID_NONE;
+
+        default:
+            return ALARM_ID_NONE;
+    }
+}
+
+/**
+ * @brief Applies a batch of alarm operations.
+ *
+ * The operations are applied in order under a single acquisition of the mutex, and the
+ * alarms task is rescheduled once for the whole batch. Each operation succeeds or fails
+ * on its own.
+ *
+ * @param ops Array of operations.
+ * @param count Number of operations.
+ * @param ids Optional array of `count` entries receiving the ID of each affected alarm,
+ *            or `ALARM_ID_NONE` for failed operations.
+ * @return Number of operations that succeeded.
+ */
+size_t alarms_apply(const alarm_op_t *ops, size_t count, uint32_t *ids) {
+    size_t applied = 0;
+
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) != pdTRUE) {
+        return 0;
+    }
+    for (size_t n = 0; n < count; n++) {
+        uint32_t id = apply_op_locked(&ops[n]);
+        if (ids != NULL) {
+            ids[n] = id;
         }
+        if (id != ALARM_ID_NONE) {
+            applied++;
+        }
+    }
+    int total = alarms_count;
+    xSemaphoreGive(alarms_mutex);
 
-        // Add alarm to the list
-        alarms_list[alarms_count] = *alarm;
-        alarms_count++;
-        ESP_LOGI(TAG, "Alarm added: %04d-%02d-%02dT%02d:%02d:%02d, target_weight=%ld",
-                 alarm->timestamp.tm_year + 1900,
-                 alarm->timestamp.tm_mon + 1,
-                 alarm->timestamp.tm_mday,
-                 alarm->timestamp.tm_hour,
-                 alarm->timestamp.tm_min,
-                 alarm->timestamp.tm_sec,
-                 alarm->target_weight);
-        xSemaphoreGive(alarms_mutex);
-        return true;
+    ESP_LOGI(TAG, "Applied %u of %u alarm operations, %d alarms set", (unsigned)applied, (unsigned)count, total);
+    if (applied > 0) {
+        alarms_reschedule();
     }
-    return false;
+    return applied;
+}
+
+/**
+ * @brief Adds an alarm to the alarms list.
+ *
+ * This function adds a new alarm to the `alarms_list` if there is space available and
+ * assigns it a stable ID. Recurring alarms whose first timestamp falls on a day not
+ * allowed by `repeat_days` start on the first allowed day instead.
+ *
+ * @param alarm Pointer to the `Alarm_t` structure to be added.
+ * @return ID of the new alarm, or `ALARM_ID_NONE` if the list is full or an error occurred.
+ */
+uint32_t add_alarm(const Alarm_t *alarm) {
+    alarm_op_t op = {
+        .type = ALARM_OP_ADD,
+        .alarm = *alarm,
+    };
+    uint32_t id = ALARM_ID_NONE;
+    alarms_apply(&op, 1, &id);
+    return id;
+}
+
+/**
+ * @brief Replaces an existing alarm, keeping its ID.
+ *
+ * @param id ID of the alarm to update.
+ * @param alarm Pointer to the new alarm settings.
+ * @return `true` if the alarm was updated, `false` if not found or the alarm is invalid.
+ */
+bool update_alarm(uint32_t id, const Alarm_t *alarm) {
+    alarm_op_t op = {
+        .type = ALARM_OP_UPDATE,
+        .id = id,
+        .alarm = *alarm,
+    };
+    return alarms_apply(&op, 1, NULL) == 1;
+}
+
+/**
+ * @brief Deletes an alarm by its ID, in O(1).
+ *
+ * @param id ID of the alarm to delete.
+ * @return `true` if the alarm was deleted, `false` if not found.
+ */
+bool delete_alarm_by_id(uint32_t id) {
+    alarm_op_t op = {
+        .type = ALARM_OP_DELETE,
+        .id = id,
+    };
+    return alarms_apply(&op, 1, NULL) == 1;
 }
 
 /**
  * @brief Deletes an alarm from the alarms list based on its timestamp.
  *
- * This function searches for an alarm matching the provided timestamp and removes it
- * from the `alarms_list`. It ensures thread-safe access using a mutex.
+ * This function searches for an alarm whose next occurrence matches the provided timestamp
+ * and removes it from the `alarms_list`. For recurring alarms this removes the whole rule.
+ * Kept for clients that do not track alarm IDs; prefer `delete_alarm_by_id()`.
  *
  * @param timestamp Pointer to the `struct tm` representing the time of the alarm to delete.
  * @return `true` if the alarm was successfully deleted, `false` if not found or an error occurred.
  */
 bool delete_alarm(const struct tm *timestamp) {
+    struct tm tm_del = *timestamp;
+    time_t t = mktime(&tm_del);
+    uint32_t id = ALARM_ID_NONE;
+
     if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
         for (int i = 0; i < alarms_count; i++) {
-            if (is_time_equal(&alarms_list[i].timestamp, timestamp)) {
-                // Remove alarm by shifting the rest
-                for (int j = i; j < alarms_count -1; j++) {
-                    alarms_list[j] = alarms_list[j+1];
-                }
-                alarms_count--;
-                ESP_LOGI(TAG, "Alarm deleted: %04d-%02d-%02dT%02d:%02d:%02d",
-                         timestamp->tm_year + 1900,
-                         timestamp->tm_mon + 1,
-                         timestamp->tm_mday,
-                         timestamp->tm_hour,
-                         timestamp->tm_min,
-                         timestamp->tm_sec);
-                xSemaphoreGive(alarms_mutex);
-                return true;
+            if (alarms_list[i].next == t) {
+                id = alarms_list[i].id;
+                break;
             }
         }
-        ESP_LOGE(TAG, "Alarm not found for deletion: %04d-%02d-%02dT%02d:%02d:%02d",
-                 timestamp->tm_year + 1900,
-                 timestamp->tm_mon + 1,
-                 timestamp->tm_mday,
-                 timestamp->tm_hour,
-                 timestamp->tm_min,
-                 timestamp->tm_sec);
         xSemaphoreGive(alarms_mutex);
+    }
+
+    if (id == ALARM_ID_NONE) {
+        char timestamp_str[TIME_FORMAT_ISO_SIZE];
+        time_format_iso_tm(timestamp, timestamp_str);
+        ESP_LOGE(TAG, "Alarm not found for deletion: %s", timestamp_str);
         return false;
     }
-    return false;
+    return delete_alarm_by_id(id);
+}
+
+/**
+ * @brief Formats one alarm as a JSON object.
+ *
+ * Carries the alarm ID and next occurrence, plus the recurrence fields for recurring alarms.
+ *
+ * @param buf Output buffer.
+ * @param size Size of the output buffer.
+ * @param alarm The alarm to format.
+ * @return Number of characters that would have been written, as `snprintf`.
+ */
+static int format_alarm(char *buf, size_t size, const alarm_slot_t *alarm) {
+    char next[TIME_FORMAT_ISO_SIZE];
+    time_format_iso(alarm->next, next);
+
+    if (alarm->repeat_days != 0 || alarm->repeat_interval != 0) {
+        return snprintf(buf, size,
+                        "{\"alarm_id\": %lu, \"timestamp\": \"%s\", \"target_weight\": %ld, \"repeat_days\": %u, \"repeat_interval\": %lu}",
+                        (unsigned long)alarm->id,
+                        next,
+                        alarm->target_weight,
+                        alarm->repeat_days,
+                        alarm->repeat_interval);
+    }
+    return snprintf(buf, size,
+                    "{\"alarm_id\": %lu, \"timestamp\": \"%s\", \"target_weight\": %ld}",
+                    (unsigned long)alarm->id,
+                    next,
+                    alarm->target_weight);
+}
+
+/**
+ * @brief Copies the alarms with the smallest IDs above a cursor, in increasing ID order.
+ *
+ * Positions in `alarms_list` change when alarms are removed, IDs do not, so pages
+ * walk the IDs. Must be called with `alarms_mutex` held.
+ *
+ * @param after ID after which the page starts.
+ * @param limit Maximum number of alarms in the page, at most `ALARMS_PAGE_SIZE`.
+ * @param page Array of `limit` entries receiving the alarms.
+ * @param count Pointer where the number of copied alarms is stored.
+ * @return Number of alarms with an ID above `after`, copied or not.
+ */
+static int page_after_locked(uint32_t after, int limit, alarm_slot_t *page, int *count) {
+    int remaining = 0;
+
+    *count = 0;
+    for (int i = 0; i < alarms_count; i++) {
+        const alarm_slot_t *slot = &alarms_list[i];
+        if (slot->id <= after) {
+            continue;
+        }
+        remaining++;
+
+        // Insert into the sorted page, dropping its largest ID once full
+        int j;
+        if (*count < limit) {
+            j = (*count)++;
+        } else if (slot->id < page[limit - 1].id) {
+            j = limit - 1;
+        } else {
+            continue;
+        }
+        while (j > 0 && page[j - 1].id > slot->id) {
+            page[j] = page[j - 1];
+            j--;
+        }
+        page[j] = *slot;
+    }
+    return remaining;
 }
 
 /**
- * @brief Retrieves all alarms and publishes them via MQTT.
+ * @brief Publishes one page of alarms via MQTT.
+ *
+ * Copies the requested page under the mutex and formats it after releasing it. A page
+ * whose alarms do not all fit the buffer ends early, its `next_cursor` resuming after
+ * the last alarm included.
  *
- * This function constructs a JSON payload containing all alarms in the `alarms_list`
- * and publishes it to the MQTT topic `hydrapet0001/update/get/alarms`.
+ * @param after ID after which the page starts, 0 for the first page.
+ * @param limit Maximum number of alarms in the page, at most `ALARMS_PAGE_SIZE`.
+ * @param next_cursor Pointer where the cursor of the next page is stored, -1 after the last page.
+ * @return `true` if the page was queued or could not be formatted, `false` if the bulk queue was full.
  */
-void get_alarms(void) {
+static bool publish_alarms_page(uint32_t after, int limit, int64_t *next_cursor) {
+    alarm_slot_t page[ALARMS_PAGE_SIZE];
+    int count = 0;
+    int remaining = 0;
+    int total = 0;
+
+    // Snapshot the page
     if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) != pdTRUE) {
         ESP_LOGE(TAG, "Failed to take alarms_mutex");
-        return;
+        *next_cursor = -1;
+        return false;
     }
+    total = alarms_count;
+    remaining = page_after_locked(after, limit, page, &count);
+    xSemaphoreGive(alarms_mutex);
 
-    // Start building JSON payload
-    char json_payload[1024];
-    size_t offset = 0;
-    offset += snprintf(json_payload + offset, sizeof(json_payload) - offset, "{\"alarms\": [");
+    // Format outside the lock, keeping room for the closing fields
+    char json_payload[160 + ALARMS_PAGE_SIZE * 152];
+    const size_t size = sizeof(json_payload) - ALARMS_PAGE_TRAILER_MAX;
+    int len = snprintf(json_payload, size, "{\"cursor\": %lu, \"total\": %d, \"alarms\": [",
+                       (unsigned long)after, total);
+    if (len < 0 || (size_t)len >= size) {
+        ESP_LOGE(TAG, "Alarms page header does not fit the buffer");
+        *next_cursor = -1;
+        return true;
+    }
+    size_t offset = len;
 
-    for (int i = 0; i < alarms_count; i++) {
-        const Alarm_t *alarm = &alarms_list[i];
-        offset += snprintf(json_payload + offset, sizeof(json_payload) - offset,
-                         "{\"timestamp\": \"%04d-%02d-%02dT%02d:%02d:%02d\", \"target_weight\": %ld}%s",
-                         alarm->timestamp.tm_year + 1900,
-                         alarm->timestamp.tm_mon + 1,
-                         alarm->timestamp.tm_mday,
-                         alarm->timestamp.tm_hour,
-                         alarm->timestamp.tm_min,
-                         alarm->timestamp.tm_sec,
-                         alarm->target_weight,
-                         (i < alarms_count -1) ? "," : "");
-        if (offset >= sizeof(json_payload)) {
-            ESP_LOGE(TAG, "JSON payload buffer overflow");
+    int included = 0;
+    while (included < count) {
+        size_t separator = (included > 0) ? 1 : 0;
+        len = format_alarm(json_payload + offset + separator, size - offset - separator, &page[included]);
+        if (len < 0 || offset + separator + len >= size) {
             break;
         }
+        if (separator) {
+            json_payload[offset] = ',';
+        }
+        offset += separator + len;
+        included++;
+    }
+
+    if (included < count) {
+        // The next page starts at the first alarm left out; one that never fits is skipped
+        ESP_LOGW(TAG, "Alarms page ended after %d of %d alarms", included, count);
+        *next_cursor = (int64_t)page[(included > 0) ? included - 1 : 0].id;
+    } else {
+        *next_cursor = (remaining > count) ? (int64_t)page[count - 1].id : -1;
     }
 
-    offset += snprintf(json_payload + offset, sizeof(json_payload) - offset, "]}");
+    // The trailer always fits the room kept for it
+    offset += snprintf(json_payload + offset, sizeof(json_payload) - offset,
+                       "], \"next_cursor\": %lld}", (long long)*next_cursor);
 
+    return mqtt_publish_data(PUBLISH_CLASS_BULK, topic_get(TOPIC_INFO_ALARMS), json_payload, offset);
+}
+
+/**
+ * @brief Publishes the pages of the streamed listing that fit in the bulk queue.
+ *
+ * Called from the alarms task, so a long listing is paced by the bulk class without
+ * holding up the commands worker. A page refused by a full queue is retried later.
+ *
+ * @return `true` if pages are still waiting to be published, `false` otherwise.
+ */
+static bool stream_alarms(void) {
+    while (publisher_space(PUBLISH_CLASS_BULK) > 0) {
+        if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) != pdTRUE) {
+            ESP_LOGE(TAG, "Failed to take alarms_mutex");
+            return false;
+        }
+        int64_t after = stream_after;
+        int limit = stream_limit;
+        xSemaphoreGive(alarms_mutex);
+        if (after < 0) {
+            return false;
+        }
+
+        int64_t next_cursor;
+        if (!publish_alarms_page((uint32_t)after, limit, &next_cursor)) {
+            return true;
+        }
+
+        // A listing requested meanwhile starts over instead
+        if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
+            if (stream_after == after) {
+                stream_after = next_cursor;
+            }
+            xSemaphoreGive(alarms_mutex);
+        }
+        if (next_cursor < 0) {
+            ESP_LOGI(TAG, "Published all alarms.");
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Retrieves alarms and publishes them via MQTT, one page per message.
+ *
+ * Each page is published to the MQTT topic `<device_id>/hydrapetinfo/alarms`, lists
+ * alarms in increasing ID order and carries `next_cursor`, the ID of its last alarm
+ * or -1 after the last page. With a negative cursor all pages are streamed one after
+ * another by the alarms task as the bulk queue takes them, so any number of alarms can
+ * be listed with a bounded buffer and without blocking the caller.
+ *
+ * @param cursor ID after which the page starts, 0 for the first page, or negative to
+ *               stream all alarms.
+ * @param limit Maximum number of alarms per page; values outside 1..`ALARMS_PAGE_SIZE`
+ *              select `ALARMS_PAGE_SIZE`.
+ */
+void get_alarms(int64_t cursor, int limit) {
+    if (limit <= 0 || limit > ALARMS_PAGE_SIZE) {
+        limit = ALARMS_PAGE_SIZE;
+    }
+
+    if (cursor >= 0) {
+        int64_t next_cursor;
+        if (!publish_alarms_page((uint32_t)cursor, limit, &next_cursor)) {
+            ESP_LOGW(TAG, "Bulk queue full, alarms page after %lld dropped", (long long)cursor);
+        }
+        return;
+    }
+
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) != pdTRUE) {
+        ESP_LOGE(TAG, "Failed to take alarms_mutex");
+        return;
+    }
+    stream_after = 0;
+    stream_limit = limit;
     xSemaphoreGive(alarms_mutex);
+    alarms_reschedule();
+}
+
+/**
+ * @brief Takes all due alarms and applies the catch-up policy to them.
+ *
+ * One-shot alarms are removed from the list. Recurring alarms stay in place with their
+ * next occurrence advanced past `now`; rules that never fire again are removed. Of the
+ * due occurrences, only the latest one within `ALARM_CATCHUP_GRACE_S` is returned; the
+ * others are coalesced into it or skipped as too old.
+ *
+ * @param now Current time in seconds since the epoch.
+ * @param out Pointer where the alarm to fire is copied, `next` holding the due occurrence.
+ * @return `true` if an alarm should fire, `false` otherwise.
+ */
+static bool take_due_alarms(time_t now, alarm_slot_t *out) {
+    bool found = false;
+    int coalesced = 0;
+    int skipped = 0;
+
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < alarms_count; i++) {
+            alarm_slot_t *slot = &alarms_list[i];
+            if (slot->next > now) {
+                continue;
+            }
+            alarm_slot_t due = *slot;
+
+            if (next_occurrence(slot, now, &slot->next)) {
+                journal_locked(ALARM_RECORD_SET, slot);
+            } else {
+                remove_alarm_locked(i);
+                journal_locked(ALARM_RECORD_DELETE, &due);
+                i--; // The last alarm was moved into this position
+            }
+
+            if (due.next < now - ALARM_CATCHUP_GRACE_S) {
+                skipped++;
+            } else if (!found || due.next > out->next) {
+                coalesced += found;
+                *out = due;
+                found = true;
+            } else {
+                coalesced++;
+            }
+        }
+        xSemaphoreGive(alarms_mutex);
+    }
+
+    if (coalesced > 0 || skipped > 0) {
+        ESP_LOGW(TAG, "Missed alarms: %d coalesced, %d skipped as older than %d s",
+                 coalesced, skipped, ALARM_CATCHUP_GRACE_S);
+    }
+    return found;
+}
+
+/**
+ * @brief Moves recurring alarms back after the clock jumped backwards.
+ *
+ * Recurring alarms were advanced relative to the old clock, so their next occurrence
+ * may lie a whole period too late. Each one is recomputed as its first occurrence
+ * after `now`, following the same rule.
+ *
+ * @param now Current time in seconds since the epoch.
+ */
+static void rewind_recurring_alarms(time_t now) {
+    int rewound = 0;
+
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < alarms_count; i++) {
+            alarm_slot_t *slot = &alarms_list[i];
+            if (slot->next <= now || (slot->repeat_interval == 0 && slot->repeat_days == 0)) {
+                continue;
+            }
+
+            // Anchor the rule at or before `now`, then step forward
+            alarm_slot_t anchor = *slot;
+            if (slot->repeat_interval > 0) {
+                anchor.next -= ((slot->next - now + slot->repeat_interval - 1) / slot->repeat_interval) *
+                               slot->repeat_interval;
+            } else {
+                struct tm tm_anchor;
+                struct tm tm_next;
+                localtime_r(&now, &tm_anchor);
+                localtime_r(&slot->next, &tm_next);
+                tm_anchor.tm_hour = tm_next.tm_hour;
+                tm_anchor.tm_min = tm_next.tm_min;
+                tm_anchor.tm_sec = tm_next.tm_sec;
+                tm_anchor.tm_isdst = -1;
+                anchor.next = mktime(&tm_anchor);
+            }
+
+            time_t next;
+            if (next_occurrence(&anchor, now, &next) && next < slot->next) {
+                slot->next = next;
+                journal_locked(ALARM_RECORD_SET, slot);
+                rewound++;
+            }
+        }
+        xSemaphoreGive(alarms_mutex);
+    }
+    ESP_LOGI(TAG, "Rewound %d recurring alarms", rewound);
+}
+
+/**
+ * @brief Applies the alarms policy to a change of the system clock.
+ *
+ * Must be called after every `settimeofday()`. Forward jumps make the skipped alarms
+ * due, which the catch-up policy then coalesces or skips. Backward jumps larger than
+ * `ALARM_CLOCK_JUMP_S` move recurring alarms back to their first occurrence on the new
+ * clock. Only records the change and wakes the alarms task, which does the rewinding
+ * and journalling, so it can be called from the LwIP task.
+ *
+ * @param before System time before the change, in seconds since the epoch.
+ * @param after System time after the change, in seconds since the epoch.
+ */
+void alarms_clock_changed(time_t before, time_t after) {
+    time_t delta = after - before;
+
+    if (delta >= ALARM_CLOCK_JUMP_S || delta <= -ALARM_CLOCK_JUMP_S) {
+        ESP_LOGW(TAG, "Clock jumped by %lld s", (long long)delta);
+        if (delta < 0) {
+            taskENTER_CRITICAL(&clock_lock);
+            rewind_pending = true;
+            taskEXIT_CRITICAL(&clock_lock);
+        }
+    }
+    alarms_reschedule();
+}
 
-    // Publish to hydrapet0001/update/get/alarms
-    mqtt_publish("hydrapet0001/update/get/alarms", json_payload);
-    ESP_LOGI(TAG, "Published alarms: %s", json_payload);
+/**
+ * @brief Fires the pending alarm unless a fill ran less than `ALARM_FILL_MIN_SPACING_S` ago.
+ *
+ * @return Monotonic time in microseconds at which the pending alarm may fire, or 0 if
+ *         nothing is pending.
+ */
+static int64_t fire_pending_alarm(void) {
+    if (!fill_pending) {
+        return 0;
+    }
+
+    int64_t now = esp_timer_get_time();
+    int64_t allowed = (last_fill_us < 0) ? now : last_fill_us + ALARM_FILL_MIN_SPACING_S * 1000000LL;
+    if (now < allowed) {
+        return allowed;
+    }
+
+    char due[TIME_FORMAT_ISO_SIZE];
+    time_format_iso(pending_fill.next, due);
+    ESP_LOGI(TAG, "Triggering alarm %lu: %s, target_weight=%ld",
+             (unsigned long)pending_fill.id, due, pending_fill.target_weight);
+
+    // Trigger water filling
+    fill_water_to(pending_fill.target_weight);
+    last_fill_us = now;
+    fill_pending = false;
+    return 0;
+}
+
+/**
+ * @brief Finds the earliest due time among all alarms.
+ *
+ * @param due_us Pointer where the earliest due time (microseconds since the epoch) is stored.
+ * @return `true` if at least one alarm is pending, `false` if the list is empty.
+ */
+static bool next_due_us(int64_t *due_us) {
+    bool found = false;
+
+    if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
+        for (int i = 0; i < alarms_count; i++) {
+            int64_t t = (int64_t)alarms_list[i].next * 1000000LL;
+            if (!found || t < *due_us) {
+                *due_us = t;
+                found = true;
+            }
+        }
+        xSemaphoreGive(alarms_mutex);
+    }
+    return found;
 }
 
 /**
  * @brief Task responsible for monitoring and triggering alarms.
  *
- * This FreeRTOS task continuously checks the current time against the alarms in the `alarms_list`.
- * When an alarm's time is due, it triggers the alarm by initiating the water filling process
- * and removes the alarm from the list.
+ * This FreeRTOS task sleeps until it is notified, either by the one-shot timer armed for
+ * the earliest due alarm or by `alarms_reschedule()`. On each wakeup it takes every due
+ * alarm, removing one-shot alarms from the list and advancing recurring ones, and fires
+ * only the latest one that is at most `ALARM_CATCHUP_GRACE_S` late, at most once per
+ * `ALARM_FILL_MIN_SPACING_S`. A backlog of missed alarms after a reboot, an outage or a
+ * clock jump therefore results in a single fill. Alarms are held until the system time
+ * is valid, as reported by `time_sync_is_valid()`. The task also streams the listings
+ * requested by `get_alarms()`, polling every `ALARMS_STREAM_POLL_MS` while the bulk queue
+ * is full. With no alarms pending and no listing streamed the task never wakes up.
  *
  * @param pvParameters Argument passed to the task (unused).
  */
 void alarms_task(void *pvParameters) {
+    bool on_hold = false;
+
     while (1) {
-        // Get current time
-        time_t now;
-        struct tm timeinfo;
-        time(&now);
-        localtime_r(&now, &timeinfo);
+        TickType_t sleep = stream_alarms() ? pdMS_TO_TICKS(ALARMS_STREAM_POLL_MS) : portMAX_DELAY;
 
-        // Check for due alarms
-        if (xSemaphoreTake(alarms_mutex, portMAX_DELAY) == pdTRUE) {
-            for (int i = 0; i < alarms_count; i++) {
-                Alarm_t *alarm = &alarms_list[i];
-                // Convert alarm time to time_t
-                time_t alarm_time = mktime(&alarm->timestamp);
-                if (alarm_time <= now) {
-                    // Alarm is due, trigger it
-                    ESP_LOGI(TAG, "Triggering alarm: %04d-%02d-%02dT%02d:%02d:%02d, target_weight=%ld",
-                             alarm->timestamp.tm_year + 1900,
-                             alarm->timestamp.tm_mon + 1,
-                             alarm->timestamp.tm_mday,
-                             alarm->timestamp.tm_hour,
-                             alarm->timestamp.tm_min,
-                             alarm->timestamp.tm_sec,
-                             alarm->target_weight);
-
-                    // Copy alarm data
-                    Alarm_t triggered_alarm = *alarm;
-
-                    // Remove the alarm from the list by shifting
-                    for (int j = i; j < alarms_count -1; j++) {
-                        alarms_list[j] = alarms_list[j+1];
-                    }
-                    alarms_count--;
-                    i--; // Adjust index after shifting
-
-                    xSemaphoreGive(alarms_mutex);
-
-                    // Trigger water filling
-                    fill_water_to(triggered_alarm.target_weight);
-                }
+        // Due times mean nothing until the clock is set
+        if (!time_sync_is_valid()) {
+            if (!on_hold) {
+                ESP_LOGW(TAG, "System time not set, alarms on hold");
+                on_hold = true;
             }
-            xSemaphoreGive(alarms_mutex);
+            ulTaskNotifyTake(pdTRUE, sleep);
+            continue;
+        }
+        on_hold = false;
+
+        // Rewind against the clock as it is now, after any further change
+        taskENTER_CRITICAL(&clock_lock);
+        bool rewind = rewind_pending;
+        rewind_pending = false;
+        taskEXIT_CRITICAL(&clock_lock);
+        if (rewind) {
+            rewind_recurring_alarms(now_us() / 1000000LL);
+        }
+
+        // Take all due alarms, keeping the latest one for the next fill
+        alarm_slot_t due_alarm;
+        if (take_due_alarms(now_us() / 1000000LL, &due_alarm)) {
+            if (fill_pending) {
+                ESP_LOGW(TAG, "Alarm %lu superseded by alarm %lu",
+                         (unsigned long)pending_fill.id, (unsigned long)due_alarm.id);
+            }
+            pending_fill = due_alarm;
+            fill_pending = true;
+        }
+        int64_t fill_at_us = fire_pending_alarm();
+
+        // Keep the journal short
+        compact_alarms_journal();
+
+        // Arm the timer for the earliest remaining alarm or the rate-limited fill
+        esp_timer_stop(alarms_timer);
+        int64_t delay_us = -1;
+        int64_t due_us;
+        if (next_due_us(&due_us)) {
+            delay_us = due_us - now_us();
+            if (delay_us <= 0) {
+                continue; // Became due in the meantime
+            }
+        }
+        if (fill_at_us > 0) {
+            int64_t fill_delay_us = fill_at_us - esp_timer_get_time();
+            if (delay_us < 0 || fill_delay_us < delay_us) {
+                delay_us = (fill_delay_us > 0) ? fill_delay_us : 1;
+            }
+        }
+        if (delay_us > 0) {
+            esp_timer_start_once(alarms_timer, (uint64_t)delay_us);
         }
 
-        // Sleep for 1 second before next check
-        vTaskDelay(pdMS_TO_TICKS(1000));
+        // Sleep until the timer fires, the alarms/clock change or a streamed page may fit
+        ulTaskNotifyTake(pdTRUE, sleep);
     }
 }
@@ -10,17 +10,51 @@
 /** @brief Maximum number of alarms that can be stored */
 #define MAX_ALARMS 1000
 
+/** @brief Maximum number of alarms published in one `get_alarms` message */
+#define ALARMS_PAGE_SIZE 10
+
+/** @brief Maximum number of operations accepted in one bulk alarms message */
+#define ALARMS_BATCH_MAX 32
+
+/** @brief `repeat_days` value repeating an alarm on every day of the week */
+#define ALARM_REPEAT_EVERY_DAY 0x7F
+
+/** @brief Alarm ID never assigned to an alarm, used to report failures */
+#define ALARM_ID_NONE 0
+
 /**
  * @brief Structure representing an alarm.
  *
- * Each alarm consists of a timestamp indicating when it should trigger
- * and a target weight that specifies the desired weight to fill.
+ * Each alarm consists of a timestamp indicating when it should first trigger
+ * and a target weight that specifies the desired weight to fill. An alarm with
+ * no recurrence fields set fires once. Setting `repeat_interval` repeats it every
+ * given number of seconds; setting `repeat_days` repeats it at the same local time
+ * on the selected days of week, or restricts an interval rule to those days.
  */
 typedef struct {
-    struct tm timestamp;      /**< @brief Time when the alarm should trigger */
+    struct tm timestamp;      /**< @brief Time when the alarm should first trigger */
     int32_t target_weight;    /**< @brief Target weight to achieve, default is 200g */
+    uint8_t repeat_days;      /**< @brief Days of week bitmask (bit 0 = Sunday), 0 for none */
+    uint32_t repeat_interval; /**< @brief Seconds between occurrences, 0 for none */
 } Alarm_t;
 
+/** @brief Type of an operation applied by `alarms_apply()` */
+typedef enum {
+    ALARM_OP_ADD,     /**< @brief Add `alarm` under a new ID */
+    ALARM_OP_UPDATE,  /**< @brief Replace the alarm `id` with `alarm` */
+    ALARM_OP_DELETE,  /**< @brief Delete the alarm `id` */
+    ALARM_OP_INVALID, /**< @brief Request that could not be parsed, always fails */
+} alarm_op_type_t;
+
+/**
+ * @brief Structure representing one operation on the alarms list.
+ */
+typedef struct {
+    alarm_op_type_t type; /**< @brief Type of the operation */
+    uint32_t id;          /**< @brief ID of the alarm to update or delete */
+    Alarm_t alarm;        /**< @brief Alarm to add or update to */
+} alarm_op_t;
+
 /**
  * @brief Initializes the alarms module.
  *
@@ -28,35 +62,96 @@ typedef struct {
  */
 void alarms_init(void);
 
+/**
+ * @brief Wakes the alarms task to recompute the next wakeup time.
+ *
+ * Called automatically when alarms are added or deleted. Clock changes go
+ * through `alarms_clock_changed()`.
+ */
+void alarms_reschedule(void);
+
+/**
+ * @brief Applies the alarms policy to a change of the system clock.
+ *
+ * Must be called after every `settimeofday()` instead of `alarms_reschedule()`. Never
+ * waits for the alarms list; the alarms task applies the change.
+ *
+ * @param before System time before the change, in seconds since the epoch.
+ * @param after System time after the change, in seconds since the epoch.
+ */
+void alarms_clock_changed(time_t before, time_t after);
+
+/**
+ * @brief Applies a batch of operations to the alarms list under one lock acquisition.
+ *
+ * Operations are applied in order; a failed operation does not stop the following ones.
+ *
+ * @param ops Array of operations.
+ * @param count Number of operations.
+ * @param ids Array of `count` entries receiving the ID of the added, updated or deleted
+ *            alarm of each operation, or `ALARM_ID_NONE` if it failed. May be NULL.
+ * @return Number of operations that succeeded.
+ */
+size_t alarms_apply(const alarm_op_t *ops, size_t count, uint32_t *ids);
+
 /**
  * @brief Adds an alarm to the alarms list.
  *
  * @param alarm Pointer to the `Alarm_t` structure to be added.
- * @return `true` if the alarm was successfully added, `false` otherwise.
+ * @return ID of the new alarm, or `ALARM_ID_NONE` if it could not be added.
  */
-bool add_alarm(const Alarm_t *alarm);
+uint32_t add_alarm(const Alarm_t *alarm);
+
+/**
+ * @brief Replaces an alarm identified by its ID.
+ *
+ * @param id ID of the alarm to update.
+ * @param alarm Pointer to the new content of the alarm.
+ * @return `true` if the alarm was successfully updated, `false` otherwise.
+ */
+bool update_alarm(uint32_t id, const Alarm_t *alarm);
+
+/**
+ * @brief Deletes an alarm identified by its ID.
+ *
+ * @param id ID of the alarm to delete.
+ * @return `true` if the alarm was successfully deleted, `false` otherwise.
+ */
+bool delete_alarm_by_id(uint32_t id);
 
 /**
  * @brief Deletes an alarm from the alarms list based on its timestamp.
  *
+ * The timestamp is matched against the next occurrence of each alarm; deleting a
+ * recurring alarm removes the whole rule.
+ *
  * @param timestamp Pointer to the `struct tm` representing the time of the alarm to delete.
  * @return `true` if the alarm was successfully deleted, `false` otherwise.
  */
 bool delete_alarm(const struct tm *timestamp);
 
 /**
- * @brief Retrieves all alarms and publishes them via MQTT.
+ * @brief Retrieves alarms and publishes them via MQTT, one page per message.
+ *
+ * Pages list alarms in increasing ID order, so alarms deleted or fired between two
+ * pages never make a client skip or repeat the others. Each page carries
+ * `next_cursor`, the cursor of the following page or -1 after the last one. With a
+ * negative cursor all pages are published one after another by the alarms task, at
+ * the pace of the bulk publish class; the call itself never waits for the queue.
  *
- * Constructs a JSON payload containing all alarms and publishes it to the MQTT topic.
+ * @param cursor ID after which the page starts, 0 for the first page, or negative to
+ *               stream all alarms.
+ * @param limit Maximum number of alarms per page, at most `ALARMS_PAGE_SIZE`.
  */
-void get_alarms(void);
+void get_alarms(int64_t cursor, int limit);
 
 /**
  * @brief Task responsible for monitoring and triggering alarms.
  *
- * This FreeRTOS task continuously checks the current time against the alarms in the `alarms_list`.
- * When an alarm's time is due, it triggers the alarm by initiating the water filling process
- * and removes the alarm from the list.
+ * This FreeRTOS task sleeps until the earliest alarm is due or until `alarms_reschedule()`
+ * is called. Due alarms are removed from the list, or advanced to their next occurrence if
+ * recurring. Missed alarms are coalesced: only the latest one within `ALARM_CATCHUP_GRACE_S`
+ * triggers the water filling process, and fills are spaced by `ALARM_FILL_MIN_SPACING_S`.
  *
  * @param pvParameters Argument passed to the task (unused).
  */
@@ -1,6 +1,7 @@
 #include "buttons.h"
 #include "led.h"
 #include "wifi.h"
+#include "connectivity.h"
 #include "esp_log.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
@@ -47,7 +48,8 @@ void buttons_init(void)
  * @brief Task that monitors the user button state and handles events.
  *
  * This FreeRTOS task continuously checks the state of the user button.
- * When the button state changes, it logs the event, blinks LEDs, and manages Wi-Fi reconnection.
+ * When the button state changes, it logs the event, blinks LEDs, and asks for an immediate
+ * Wi-Fi connection attempt while offline.
  *
  * @param arg Parameter passed to the task (unused).
  */
@@ -63,14 +65,9 @@ void buttons_task(void *arg)
 
                 led_blink_pair();
 
-                while(!is_wifi_connected()){
-                    // Retry connecting to the internet
-                    if (wifi_reconnect()) {
-                        ESP_LOGI(TAG, "Successfully connected to Wi-Fi");
-                    } else {
-                        ESP_LOGI(TAG, "Connection not established, trying connect again");
-                    }
-                    vTaskDelay(pdMS_TO_TICKS(200));
+                if (!connectivity_is(CONNECTIVITY_IP_ACQUIRED)) {
+                    // Retry now rather than at the end of the backoff delay
+                    wifi_reconnect();
                 }
 
             } else {
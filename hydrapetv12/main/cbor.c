@@ -0,0 +1,310 @@
+// cbor.c
+
+#include "cbor.h"
+#include <string.h>
+
+/** @brief Deepest nesting of arrays, maps and tags accepted by `cbor_skip()` */
+#define CBOR_MAX_DEPTH 8
+
+/**
+ * @brief Writes bytes to the output, or flags an overflow.
+ *
+ * @param writer Pointer to the encoder.
+ * @param data Bytes to write.
+ * @param len Number of bytes.
+ */
+static void put_bytes(cbor_writer_t *writer, const void *data, size_t len)
+{
+    if (writer->overflow || writer->size - writer->len < len) {
+        writer->overflow = true;
+        return;
+    }
+    memcpy(writer->buf + writer->len, data, len);
+    writer->len += len;
+}
+
+/**
+ * @brief Writes the head of a data item in its shortest form.
+ *
+ * @param writer Pointer to the encoder.
+ * @param type Major type.
+ * @param value Argument of the head.
+ */
+static void put_head(cbor_writer_t *writer, cbor_type_t type, uint64_t value)
+{
+    uint8_t head[9];
+    size_t len;
+    uint8_t major = (uint8_t)(type << 5);
+
+    if (value < 24) {
+        head[0] = major | (uint8_t)value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major | 24;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major | 25;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major | 26;
+        len = 5;
+    } else {
+        head[0] = major | 27;
+        len = 9;
+    }
+    // Big-endian argument after the initial byte
+    for (size_t i = len - 1; i > 0; i--) {
+        head[i] = (uint8_t)value;
+        value >>= 8;
+    }
+    put_bytes(writer, head, len);
+}
+
+/**
+ * @brief Initializes an encoder.
+ *
+ * @param writer Pointer to the encoder.
+ * @param buf Output buffer.
+ * @param size Size of the output buffer.
+ */
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buf, size_t size)
+{
+    writer->buf = buf;
+    writer->size = size;
+    writer->len = 0;
+    writer->overflow = false;
+}
+
+/**
+ * @brief Writes an unsigned integer.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_uint(cbor_writer_t *writer, uint64_t value)
+{
+    put_head(writer, CBOR_TYPE_UINT, value);
+}
+
+/**
+ * @brief Writes a signed integer.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_int(cbor_writer_t *writer, int64_t value)
+{
+    if (value >= 0) {
+        put_head(writer, CBOR_TYPE_UINT, (uint64_t)value);
+    } else {
+        // Negative integers are encoded as -1 - n
+        put_head(writer, CBOR_TYPE_NINT, (uint64_t)(-1 - value));
+    }
+}
+
+/**
+ * @brief Writes a boolean.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_bool(cbor_writer_t *writer, bool value)
+{
+    put_head(writer, CBOR_TYPE_SIMPLE, value ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE);
+}
+
+/**
+ * @brief Writes a text string.
+ *
+ * @param writer Pointer to the encoder.
+ * @param text The NUL-terminated string.
+ */
+void cbor_put_text(cbor_writer_t *writer, const char *text)
+{
+    size_t len = strlen(text);
+    put_head(writer, CBOR_TYPE_TEXT, len);
+    put_bytes(writer, text, len);
+}
+
+/**
+ * @brief Writes the head of an array, to be followed by its items.
+ *
+ * @param writer Pointer to the encoder.
+ * @param count Number of items.
+ */
+void cbor_put_array(cbor_writer_t *writer, size_t count)
+{
+    put_head(writer, CBOR_TYPE_ARRAY, count);
+}
+
+/**
+ * @brief Writes the head of a map, to be followed by its keys and values.
+ *
+ * @param writer Pointer to the encoder.
+ * @param count Number of key/value pairs.
+ */
+void cbor_put_map(cbor_writer_t *writer, size_t count)
+{
+    put_head(writer, CBOR_TYPE_MAP, count);
+}
+
+/**
+ * @brief Initializes a decoder.
+ *
+ * @param reader Pointer to the decoder.
+ * @param data Input buffer.
+ * @param len Length of the input.
+ */
+void cbor_reader_init(cbor_reader_t *reader, const void *data, size_t len)
+{
+    reader->ptr = data;
+    reader->end = reader->ptr + len;
+}
+
+/**
+ * @brief Reads the head of the next data item.
+ *
+ * @param reader Pointer to the decoder.
+ * @param item Pointer where the item head is stored.
+ * @return `true` if an item was read, `false` at the end of the input or on malformed input.
+ */
+bool cbor_read(cbor_reader_t *reader, cbor_item_t *item)
+{
+    const uint8_t *p = reader->ptr;
+    if (p >= reader->end) {
+        return false;
+    }
+
+    uint8_t info = *p & 0x1F;
+    item->type = (cbor_type_t)(*p >> 5);
+    p++;
+
+    if (info < 24) {
+        item->value = info;
+    } else if (info <= 27) {
+        size_t len = (size_t)1 << (info - 24);
+        if ((size_t)(reader->end - p) < len) {
+            return false;
+        }
+        item->value = 0;
+        for (size_t i = 0; i < len; i++) {
+            item->value = (item->value << 8) | *p++;
+        }
+    } else {
+        // Reserved values and indefinite lengths
+        return false;
+    }
+
+    item->data = NULL;
+    if (item->type == CBOR_TYPE_BYTES || item->type == CBOR_TYPE_TEXT) {
+        if ((uint64_t)(reader->end - p) < item->value) {
+            return false;
+        }
+        item->data = p;
+        p += item->value;
+    }
+    reader->ptr = p;
+    return true;
+}
+
+/**
+ * @brief Skips the next data item including all nested items.
+ *
+ * Nested items are counted rather than recursed into, so the stack use is fixed.
+ *
+ * @param reader Pointer to the decoder.
+ * @return `true` if an item was skipped, `false` on malformed or too deeply nested input.
+ */
+bool cbor_skip(cbor_reader_t *reader)
+{
+    uint64_t remaining[CBOR_MAX_DEPTH];
+    int depth = 0;
+    remaining[0] = 1;
+
+    while (1) {
+        cbor_item_t item;
+        if (!cbor_read(reader, &item)) {
+            return false;
+        }
+        remaining[depth]--;
+
+        uint64_t children = 0;
+        if (item.type == CBOR_TYPE_ARRAY) {
+            children = item.value;
+        } else if (item.type == CBOR_TYPE_MAP) {
+            if (item.value > UINT64_MAX / 2) {
+                return false;
+            }
+            children = item.value * 2;
+        } else if (item.type == CBOR_TYPE_TAG) {
+            children = 1;
+        }
+        if (children > 0) {
+            if (depth + 1 >= CBOR_MAX_DEPTH) {
+                return false;
+            }
+            remaining[++depth] = children;
+        }
+
+        // Close every container whose items have all been read
+        while (remaining[depth] == 0) {
+            if (depth == 0) {
+                return true;
+            }
+            depth--;
+        }
+    }
+}
+
+/**
+ * @brief Reads an integer item.
+ *
+ * @param reader Pointer to the decoder.
+ * @param value Pointer where the value is stored.
+ * @return `true` if the next item is an integer in the range of `int64_t`, `false` otherwise.
+ */
+bool cbor_read_int(cbor_reader_t *reader, int64_t *value)
+{
+    cbor_reader_t start = *reader;
+    cbor_item_t item;
+    if (!cbor_read(reader, &item) || item.value > INT64_MAX ||
+        (item.type != CBOR_TYPE_UINT && item.type != CBOR_TYPE_NINT)) {
+        *reader = start;
+        return false;
+    }
+    *value = (item.type == CBOR_TYPE_UINT) ? (int64_t)item.value : -1 - (int64_t)item.value;
+    return true;
+}
+
+/**
+ * @brief Finds the value of a text key in the map starting at the reader.
+ *
+ * @param reader Pointer to a decoder positioned at a map; on success positioned at the value.
+ * @param key The key to look for.
+ * @return `true` if the key was found, `false` otherwise.
+ */
+bool cbor_map_find(cbor_reader_t *reader, const char *key)
+{
+    cbor_reader_t r = *reader;
+    cbor_item_t item;
+    size_t key_len = strlen(key);
+
+    if (!cbor_read(&r, &item) || item.type != CBOR_TYPE_MAP) {
+        return false;
+    }
+    for (uint64_t pairs = item.value; pairs > 0; pairs--) {
+        cbor_reader_t key_start = r;
+        cbor_item_t key_item;
+        if (cbor_read(&r, &key_item) && key_item.type == CBOR_TYPE_TEXT &&
+            key_item.value == key_len && memcmp(key_item.data, key, key_len) == 0) {
+            *reader = r;
+            return true;
+        }
+        // Keys of other types may be containers, so skip them as whole items
+        r = key_start;
+        if (!cbor_skip(&r) || !cbor_skip(&r)) {
+            return false;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,163 @@
+// cbor.h
+
+#ifndef MAIN_CBOR_H_
+#define MAIN_CBOR_H_
+
+#include <stdint.h>   /**< @brief For uint8_t, int64_t, uint64_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include <stdbool.h>  /**< @brief For bool */
+
+/** @brief Major types of CBOR data items (RFC 8949) */
+typedef enum {
+    CBOR_TYPE_UINT   = 0, /**< @brief Unsigned integer */
+    CBOR_TYPE_NINT   = 1, /**< @brief Negative integer */
+    CBOR_TYPE_BYTES  = 2, /**< @brief Byte string */
+    CBOR_TYPE_TEXT   = 3, /**< @brief UTF-8 text string */
+    CBOR_TYPE_ARRAY  = 4, /**< @brief Array of data items */
+    CBOR_TYPE_MAP    = 5, /**< @brief Map of key/value pairs */
+    CBOR_TYPE_TAG    = 6, /**< @brief Tag, followed by the tagged item */
+    CBOR_TYPE_SIMPLE = 7, /**< @brief Simple value (false, true, null) or float */
+} cbor_type_t;
+
+/** @brief Simple value `false` */
+#define CBOR_SIMPLE_FALSE 20
+/** @brief Simple value `true` */
+#define CBOR_SIMPLE_TRUE 21
+
+/**
+ * @brief Encoder writing CBOR data items into a fixed buffer.
+ *
+ * Writes past the end of the buffer are dropped and set `overflow`, so a
+ * message can be encoded without checks and validated once at the end.
+ */
+typedef struct {
+    uint8_t *buf;   /**< @brief Output buffer */
+    size_t size;    /**< @brief Size of the output buffer */
+    size_t len;     /**< @brief Number of bytes written */
+    bool overflow;  /**< @brief Set when an item did not fit the buffer */
+} cbor_writer_t;
+
+/**
+ * @brief Decoder reading CBOR data items from a buffer.
+ */
+typedef struct {
+    const uint8_t *ptr;  /**< @brief Next byte to read */
+    const uint8_t *end;  /**< @brief End of the input */
+} cbor_reader_t;
+
+/**
+ * @brief Head of a decoded data item.
+ *
+ * Indefinite-length items are not supported.
+ */
+typedef struct {
+    cbor_type_t type;     /**< @brief Major type */
+    uint64_t value;       /**< @brief Integer value, string length, item count, tag or simple value */
+    const uint8_t *data;  /**< @brief Content of byte and text strings, not NUL-terminated */
+} cbor_item_t;
+
+/**
+ * @brief Initializes an encoder.
+ *
+ * @param writer Pointer to the encoder.
+ * @param buf Output buffer.
+ * @param size Size of the output buffer.
+ */
+void cbor_writer_init(cbor_writer_t *writer, uint8_t *buf, size_t size);
+
+/**
+ * @brief Writes an unsigned integer.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_uint(cbor_writer_t *writer, uint64_t value);
+
+/**
+ * @brief Writes a signed integer.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_int(cbor_writer_t *writer, int64_t value);
+
+/**
+ * @brief Writes a boolean.
+ *
+ * @param writer Pointer to the encoder.
+ * @param value The value.
+ */
+void cbor_put_bool(cbor_writer_t *writer, bool value);
+
+/**
+ * @brief Writes a text string.
+ *
+ * @param writer Pointer to the encoder.
+ * @param text The NUL-terminated string.
+ */
+void cbor_put_text(cbor_writer_t *writer, const char *text);
+
+/**
+ * @brief Writes the head of an array, to be followed by its items.
+ *
+ * @param writer Pointer to the encoder.
+ * @param count Number of items.
+ */
+void cbor_put_array(cbor_writer_t *writer, size_t count);
+
+/**
+ * @brief Writes the head of a map, to be followed by its keys and values.
+ *
+ * @param writer Pointer to the encoder.
+ * @param count Number of key/value pairs.
+ */
+void cbor_put_map(cbor_writer_t *writer, size_t count);
+
+/**
+ * @brief Initializes a decoder.
+ *
+ * @param reader Pointer to the decoder.
+ * @param data Input buffer.
+ * @param len Length of the input.
+ */
+void cbor_reader_init(cbor_reader_t *reader, const void *data, size_t len);
+
+/**
+ * @brief Reads the head of the next data item.
+ *
+ * The content of byte and text strings is consumed too; the items of arrays and
+ * maps and the item following a tag are read by the next calls.
+ *
+ * @param reader Pointer to the decoder.
+ * @param item Pointer where the item head is stored.
+ * @return `true` if an item was read, `false` at the end of the input or on malformed input.
+ */
+bool cbor_read(cbor_reader_t *reader, cbor_item_t *item);
+
+/**
+ * @brief Skips the next data item including all nested items.
+ *
+ * @param reader Pointer to the decoder.
+ * @return `true` if an item was skipped, `false` on malformed or too deeply nested input.
+ */
+bool cbor_skip(cbor_reader_t *reader);
+
+/**
+ * @brief Reads an integer item.
+ *
+ * @param reader Pointer to the decoder.
+ * @param value Pointer where the value is stored.
+ * @return `true` if the next item is an integer in the range of `int64_t`, `false` otherwise.
+ */
+bool cbor_read_int(cbor_reader_t *reader, int64_t *value);
+
+/**
+ * @brief Finds the value of a text key in the map starting at the reader.
+ *
+ * @param reader Pointer to a decoder positioned at a map; on success positioned at the value.
+ * @param key The key to look for.
+ * @return `true` if the key was found, `false` otherwise.
+ */
+bool cbor_map_find(cbor_reader_t *reader, const char *key);
+
+#endif /* MAIN_CBOR_H_ */
@@ -0,0 +1,488 @@
+// commands.c
+
+#include "commands.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt.h"
+#include "mqtt_tls.h"
+#include "hx711.h"
+#include "led.h"
+#include "buttons.h"
+#include "motor.h"
+#include "time_sync.h"
+#include "timebase.h"
+#include "topics.h"
+
+static const char *TAG = "COMMANDS";
+
+/** @brief Queue of commands waiting for the worker task */
+static QueueHandle_t commands_queue = NULL;
+
+/** @brief Counters of the commands queue, guarded by `stats_lock` */
+static commands_stats_t stats = { 0 };
+
+/** @brief Spinlock guarding `stats`, updated from the MQTT and worker tasks */
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Size of a response without details, the ID and command name included */
+#define RESPONSE_HEADER_SIZE 160
+
+/** @brief Size of the details of a batch response: a status and an alarm ID per command */
+#define BATCH_DETAILS_SIZE (48 + COMMANDS_BATCH_MAX * 24)
+
+/** @brief Size of the details of a stats response: the commands and TLS counters and those of each publish class */
+#define STATS_DETAILS_SIZE (288 + PUBLISH_CLASS_COUNT * 176)
+
+/** @brief Names of the command statuses, indexed by `command_status_t` */
+static const char *const status_names[] = {
+    [COMMAND_STATUS_OK]      = "ok",
+    [COMMAND_STATUS_INVALID] = "invalid",
+    [COMMAND_STATUS_BUSY]    = "busy",
+    [COMMAND_STATUS_FAILED]  = "failed",
+    [COMMAND_STATUS_UNKNOWN] = "unknown",
+};
+
+/**
+ * @brief Publishes the response to a command.
+ *
+ * @param reply Pointer to where and how to answer.
+ * @param status Outcome of the command.
+ * @param details JSON members appended to the response, e.g. "\"results\": [...]", or NULL.
+ */
+static void publish_response(const command_reply_t *reply, command_status_t status, const char *details)
+{
+    const char *topic = topic_get(TOPIC_INFO_RESPONSE);
+    const void *correlation = NULL;
+    size_t correlation_len = 0;
+#if CONFIG_MQTT_PROTOCOL_5
+    if (reply->response_topic[0] != '\0') {
+        topic = reply->response_topic;
+        correlation = reply->correlation;
+        correlation_len = reply->correlation_len;
+    }
+#endif
+
+    // Called from both the MQTT and the worker task, so the payload is not static
+    size_t size = RESPONSE_HEADER_SIZE + ((details != NULL) ? strlen(details) + 2 : 0);
+    char *json_payload = malloc(size);
+    if (json_payload == NULL) {
+        ESP_LOGE(TAG, "No memory for response to %s", reply->id);
+        return;
+    }
+
+    int64_t latency_us = timebase_now_us() - reply->received_us;
+    int len = snprintf(json_payload, size, "{\"id\": \"%s\"", reply->id);
+    if (reply->name != NULL) {
+        len += snprintf(json_payload + len, size - len, ", \"command\": \"%s\"", reply->name);
+    }
+    len += snprintf(json_payload + len, size - len, ", \"status\": \"%s\", \"error\": %d, \"latency_us\": %lld",
+                    status_names[status], (int)status, (long long)latency_us);
+    if (details != NULL) {
+        len += snprintf(json_payload + len, size - len, ", %s", details);
+    }
+    snprintf(json_payload + len, size - len, "}");
+
+    if (publisher_send_correlated(PUBLISH_CLASS_RESPONSE, topic, json_payload, strlen(json_payload),
+                                  correlation, correlation_len)) {
+        ESP_LOGI(TAG, "Response %s -> %s", topic, json_payload);
+    }
+    free(json_payload);
+}
+
+/**
+ * @brief Publishes the IDs affected by an alarm operation.
+ *
+ * The result is published to `<device_id>/hydrapetinfo/alarm` as
+ * {"op": "set", "alarm_ids": [...]}, with 0 marking failed operations.
+ *
+ * @param op Name of the operation, "set" or "del".
+ * @param ids Array of alarm IDs, one per requested operation.
+ * @param count Number of IDs.
+ */
+static void publish_alarm_result(const char *op, const uint32_t *ids, size_t count)
+{
+    char json_payload[48 + ALARMS_BATCH_MAX * 12];
+    size_t offset = 0;
+
+    offset += snprintf(json_payload, sizeof(json_payload), "{\"op\": \"%s\", \"alarm_ids\": [", op);
+    for (size_t i = 0; i < count; i++) {
+        offset += snprintf(json_payload + offset, sizeof(json_payload) - offset,
+                           (i > 0) ? ", %lu" : "%lu", (unsigned long)ids[i]);
+    }
+    snprintf(json_payload + offset, sizeof(json_payload) - offset, "]}");
+
+    mqtt_publish(PUBLISH_CLASS_RESPONSE, topic_get(TOPIC_INFO_ALARM), json_payload);
+}
+
+/**
+ * @brief Adds or updates one alarm and publishes the result.
+ *
+ * @param id ID of the alarm to update, `ALARM_ID_NONE` to add one.
+ * @param alarm Pointer to the alarm.
+ * @return `COMMAND_STATUS_OK` if the alarm was set, `COMMAND_STATUS_FAILED` otherwise.
+ */
+static command_status_t execute_set_alarm(uint32_t id, const Alarm_t *alarm)
+{
+    if (id != ALARM_ID_NONE) {
+        if (!update_alarm(id, alarm)) {
+            id = ALARM_ID_NONE;
+        }
+    } else {
+        id = add_alarm(alarm);
+    }
+
+    if (id != ALARM_ID_NONE) {
+        ESP_LOGI(TAG, "Alarm %lu has been set.", (unsigned long)id);
+    } else {
+        ESP_LOGE(TAG, "Failed to set alarm.");
+    }
+    publish_alarm_result("set", &id, 1);
+    return (id != ALARM_ID_NONE) ? COMMAND_STATUS_OK : COMMAND_STATUS_FAILED;
+}
+
+/**
+ * @brief Deletes one alarm, by ID or by its next occurrence.
+ *
+ * @param id ID of the alarm, `ALARM_ID_NONE` to match `timestamp`.
+ * @param timestamp Pointer to the next occurrence of the alarm.
+ * @return `COMMAND_STATUS_OK` if the alarm was deleted, `COMMAND_STATUS_FAILED` otherwise.
+ */
+static command_status_t execute_del_alarm(uint32_t id, struct tm *timestamp)
+{
+    bool deleted = (id != ALARM_ID_NONE) ? delete_alarm_by_id(id) : delete_alarm(timestamp);
+    if (deleted) {
+        ESP_LOGI(TAG, "Alarm has been deleted.");
+        return COMMAND_STATUS_OK;
+    }
+    ESP_LOGE(TAG, "Failed to delete alarm.");
+    return COMMAND_STATUS_FAILED;
+}
+
+/**
+ * @brief Applies a batch of alarm operations and publishes the result.
+ *
+ * @param op Name of the operation in the result, "set" or "del".
+ * @param ops Array of operations.
+ * @param count Number of operations.
+ * @return `COMMAND_STATUS_OK` if all operations were applied, `COMMAND_STATUS_INVALID` if
+ *         some could not be parsed, `COMMAND_STATUS_FAILED` otherwise.
+ */
+static command_status_t execute_alarms_batch(const char *op, const alarm_op_t *ops, size_t count)
+{
+    uint32_t ids[ALARMS_BATCH_MAX];
+
+    size_t applied = alarms_apply(ops, count, ids);
+    ESP_LOGI(TAG, "Applied %u of %u alarm operations.", (unsigned)applied, (unsigned)count);
+    publish_alarm_result(op, ids, count);
+    if (applied == count) {
+        return COMMAND_STATUS_OK;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].type == ALARM_OP_INVALID) {
+            return COMMAND_STATUS_INVALID;
+        }
+    }
+    return COMMAND_STATUS_FAILED;
+}
+
+/**
+ * @brief Executes a command.
+ *
+ * @param type Type of the command.
+ * @param args Pointer to the arguments of the command.
+ * @return Outcome of the command.
+ */
+static command_status_t execute_command(command_type_t type, command_args_t *args)
+{
+    command_status_t status = COMMAND_STATUS_OK;
+
+    switch (type) {
+        case COMMAND_POUR_WATER:
+            ESP_LOGI(TAG, "Starting water filling to weight: %ld g", (long)args->target_weight);
+            fill_water_to(args->target_weight);
+            break;
+        case COMMAND_TARE:
+            led_blink_once();
+            tare();
+            ESP_LOGI(TAG, "Tare function has been called.");
+            break;
+        case COMMAND_SET_TIME:
+            if (time_sync_set_time(args->time) == ESP_OK) {
+                ESP_LOGI(TAG, "Time has been successfully set.");
+            } else {
+                ESP_LOGE(TAG, "Failed to set time.");
+                status = COMMAND_STATUS_FAILED;
+            }
+            break;
+        case COMMAND_GET_TIME:
+            mqtt_publish_current_time(PUBLISH_CLASS_RESPONSE, timebase_now_us());
+            break;
+        case COMMAND_GET_WATER:
+            mqtt_publish_water_state(PUBLISH_CLASS_RESPONSE, get_water_weight());
+            break;
+        case COMMAND_GET_STATUS: {
+            int32_t weight = get_water_weight();
+            int64_t timestamp_us = timebase_now_us();
+            mqtt_publish_all(PUBLISH_CLASS_RESPONSE, weight, timestamp_us, user_button_state(), led_get_state(),
+                             get_motor_state());
+            break;
+        }
+        case COMMAND_SET_ALARM:
+            status = execute_set_alarm(args->set_alarm.id, &args->set_alarm.alarm);
+            break;
+        case COMMAND_GET_ALARMS:
+            get_alarms(args->get_alarms.cursor, args->get_alarms.limit);
+            break;
+        case COMMAND_DEL_ALARM:
+            status = execute_del_alarm(args->del_alarm.id, &args->del_alarm.timestamp);
+            break;
+        case COMMAND_ALARMS_BATCH:
+            status = execute_alarms_batch(args->alarms_batch.op, args->alarms_batch.ops,
+                                          args->alarms_batch.count);
+            break;
+        case COMMAND_SET_ENCODING:
+            if (telemetry_set_encoding(args->encoding) == ESP_OK) {
+                ESP_LOGI(TAG, "Telemetry encoding has been set.");
+            } else {
+                status = COMMAND_STATUS_FAILED;
+            }
+            break;
+        default:
+            ESP_LOGW(TAG, "Unknown command type %d", (int)type);
+            status = COMMAND_STATUS_UNKNOWN;
+            break;
+    }
+    return status;
+}
+
+/**
+ * @brief Executes the commands of a batch in order and publishes one response.
+ *
+ * Runs of consecutive alarm operations are applied by one `alarms_apply()` call,
+ * so under one lock acquisition. The response is always published, with the status
+ * of each command and the IDs of the alarm operations, 0 marking failures:
+ * {"id": "7", "command": "batch", "status": "failed", ..., "results": ["ok", "failed"], "alarm_ids": [17, 0]}
+ *
+ * @param reply Pointer to where and how to answer.
+ * @param batch Pointer to the batch.
+ */
+static void execute_batch(const command_reply_t *reply, command_batch_t *batch)
+{
+    // Only used from the worker task
+    static char details[BATCH_DETAILS_SIZE];
+    command_status_t results[COMMANDS_BATCH_MAX];
+    uint32_t ids[COMMANDS_BATCH_MAX];
+
+    for (size_t i = 0; i < batch->count;) {
+        command_step_t *step = &batch->steps[i];
+        if (step->type != COMMAND_ALARMS_BATCH) {
+            results[i++] = execute_command(step->type, &step->args);
+            continue;
+        }
+        // Each alarm step holds the next operation of `ops`, so a run of them is contiguous
+        size_t first = step->args.alarms_batch.ops - batch->ops;
+        size_t end = i;
+        while (end < batch->count && batch->steps[end].type == COMMAND_ALARMS_BATCH) {
+            end++;
+        }
+        alarms_apply(&batch->ops[first], end - i, &ids[first]);
+        for (; i < end; i++, first++) {
+            results[i] = (ids[first] != ALARM_ID_NONE) ? COMMAND_STATUS_OK
+                       : (batch->ops[first].type == ALARM_OP_INVALID) ? COMMAND_STATUS_INVALID
+                       : COMMAND_STATUS_FAILED;
+        }
+    }
+
+    command_status_t status = COMMAND_STATUS_OK;
+    size_t len = snprintf(details, sizeof(details), "\"results\": [");
+    for (size_t i = 0; i < batch->count; i++) {
+        len += snprintf(details + len, sizeof(details) - len, (i > 0) ? ", \"%s\"" : "\"%s\"",
+                        status_names[results[i]]);
+        if (results[i] != COMMAND_STATUS_OK) {
+            status = COMMAND_STATUS_FAILED;
+        }
+    }
+    len += snprintf(details + len, sizeof(details) - len, "], \"alarm_ids\": [");
+    for (size_t i = 0; i < batch->op_count; i++) {
+        len += snprintf(details + len, sizeof(details) - len, (i > 0) ? ", %lu" : "%lu", (unsigned long)ids[i]);
+    }
+    snprintf(details + len, sizeof(details) - len, "]");
+
+    ESP_LOGI(TAG, "Executed batch of %u commands: %s", (unsigned)batch->count, status_names[status]);
+    publish_response(reply, status, details);
+}
+
+/**
+ * @brief Publishes the queue counters of the device in the response to a stats request.
+ *
+ * The response is always published, with the counters of the commands queue, of
+ * each publish class and of the TLS handshakes, e.g.
+ * {"id": "", "command": "get/stats", "status": "ok", ..., "commands": {"posted": 12, "dropped": 0, "executed": 11, "high_water": 2},
+ *  "publisher": {"alarm": {"queued": 1, "sent": 1, "dropped": 0, "failed": 0, "depth": 0, "high_water": 1}, ...},
+ *  "tls": {"full": 1, "resumed": 3, "offered": 3, "failed": 0, "full_avg_ms": ..., "resumed_avg_ms": ...}}
+ *
+ * @param reply Pointer to where and how to answer.
+ */
+static void execute_get_stats(const command_reply_t *reply)
+{
+    // Only used from the worker task
+    static char details[STATS_DETAILS_SIZE];
+    commands_stats_t commands;
+
+    commands_get_stats(&commands);
+    size_t len = snprintf(details, sizeof(details),
+                          "\"commands\": {\"posted\": %lu, \"dropped\": %lu, \"executed\": %lu, \"high_water\": %lu}, "
+                          "\"publisher\": {",
+                          (unsigned long)commands.posted, (unsigned long)commands.dropped,
+                          (unsigned long)commands.executed, (unsigned long)commands.high_water);
+    for (int cls = 0; cls < PUBLISH_CLASS_COUNT; cls++) {
+        publisher_stats_t publisher;
+        publisher_get_stats(cls, &publisher);
+        len += snprintf(details + len, sizeof(details) - len,
+                        "%s\"%s\": {\"queued\": %lu, \"sent\": %lu, \"dropped\": %lu, \"failed\": %lu, "
+                        "\"depth\": %lu, \"high_water\": %lu}",
+                        (cls > 0) ? ", " : "", publisher_class_name(cls),
+                        (unsigned long)publisher.queued, (unsigned long)publisher.sent,
+                        (unsigned long)publisher.dropped, (unsigned long)publisher.failed,
+                        (unsigned long)publisher.depth, (unsigned long)publisher.high_water);
+    }
+    mqtt_tls_stats_t tls;
+    mqtt_tls_get_stats(&tls);
+    snprintf(details + len, sizeof(details) - len,
+             "}, \"tls\": {\"full\": %lu, \"resumed\": %lu, \"offered\": %lu, \"failed\": %lu, "
+             "\"full_avg_ms\": %lu, \"resumed_avg_ms\": %lu}",
+             (unsigned long)tls.full, (unsigned long)tls.resumed, (unsigned long)tls.offered,
+             (unsigned long)tls.failed, (unsigned long)tls.full_avg_ms, (unsigned long)tls.resumed_avg_ms);
+    publish_response(reply, COMMAND_STATUS_OK, details);
+}
+
+/**
+ * @brief Releases the buffers owned by a command.
+ *
+ * @param command Pointer to the command.
+ */
+static void release_command(command_t *command)
+{
+    if (command->type == COMMAND_ALARMS_BATCH) {
+        free(command->args.alarms_batch.ops);
+        command->args.alarms_batch.ops = NULL;
+    } else if (command->type == COMMAND_BATCH) {
+        free(command->args.batch);
+        command->args.batch = NULL;
+    }
+}
+
+/**
+ * @brief Task executing queued commands one at a time.
+ *
+ * Runs the slow parts of the commands (weighing, tare, LED feedback, flash writes)
+ * so the MQTT task only parses and queues them.
+ *
+ * @param pvParameters Pointer to task parameters (unused).
+ */
+static void commands_task(void *pvParameters)
+{
+    command_t command;
+
+    while (1) {
+        if (xQueueReceive(commands_queue, &command, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (command.type == COMMAND_BATCH) {
+            // Batches publish their own aggregated response
+            execute_batch(&command.reply, command.args.batch);
+        } else if (command.type == COMMAND_GET_STATS) {
+            execute_get_stats(&command.reply);
+        } else {
+            command_status_t status = execute_command(command.type, &command.args);
+            commands_respond(&command.reply, status);
+        }
+        release_command(&command);
+
+        taskENTER_CRITICAL(&stats_lock);
+        stats.executed++;
+        taskEXIT_CRITICAL(&stats_lock);
+    }
+}
+
+/**
+ * @brief Initializes the commands queue and starts the worker task.
+ */
+void commands_init(void)
+{
+    commands_queue = xQueueCreate(COMMANDS_QUEUE_LENGTH, sizeof(command_t));
+    if (commands_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create commands queue");
+        return;
+    }
+
+    xTaskCreate(commands_task, "commands_task", 4096, NULL, 5, NULL);
+    ESP_LOGI(TAG, "Commands worker started.");
+}
+
+/**
+ * @brief Queues a command for the worker task without blocking.
+ *
+ * @param command Pointer to the command, copied into the queue.
+ * @return `true` if the command was queued, `false` if the queue is full or not initialized.
+ */
+bool commands_post(const command_t *command)
+{
+    if (commands_queue == NULL || xQueueSend(commands_queue, command, 0) != pdTRUE) {
+        command_t dropped = *command;
+        release_command(&dropped);
+
+        taskENTER_CRITICAL(&stats_lock);
+        uint32_t dropped_count = ++stats.dropped;
+        taskEXIT_CRITICAL(&stats_lock);
+        ESP_LOGW(TAG, "Commands queue full, dropped command type %d (%lu dropped)",
+                 (int)command->type, (unsigned long)dropped_count);
+        return false;
+    }
+
+    uint32_t waiting = uxQueueMessagesWaiting(commands_queue);
+    taskENTER_CRITICAL(&stats_lock);
+    stats.posted++;
+    if (waiting > stats.high_water) {
+        stats.high_water = waiting;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+    return true;
+}
+
+/**
+ * @brief Publishes the response to a command, if its request asked for one.
+ *
+ * @param reply Pointer to where and how to answer.
+ * @param status Outcome of the command.
+ */
+void commands_respond(const command_reply_t *reply, command_status_t status)
+{
+#if CONFIG_MQTT_PROTOCOL_5
+    if (reply->id[0] == '\0' && reply->response_topic[0] == '\0') {
+        return;
+    }
+#else
+    if (reply->id[0] == '\0') {
+        return;
+    }
+#endif
+    publish_response(reply, status, NULL);
+}
+
+/**
+ * @brief Retrieves the counters of the commands queue.
+ *
+ * @param stats_out Pointer where the counters are stored.
+ */
+void commands_get_stats(commands_stats_t *stats_out)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    *stats_out = stats;
+    taskEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,178 @@
+// commands.h
+
+#ifndef MAIN_COMMANDS_H_
+#define MAIN_COMMANDS_H_
+
+#include <stdint.h>   /**< @brief For int32_t, uint32_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include <stdbool.h>  /**< @brief For bool */
+#include <time.h>     /**< @brief For time_t, struct tm */
+#include "sdkconfig.h"
+#include "alarms.h"
+#include "telemetry.h"
+
+/** @brief Number of commands waiting for the worker before new ones are dropped */
+#define COMMANDS_QUEUE_LENGTH 8
+
+/** @brief Largest number of commands in one "batch" message */
+#define COMMANDS_BATCH_MAX ALARMS_BATCH_MAX
+
+/** @brief Longest request ID echoed in responses, e.g. a UUID */
+#define COMMAND_ID_MAX_LEN 36
+
+/** @brief Longest MQTT 5 response topic a command can be answered on */
+#define COMMAND_RESPONSE_TOPIC_MAX_LEN 127
+
+/** @brief Longest MQTT 5 correlation data echoed in responses */
+#define COMMAND_CORRELATION_MAX_LEN 64
+
+/** @brief Outcome of a command, sent as `status` and `error` of its response */
+typedef enum {
+    COMMAND_STATUS_OK      = 0, /**< @brief "ok": executed */
+    COMMAND_STATUS_INVALID = 1, /**< @brief "invalid": the payload could not be parsed */
+    COMMAND_STATUS_BUSY    = 2, /**< @brief "busy": dropped because the commands queue was full */
+    COMMAND_STATUS_FAILED  = 3, /**< @brief "failed": executed without success */
+    COMMAND_STATUS_UNKNOWN = 4, /**< @brief "unknown": no command for the topic */
+} command_status_t;
+
+/**
+ * @brief Where and how to answer a command.
+ *
+ * A response is only sent when the request carries an `id` or, with MQTT 5,
+ * a response topic.
+ */
+typedef struct {
+    char id[COMMAND_ID_MAX_LEN + 1];    /**< @brief Request ID echoed in the response, empty for none */
+    const char *name;                   /**< @brief Command topic after the prefix, e.g. "set/alarm", or NULL */
+    int64_t received_us;                /**< @brief Monotonic time the request was received, see `timebase_now_us()` */
+#if CONFIG_MQTT_PROTOCOL_5
+    char response_topic[COMMAND_RESPONSE_TOPIC_MAX_LEN + 1]; /**< @brief MQTT 5 response topic, empty for none */
+    uint8_t correlation[COMMAND_CORRELATION_MAX_LEN];        /**< @brief MQTT 5 correlation data */
+    size_t correlation_len;                                  /**< @brief Length of `correlation` */
+#endif
+} command_reply_t;
+
+/** @brief Type of a command received over MQTT */
+typedef enum {
+    COMMAND_POUR_WATER,   /**< @brief Fill water to `args.target_weight` */
+    COMMAND_TARE,         /**< @brief Tare the scale */
+    COMMAND_SET_TIME,     /**< @brief Set the system time to `args.time` */
+    COMMAND_GET_TIME,     /**< @brief Publish the current time */
+    COMMAND_GET_WATER,    /**< @brief Publish the current water state */
+    COMMAND_GET_STATUS,   /**< @brief Publish the device status */
+    COMMAND_SET_ALARM,    /**< @brief Add or update one alarm, see `args.set_alarm` */
+    COMMAND_GET_ALARMS,   /**< @brief Publish the alarms list, see `args.get_alarms` */
+    COMMAND_DEL_ALARM,    /**< @brief Delete one alarm, see `args.del_alarm` */
+    COMMAND_ALARMS_BATCH, /**< @brief Apply several alarm operations, see `args.alarms_batch` */
+    COMMAND_SET_ENCODING, /**< @brief Select the telemetry encoding `args.encoding` */
+    COMMAND_BATCH,        /**< @brief Execute several commands in order, see `args.batch` */
+    COMMAND_GET_STATS,    /**< @brief Publish the counters of the commands and publish queues in the response */
+} command_type_t;
+
+/** @brief Commands of a "batch" message, see `struct command_batch` */
+typedef struct command_batch command_batch_t;
+
+/**
+ * @brief Arguments of a command, the member being selected by its type.
+ */
+typedef union {
+    int32_t target_weight;      /**< @brief Target weight in grams */
+    time_t time;                /**< @brief Time to set, in seconds since the epoch */
+    telemetry_encoding_t encoding; /**< @brief Telemetry encoding to select */
+    struct {
+        uint32_t id;            /**< @brief ID of the alarm to update, `ALARM_ID_NONE` to add one */
+        Alarm_t alarm;          /**< @brief Alarm to add or update to */
+    } set_alarm;
+    struct {
+        int64_t cursor;         /**< @brief Alarm ID after which the page starts, 0 for the first page, -1 for all pages */
+        int limit;              /**< @brief Maximum number of alarms per page */
+    } get_alarms;
+    struct {
+        uint32_t id;            /**< @brief ID of the alarm, `ALARM_ID_NONE` to match `timestamp` */
+        struct tm timestamp;    /**< @brief Next occurrence of the alarm to delete */
+    } del_alarm;
+    struct {
+        const char *op;         /**< @brief Name of the operation in the result, "set" or "del" */
+        alarm_op_t *ops;        /**< @brief Operations allocated with `malloc`, owned by the queue */
+        size_t count;           /**< @brief Number of operations */
+    } alarms_batch;
+    command_batch_t *batch;     /**< @brief Batch allocated with `malloc`, owned by the queue */
+} command_args_t;
+
+/**
+ * @brief One command of a batch.
+ *
+ * Alarm operations are `COMMAND_ALARMS_BATCH` steps of one operation each, held
+ * in `ops` of the batch, so consecutive ones are applied under one lock.
+ */
+typedef struct {
+    command_type_t type;            /**< @brief Type of the command, selecting the member of `args` */
+    command_args_t args;            /**< @brief Arguments of the command */
+} command_step_t;
+
+/**
+ * @brief Commands of a "batch" message, executed in order with one response.
+ */
+struct command_batch {
+    size_t count;                               /**< @brief Number of steps */
+    command_step_t steps[COMMANDS_BATCH_MAX];   /**< @brief Commands in request order */
+    alarm_op_t ops[COMMANDS_BATCH_MAX];         /**< @brief Alarm operations of the steps, in request order */
+    size_t op_count;                            /**< @brief Number of alarm operations */
+};
+
+/**
+ * @brief Structure representing a parsed command, executed by the commands worker.
+ */
+typedef struct {
+    command_type_t type;            /**< @brief Type of the command, selecting the member of `args` */
+    command_args_t args;            /**< @brief Arguments of the command */
+    command_reply_t reply;          /**< @brief Where to answer the command */
+} command_t;
+
+/**
+ * @brief Counters of the commands queue.
+ */
+typedef struct {
+    uint32_t posted;      /**< @brief Number of commands queued */
+    uint32_t dropped;     /**< @brief Number of commands dropped because the queue was full */
+    uint32_t executed;    /**< @brief Number of commands executed */
+    uint32_t high_water;  /**< @brief Largest number of commands waiting at once */
+} commands_stats_t;
+
+/**
+ * @brief Initializes the commands queue and starts the worker task.
+ */
+void commands_init(void);
+
+/**
+ * @brief Queues a command for the worker task without blocking.
+ *
+ * Ownership of the buffers referenced by the command passes to the queue,
+ * also when the command is dropped.
+ *
+ * @param command Pointer to the command, copied into the queue.
+ * @return `true` if the command was queued, `false` if the queue is full or not initialized.
+ */
+bool commands_post(const command_t *command);
+
+/**
+ * @brief Publishes the response to a command, if its request asked for one.
+ *
+ * The response is published to `<device_id>/hydrapetinfo/response`, or with MQTT 5
+ * to the response topic of the request with its correlation data, as
+ * {"id": "42", "command": "set/alarm", "status": "ok", "error": 0, "latency_us": 1830},
+ * where `latency_us` is the time from receiving the request to the response.
+ *
+ * @param reply Pointer to where and how to answer.
+ * @param status Outcome of the command.
+ */
+void commands_respond(const command_reply_t *reply, command_status_t status);
+
+/**
+ * @brief Retrieves the counters of the commands queue.
+ *
+ * @param stats_out Pointer where the counters are stored.
+ */
+void commands_get_stats(commands_stats_t *stats_out);
+
+#endif /* MAIN_COMMANDS_H_ */
@@ -3,11 +3,52 @@
 #ifndef MAIN_CONFIG_H_
 #define MAIN_CONFIG_H_
 
-/** @brief Duration between each publish in milliseconds (60 seconds) */
-#define PUBLISH_ALL_DURATION_TIME 	60 * 1000 /**< @brief 1 minute between refresh */
+/** @brief Interval between telemetry readings in milliseconds, published only on change (5 seconds) */
+#define TELEMETRY_SAMPLE_PERIOD_MS 	5 * 1000
+/** @brief Weight change in grams from the last published weight needed to publish it again */
+#define TELEMETRY_WEIGHT_DEADBAND_G	5
+/** @brief Longest interval between two complete telemetry messages in seconds (15 minutes) */
+#define TELEMETRY_HEARTBEAT_S      	(15 * 60)
+/** @brief Also publish each cycle to the legacy all/water/time/watertanklevel topics (1), until subscribers
+ *  have moved to telemetry, or only to telemetry (0) */
+#define TELEMETRY_LEGACY_TOPICS    	1
+/** @brief Telemetry messages kept in RAM while offline before the oldest move to the flash ring */
+#define TELEMETRY_STORE_RAM_RECORDS	64
+/** @brief Largest number of stored telemetry messages published in one batch message */
+#define TELEMETRY_FLUSH_BATCH_SIZE 	16
+/** @brief Unacknowledged bytes in the MQTT outbox above which flushing waits for the next reading */
+#define TELEMETRY_FLUSH_OUTBOX_MAX 	4096
 #define EXAMPLE_ESP_WIFI_SSID      	"Antena"          /**< @brief SSID of the Wi-Fi network */
 #define EXAMPLE_ESP_WIFI_PASS      	"pppppppp"        /**< @brief Password of the Wi-Fi network */
-#define EXAMPLE_ESP_MAXIMUM_RETRY  	10                /**< @brief Maximum number of connection retries */
+/** @brief Delay before the first Wi-Fi reconnection attempt in milliseconds, doubled after each failure */
+#define WIFI_RETRY_MIN_MS          	1000
+/** @brief Longest delay between two Wi-Fi connection attempts in milliseconds (5 minutes) */
+#define WIFI_RETRY_MAX_MS          	(5 * 60 * 1000)
 
+/** @brief Missed alarms due longer ago than this many seconds are skipped instead of fired */
+#define ALARM_CATCHUP_GRACE_S      	(15 * 60)
+/** @brief Minimum number of seconds between two fills triggered by alarms */
+#define ALARM_FILL_MIN_SPACING_S   	(5 * 60)
+/** @brief Clock change in seconds above which alarms are re-evaluated as after a clock jump */
+#define ALARM_CLOCK_JUMP_S         	120
+
+
+/** @brief SNTP server, e.g. the address of a local NTP server for testing */
+#define SNTP_SERVER                	"pool.ntp.org"
+/** @brief Interval between SNTP syncs in milliseconds (1 hour) */
+#define SNTP_SYNC_INTERVAL_MS      	(60 * 60 * 1000)
+/** @brief Interval in milliseconds at which telemetry timestamps follow the clock while SNTP slews it (10 seconds) */
+#define SNTP_SLEW_RESAMPLE_MS      	(10 * 1000)
+
+/** @brief MQTT broker; `mqtts://` connects over TLS, verifying the broker against the certificate bundle */
+#define MQTT_BROKER_URI            	"mqtts://test.mosquitto.org:8886"
+/** @brief Largest incoming MQTT message in bytes, reassembled from fragments if needed */
+#define MQTT_MESSAGE_MAX_SIZE      	8192
+/** @brief MQTT keep-alive in seconds; the broker publishes the Last Will after 1.5 times this without traffic */
+#define MQTT_KEEPALIVE_S           	30
+/** @brief MQTT 5 session expiry in seconds: how long the broker keeps the session and queued commands of a disconnected device (1 day) */
+#define MQTT_SESSION_EXPIRY_S      	(24 * 60 * 60)
+/** @brief JSON tokens of the largest command, e.g. "set/alarms" with 32 alarms of 5 keys */
+#define MQTT_JSON_MAX_TOKENS       	384
 
 #endif /* MAIN_CONFIG_H_ */
@@ -0,0 +1,71 @@
+// connectivity.c
+
+#include "connectivity.h"
+#include "esp_log.h"
+
+static const char *TAG = "CONNECTIVITY";
+
+/** @brief Event group of the `CONNECTIVITY_*` bits */
+static EventGroupHandle_t connectivity_group = NULL;
+
+/**
+ * @brief Creates the event group holding the connectivity state.
+ */
+void connectivity_init(void)
+{
+    connectivity_group = xEventGroupCreate();
+    if (connectivity_group == NULL) {
+        ESP_LOGE(TAG, "Failed to create the connectivity event group");
+    }
+}
+
+/**
+ * @brief Marks connectivity levels as reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to set.
+ */
+void connectivity_set(EventBits_t bits)
+{
+    if (connectivity_group != NULL) {
+        xEventGroupSetBits(connectivity_group, bits);
+    }
+}
+
+/**
+ * @brief Marks connectivity levels as lost.
+ *
+ * @param bits `CONNECTIVITY_*` bits to clear.
+ */
+void connectivity_clear(EventBits_t bits)
+{
+    if (connectivity_group != NULL) {
+        xEventGroupClearBits(connectivity_group, bits);
+    }
+}
+
+/**
+ * @brief Checks whether all given connectivity levels are reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to check.
+ * @return `true` if all bits are set, `false` otherwise.
+ */
+bool connectivity_is(EventBits_t bits)
+{
+    return connectivity_group != NULL && (xEventGroupGetBits(connectivity_group) & bits) == bits;
+}
+
+/**
+ * @brief Blocks until all given connectivity levels are reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to wait for.
+ * @param timeout Longest wait in ticks, `portMAX_DELAY` to wait forever.
+ * @return `true` if all bits are set, `false` on timeout.
+ */
+bool connectivity_wait(EventBits_t bits, TickType_t timeout)
+{
+    if (connectivity_group == NULL) {
+        return false;
+    }
+    EventBits_t set = xEventGroupWaitBits(connectivity_group, bits, pdFALSE, pdTRUE, timeout);
+    return (set & bits) == bits;
+}
@@ -0,0 +1,58 @@
+// connectivity.h
+
+#ifndef MAIN_CONNECTIVITY_H_
+#define MAIN_CONNECTIVITY_H_
+
+#include <stdbool.h>  /**< @brief For bool */
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "esp_bit_defs.h"
+
+/** @brief Associated with the access point */
+#define CONNECTIVITY_LINK_UP         BIT0
+/** @brief IP address acquired */
+#define CONNECTIVITY_IP_ACQUIRED     BIT1
+/** @brief Connected to the MQTT broker */
+#define CONNECTIVITY_MQTT_CONNECTED  BIT2
+
+/**
+ * @brief Creates the event group holding the connectivity state.
+ *
+ * Must be called before the Wi-Fi and MQTT clients are started. Wi-Fi events set
+ * and clear the link and IP bits, MQTT events the MQTT bit; reconnecting is left
+ * to the Wi-Fi connection manager and the MQTT client, so other tasks only wait.
+ */
+void connectivity_init(void);
+
+/**
+ * @brief Marks connectivity levels as reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to set.
+ */
+void connectivity_set(EventBits_t bits);
+
+/**
+ * @brief Marks connectivity levels as lost.
+ *
+ * @param bits `CONNECTIVITY_*` bits to clear.
+ */
+void connectivity_clear(EventBits_t bits);
+
+/**
+ * @brief Checks whether all given connectivity levels are reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to check.
+ * @return `true` if all bits are set, `false` otherwise.
+ */
+bool connectivity_is(EventBits_t bits);
+
+/**
+ * @brief Blocks until all given connectivity levels are reached.
+ *
+ * @param bits `CONNECTIVITY_*` bits to wait for.
+ * @param timeout Longest wait in ticks, `portMAX_DELAY` to wait forever.
+ * @return `true` if all bits are set, `false` on timeout.
+ */
+bool connectivity_wait(EventBits_t bits, TickType_t timeout);
+
+#endif /* MAIN_CONNECTIVITY_H_ */
@@ -11,6 +11,8 @@
 #include "mqtt.h"
 #include "motor.h"
 #include "led.h"
+#include "timebase.h"
+#include "time_format.h"
 
 /** @brief GPIO number for the HX711 DATA pin (DOUT) */
 #define HX711_DATA_PIN GPIO_NUM_21  // Pin DOUT tensometru HX711
@@ -216,14 +218,9 @@ void tare(void)
  */
 void add_measurement(int32_t weight)
 {
-    time_t now = 0;
-    struct tm timeinfo = {0};
-    time(&now);
-    localtime_r(&now, &timeinfo);
-
     Measurement measurement;
     measurement.weight = weight;
-    measurement.timestamp = timeinfo;
+    measurement.timestamp_us = timebase_now_us();
 
     if (xSemaphoreTake(buffer_mutex, portMAX_DELAY) == pdTRUE)
     {
@@ -286,10 +283,9 @@ void get_all_measurements(void)
         Measurement m;
         if (read_measurement(&m))
         {
-            printf("Waga: %ld, Czas: %04d-%02d-%02dT%02d:%02d:%02d\n",
-                   m.weight,
-                   m.timestamp.tm_year + 1900, m.timestamp.tm_mon + 1, m.timestamp.tm_mday,
-                   m.timestamp.tm_hour, m.timestamp.tm_min, m.timestamp.tm_sec);
+            char timestamp[TIME_FORMAT_ISO_SIZE];
+            time_format_iso(timebase_to_wall_us(m.timestamp_us) / 1000000LL, timestamp);
+            printf("Waga: %ld, Czas: %s\n", m.weight, timestamp);
         }
         else
         {
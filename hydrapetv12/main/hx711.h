@@ -4,14 +4,13 @@
 #define HX711_H
 
 #include <stdint.h>
-#include <time.h>
 
 /**
  * @brief Structure representing a weight measurement.
  */
 typedef struct {
     int32_t weight;          /**< @brief Weight in raw units */
-    struct tm timestamp;     /**< @brief Timestamp of the measurement */
+    int64_t timestamp_us;    /**< @brief Monotonic timestamp of the measurement, see `timebase_now_us()` */
 } Measurement;
 
 /** @brief Size of the circular measurement buffer */
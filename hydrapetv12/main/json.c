@@ -0,0 +1,427 @@
+// json.c
+
+#include "json.h"
+#include <string.h>
+
+/** @brief Deepest nesting of objects and arrays accepted by `json_parse()` */
+#define JSON_MAX_DEPTH 8
+
+/**
+ * @brief State of the tokenizer.
+ */
+typedef struct {
+    const char *json;       /**< @brief Text of the document */
+    size_t len;             /**< @brief Length of the text */
+    size_t pos;             /**< @brief Offset of the next character */
+    json_token_t *tokens;   /**< @brief Pool of tokens */
+    size_t max_tokens;      /**< @brief Size of the pool */
+    size_t count;           /**< @brief Number of tokens used */
+} json_parser_t;
+
+/**
+ * @brief Skips whitespace.
+ *
+ * @param parser Pointer to the tokenizer.
+ */
+static void skip_space(json_parser_t *parser)
+{
+    while (parser->pos < parser->len) {
+        char c = parser->json[parser->pos];
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            break;
+        }
+        parser->pos++;
+    }
+}
+
+/**
+ * @brief Takes the next token of the pool.
+ *
+ * @param parser Pointer to the tokenizer.
+ * @param type Type of the token.
+ * @param start Offset of its first character.
+ * @return Index of the token, or -1 if the pool is exhausted.
+ */
+static int take_token(json_parser_t *parser, json_type_t type, size_t start)
+{
+    if (parser->count == parser->max_tokens) {
+        return -1;
+    }
+    json_token_t *token = &parser->tokens[parser->count];
+    token->type = (uint8_t)type;
+    token->start = (uint16_t)start;
+    token->end = (uint16_t)start;
+    token->size = 0;
+    return (int)parser->count++;
+}
+
+/**
+ * @brief Checks whether a character is a hexadecimal digit.
+ *
+ * @param c The character.
+ * @return `true` for 0-9, a-f and A-F, `false` otherwise.
+ */
+static bool is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+/**
+ * @brief Tokenizes a string, the parse position being on its opening quote.
+ *
+ * @param parser Pointer to the tokenizer.
+ * @return Index of the token, `JSON_ERROR_NOMEM` or `JSON_ERROR_INVALID`.
+ */
+static int parse_string(json_parser_t *parser)
+{
+    int index = take_token(parser, JSON_TYPE_STRING, ++parser->pos);
+    if (index < 0) {
+        return JSON_ERROR_NOMEM;
+    }
+
+    while (parser->pos < parser->len) {
+        char c = parser->json[parser->pos];
+        if (c == '"') {
+            parser->tokens[index].end = (uint16_t)parser->pos++;
+            return index;
+        }
+        if ((uint8_t)c < 0x20) {
+            return JSON_ERROR_INVALID;
+        }
+        if (c == '\\') {
+            if (++parser->pos == parser->len) {
+                return JSON_ERROR_INVALID;
+            }
+            c = parser->json[parser->pos];
+            if (c == 'u') {
+                if (parser->len - parser->pos < 5) {
+                    return JSON_ERROR_INVALID;
+                }
+                for (int i = 1; i <= 4; i++) {
+                    if (!is_hex(parser->json[parser->pos + i])) {
+                        return JSON_ERROR_INVALID;
+                    }
+                }
+                parser->pos += 4;
+            } else if (strchr("\"\\/bfnrt", c) == NULL || c == '\0') {
+                return JSON_ERROR_INVALID;
+            }
+        }
+        parser->pos++;
+    }
+    return JSON_ERROR_INVALID;
+}
+
+/**
+ * @brief Skips the digits at the parse position.
+ *
+ * @param parser Pointer to the tokenizer.
+ * @return `true` if at least one digit was skipped, `false` otherwise.
+ */
+static bool skip_digits(json_parser_t *parser)
+{
+    size_t start = parser->pos;
+    while (parser->pos < parser->len && parser->json[parser->pos] >= '0' && parser->json[parser->pos] <= '9') {
+        parser->pos++;
+    }
+    return parser->pos > start;
+}
+
+/**
+ * @brief Tokenizes a number, `true`, `false` or `null`.
+ *
+ * @param parser Pointer to the tokenizer.
+ * @return Index of the token, `JSON_ERROR_NOMEM` or `JSON_ERROR_INVALID`.
+ */
+static int parse_primitive(json_parser_t *parser)
+{
+    static const char *const literals[] = { "true", "false", "null" };
+    int index = take_token(parser, JSON_TYPE_PRIMITIVE, parser->pos);
+    if (index < 0) {
+        return JSON_ERROR_NOMEM;
+    }
+
+    const char *p = parser->json + parser->pos;
+    size_t left = parser->len - parser->pos;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(literals) / sizeof(literals[0]); i++) {
+        size_t literal_len = strlen(literals[i]);
+        if (left >= literal_len && memcmp(p, literals[i], literal_len) == 0) {
+            parser->pos += literal_len;
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        // -?digits(.digits)?([eE][+-]?digits)?
+        if (*p == '-') {
+            parser->pos++;
+        }
+        if (!skip_digits(parser)) {
+            return JSON_ERROR_INVALID;
+        }
+        if (parser->pos < parser->len && parser->json[parser->pos] == '.') {
+            parser->pos++;
+            if (!skip_digits(parser)) {
+                return JSON_ERROR_INVALID;
+            }
+        }
+        if (parser->pos < parser->len && (parser->json[parser->pos] == 'e' || parser->json[parser->pos] == 'E')) {
+            parser->pos++;
+            if (parser->pos < parser->len && (parser->json[parser->pos] == '+' || parser->json[parser->pos] == '-')) {
+                parser->pos++;
+            }
+            if (!skip_digits(parser)) {
+                return JSON_ERROR_INVALID;
+            }
+        }
+    }
+    parser->tokens[index].end = (uint16_t)parser->pos;
+    return index;
+}
+
+/**
+ * @brief Tokenizes a value and its children.
+ *
+ * @param parser Pointer to the tokenizer.
+ * @param depth Number of containers around the value.
+ * @return Index of the token, `JSON_ERROR_NOMEM` or `JSON_ERROR_INVALID`.
+ */
+static int parse_value(json_parser_t *parser, int depth)
+{
+    skip_space(parser);
+    if (parser->pos == parser->len) {
+        return JSON_ERROR_INVALID;
+    }
+
+    char open = parser->json[parser->pos];
+    if (open == '"') {
+        return parse_string(parser);
+    }
+    if (open != '{' && open != '[') {
+        return parse_primitive(parser);
+    }
+    if (depth == JSON_MAX_DEPTH) {
+        return JSON_ERROR_INVALID;
+    }
+
+    bool is_object = (open == '{');
+    char close = is_object ? '}' : ']';
+    int index = take_token(parser, is_object ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY, parser->pos++);
+    if (index < 0) {
+        return JSON_ERROR_NOMEM;
+    }
+
+    skip_space(parser);
+    if (parser->pos < parser->len && parser->json[parser->pos] == close) {
+        parser->tokens[index].end = (uint16_t)++parser->pos;
+        return index;
+    }
+
+    while (1) {
+        if (is_object) {
+            skip_space(parser);
+            if (parser->pos == parser->len || parser->json[parser->pos] != '"') {
+                return JSON_ERROR_INVALID;
+            }
+            int key = parse_string(parser);
+            if (key < 0) {
+                return key;
+            }
+            parser->tokens[key].size = 1;
+            skip_space(parser);
+            if (parser->pos == parser->len || parser->json[parser->pos] != ':') {
+                return JSON_ERROR_INVALID;
+            }
+            parser->pos++;
+        }
+
+        int child = parse_value(parser, depth + 1);
+        if (child < 0) {
+            return child;
+        }
+        parser->tokens[index].size++;
+
+        skip_space(parser);
+        if (parser->pos == parser->len) {
+            return JSON_ERROR_INVALID;
+        }
+        char c = parser->json[parser->pos++];
+        if (c == close) {
+            parser->tokens[index].end = (uint16_t)parser->pos;
+            return index;
+        }
+        if (c != ',') {
+            return JSON_ERROR_INVALID;
+        }
+    }
+}
+
+/**
+ * @brief Tokenizes a JSON document in place, without allocating.
+ *
+ * @param doc Pointer where the parsed document is stored.
+ * @param json Text of the document, not necessarily NUL-terminated.
+ * @param len Length of the text, up to `JSON_MAX_LEN`.
+ * @param tokens Pool of tokens to fill.
+ * @param max_tokens Size of the pool.
+ * @return Number of tokens, `JSON_ERROR_NOMEM` or `JSON_ERROR_INVALID`.
+ */
+int json_parse(json_doc_t *doc, const char *json, size_t len, json_token_t *tokens, size_t max_tokens)
+{
+    json_parser_t parser = {
+        .json = json,
+        .len = len,
+        .tokens = tokens,
+        .max_tokens = max_tokens,
+    };
+
+    doc->json = json;
+    doc->tokens = tokens;
+    doc->count = 0;
+    if (len > JSON_MAX_LEN) {
+        return JSON_ERROR_INVALID;
+    }
+
+    int root = parse_value(&parser, 0);
+    if (root < 0) {
+        return root;
+    }
+    // Nothing but whitespace may follow the value
+    skip_space(&parser);
+    if (parser.pos != len) {
+        return JSON_ERROR_INVALID;
+    }
+
+    doc->count = (int)parser.count;
+    return doc->count;
+}
+
+/**
+ * @brief Returns the token following a value and all its children.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @return Index of the next sibling, or `doc->count` after the last one.
+ */
+int json_next(const json_doc_t *doc, int token)
+{
+    uint16_t end = doc->tokens[token].end;
+    int next = token + 1;
+    // Children start inside their container, siblings after it
+    while (next < doc->count && doc->tokens[next].start < end) {
+        next++;
+    }
+    return next;
+}
+
+/**
+ * @brief Looks up the value of a key of an object.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key, compared with the raw key text.
+ * @return Index of the value, or -1 if `object` is not an object or lacks the key.
+ */
+int json_object_get(const json_doc_t *doc, int object, const char *key)
+{
+    if (object < 0 || object >= doc->count || doc->tokens[object].type != JSON_TYPE_OBJECT) {
+        return -1;
+    }
+
+    size_t key_len = strlen(key);
+    int token = object + 1;
+    for (uint16_t i = 0; i < doc->tokens[object].size; i++) {
+        const json_token_t *name = &doc->tokens[token];
+        if ((size_t)(name->end - name->start) == key_len &&
+            memcmp(doc->json + name->start, key, key_len) == 0) {
+            return token + 1;
+        }
+        token = json_next(doc, token + 1);
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads an integer value.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @param value Pointer where the integer is stored.
+ * @return `true` if the value is an integer of up to 18 digits, `false` otherwise.
+ */
+bool json_get_int(const json_doc_t *doc, int token, int64_t *value)
+{
+    if (token < 0 || token >= doc->count || doc->tokens[token].type != JSON_TYPE_PRIMITIVE) {
+        return false;
+    }
+
+    const char *p = doc->json + doc->tokens[token].start;
+    const char *end = doc->json + doc->tokens[token].end;
+    bool negative = (*p == '-');
+    if (negative) {
+        p++;
+    }
+    // 18 digits never overflow, longer numbers are out of range for all fields anyway
+    if (p == end || end - p > 18) {
+        return false;
+    }
+    int64_t v = 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+        v = v * 10 + (*p - '0');
+    }
+    *value = negative ? -v : v;
+    return true;
+}
+
+/**
+ * @brief Reads a string value, as a view of the raw text without unescaping.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @param str Pointer where the start of the string is stored.
+ * @param len Pointer where the length of the string is stored.
+ * @return `true` if the value is a string, `false` otherwise.
+ */
+bool json_get_string(const json_doc_t *doc, int token, const char **str, size_t *len)
+{
+    if (token < 0 || token >= doc->count || doc->tokens[token].type != JSON_TYPE_STRING) {
+        return false;
+    }
+    *str = doc->json + doc->tokens[token].start;
+    *len = doc->tokens[token].end - doc->tokens[token].start;
+    return true;
+}
+
+/**
+ * @brief Reads an integer value of a key of an object.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key.
+ * @param value Pointer where the integer is stored.
+ * @return `true` if the key was found with an integer value, `false` otherwise.
+ */
+bool json_object_get_int(const json_doc_t *doc, int object, const char *key, int64_t *value)
+{
+    return json_get_int(doc, json_object_get(doc, object, key), value);
+}
+
+/**
+ * @brief Reads a string value of a key of an object, without unescaping.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key.
+ * @param str Pointer where the start of the string is stored.
+ * @param len Pointer where the length of the string is stored.
+ * @return `true` if the key was found with a string value, `false` otherwise.
+ */
+bool json_object_get_string(const json_doc_t *doc, int object, const char *key, const char **str, size_t *len)
+{
+    return json_get_string(doc, json_object_get(doc, object, key), str, len);
+}
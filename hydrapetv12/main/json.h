@@ -0,0 +1,126 @@
+// json.h
+
+#ifndef MAIN_JSON_H_
+#define MAIN_JSON_H_
+
+#include <stdint.h>   /**< @brief For uint16_t, int64_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include <stdbool.h>  /**< @brief For bool */
+
+/** @brief Longest document accepted, bounded by the 16-bit token offsets */
+#define JSON_MAX_LEN UINT16_MAX
+
+/** @brief Error returned by `json_parse()` when the document needs more tokens than given */
+#define JSON_ERROR_NOMEM (-1)
+/** @brief Error returned by `json_parse()` when the document is not valid JSON */
+#define JSON_ERROR_INVALID (-2)
+
+/** @brief Types of JSON tokens */
+typedef enum {
+    JSON_TYPE_OBJECT,     /**< @brief Object, `size` being its number of keys */
+    JSON_TYPE_ARRAY,      /**< @brief Array, `size` being its number of elements */
+    JSON_TYPE_STRING,     /**< @brief String, spanning its content without the quotes or unescaping */
+    JSON_TYPE_PRIMITIVE,  /**< @brief Number, `true`, `false` or `null` */
+} json_type_t;
+
+/**
+ * @brief Token of a parsed document, pointing into the document text.
+ *
+ * Tokens are stored in document order, so a key is followed by its value and a
+ * container by its children.
+ */
+typedef struct {
+    uint8_t type;     /**< @brief Type of the token, a `json_type_t` */
+    uint16_t start;   /**< @brief Offset of the first character */
+    uint16_t end;     /**< @brief Offset past the last character */
+    uint16_t size;    /**< @brief Number of keys of an object, elements of an array, 1 for a key */
+} json_token_t;
+
+/**
+ * @brief Parsed document: the text and its tokens, the root being token 0.
+ */
+typedef struct {
+    const char *json;             /**< @brief Text of the document, not necessarily NUL-terminated */
+    const json_token_t *tokens;   /**< @brief Tokens of the document */
+    int count;                    /**< @brief Number of tokens */
+} json_doc_t;
+
+/**
+ * @brief Tokenizes a JSON document in place, without allocating.
+ *
+ * The whole document must be one valid JSON value, optionally surrounded by
+ * whitespace, nested at most 8 levels deep.
+ *
+ * @param doc Pointer where the parsed document is stored.
+ * @param json Text of the document, not necessarily NUL-terminated.
+ * @param len Length of the text, up to `JSON_MAX_LEN`.
+ * @param tokens Pool of tokens to fill.
+ * @param max_tokens Size of the pool.
+ * @return Number of tokens, `JSON_ERROR_NOMEM` or `JSON_ERROR_INVALID`.
+ */
+int json_parse(json_doc_t *doc, const char *json, size_t len, json_token_t *tokens, size_t max_tokens);
+
+/**
+ * @brief Returns the token following a value and all its children.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @return Index of the next sibling, or `doc->count` after the last one.
+ */
+int json_next(const json_doc_t *doc, int token);
+
+/**
+ * @brief Looks up the value of a key of an object.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key, compared with the raw key text.
+ * @return Index of the value, or -1 if `object` is not an object or lacks the key.
+ */
+int json_object_get(const json_doc_t *doc, int object, const char *key);
+
+/**
+ * @brief Reads an integer value.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @param value Pointer where the integer is stored.
+ * @return `true` if the value is an integer of up to 18 digits, `false` otherwise.
+ */
+bool json_get_int(const json_doc_t *doc, int token, int64_t *value);
+
+/**
+ * @brief Reads a string value, as a view of the raw text without unescaping.
+ *
+ * @param doc Pointer to the document.
+ * @param token Index of the value.
+ * @param str Pointer where the start of the string is stored.
+ * @param len Pointer where the length of the string is stored.
+ * @return `true` if the value is a string, `false` otherwise.
+ */
+bool json_get_string(const json_doc_t *doc, int token, const char **str, size_t *len);
+
+/**
+ * @brief Reads an integer value of a key of an object.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key.
+ * @param value Pointer where the integer is stored.
+ * @return `true` if the key was found with an integer value, `false` otherwise.
+ */
+bool json_object_get_int(const json_doc_t *doc, int object, const char *key, int64_t *value);
+
+/**
+ * @brief Reads a string value of a key of an object, without unescaping.
+ *
+ * @param doc Pointer to the document.
+ * @param object Index of the object.
+ * @param key The key.
+ * @param str Pointer where the start of the string is stored.
+ * @param len Pointer where the length of the string is stored.
+ * @return `true` if the key was found with a string value, `false` otherwise.
+ */
+bool json_object_get_string(const json_doc_t *doc, int object, const char *key, const char **str, size_t *len);
+
+#endif /* MAIN_JSON_H_ */
@@ -23,8 +23,15 @@
 #include "buttons.h"      
 #include "driver/uart.h"  
 #include "wifi.h"
+#include "connectivity.h"
 #include "motor.h"
 #include "alarms.h"
+#include "time_sync.h"
+#include "timebase.h"
+#include "topics.h"
+#include "commands.h"
+#include "publisher.h"
+#include "telemetry.h"
 #include "water_level_sensor.h"
 #include "config.h"
 
@@ -34,12 +41,12 @@ static const char *TAG = "MAIN";
  * @brief Task responsible for publishing sensor data periodically.
  *
  * This FreeRTOS task runs indefinitely, performing the following actions in a loop:
- * 1. Checks if the device is connected to Wi-Fi.
- * 2. If connected, reads the current weight from the HX711 sensor.
- * 3. Retrieves the current system time.
- * 4. Publishes the collected data to various MQTT topics.
- * 5. Blinks an LED for visual feedback.
- * 6. Waits for the defined duration before repeating the process.
+ * 1. Publishes telemetry stored while the broker was unreachable, in paced batches.
+ * 2. Reads the weight, the device states and the current time once.
+ * 3. Publishes the fields that changed, or all fields as a heartbeat, in one telemetry message,
+ *    or stores the message while offline.
+ * 4. Blinks an LED for visual feedback if a message was published or stored.
+ * 5. Waits for the defined duration before repeating the process.
  *
  * @param pvParameters Pointer to task parameters (unused).
  */
@@ -47,41 +54,22 @@ static void publish_task(void *pvParameters)
 {
     while (true)
     {
-        // Check if connected to Wi-Fi
-        while (!is_wifi_connected())
+        // Catch up on readings taken while offline, oldest first
+        telemetry_flush();
+
+        // Read all fields once, also while offline
+        telemetry_sample_t sample;
+        telemetry_read(&sample);
+
+        // Publish the changed fields to "<device_id>/hydrapetinfo/telemetry"
+        if (telemetry_report(&sample))
         {
-            ESP_LOGW(TAG, "Wi-Fi connection not established yet");
-            vTaskDelay(pdMS_TO_TICKS(2000)); 
+            // Blink LED after publishing
+            led_blink_once();
         }
 
-        // Connected to Wi-Fi, proceed to read data
-        int32_t weight = get_water_weight();  // Read weight from HX711
-        time_t now = 0;
-        time(&now);
-        struct tm timeinfo = {0};
-        localtime_r(&now, &timeinfo);
-
-        // Publish to "hydrapet0001/hydrapetinfo/all"
-        mqtt_publish_all(weight, 
-                        timeinfo, 
-                        user_button_state(), 
-                        led_get_state(), 
-                        get_motor_state());
-
-        // Publish water state to "hydrapet0001/hydrapetinfo/water"
-        mqtt_publish_water_state(weight);
-
-        // Publish current time to "hydrapet0001/hydrapetinfo/time"
-        mqtt_publish_current_time(timeinfo);
-        
-        // Publish water tank level status
-        mqtt_publish_water_tank_level();
-
-        // Blink LED after publishing
-        led_blink_once();
-
-        // Wait for the defined duration before the next publish cycle
-        vTaskDelay(pdMS_TO_TICKS(PUBLISH_ALL_DURATION_TIME));
+        // Wait for the defined duration before the next reading
+        vTaskDelay(pdMS_TO_TICKS(TELEMETRY_SAMPLE_PERIOD_MS));
     }
 }
 
@@ -102,14 +90,30 @@ void app_main(void)
     }
     ESP_ERROR_CHECK(ret);
 
+    // Determine the device ID and build the MQTT topics
+    topics_init();
+
+    // Load the telemetry encoding of the device
+    telemetry_init();
+
     // Initialize LED module
     led_init();
     
     // Set Wi-Fi logging level to ERROR to reduce verbosity
     esp_log_level_set("wifi", ESP_LOG_ERROR);
 
-    // Initialize Wi-Fi connection
-    wifi_init();    
+    // Create the connectivity state the Wi-Fi and MQTT events are reported to
+    connectivity_init();
+
+    // Start connecting to Wi-Fi in the background; everything below works offline
+    wifi_init();
+
+    // Start SNTP time synchronisation
+    time_sync_init();
+
+    // Start the scheduler sending outgoing MQTT messages by priority, ready
+    // for the birth message queued when the client connects
+    publisher_init();
 
     // Initialize MQTT client
     mqtt_init();
@@ -131,15 +135,18 @@ void app_main(void)
     /**
      * @brief Task for publishing sensor data periodically.
      *
-     * Publishes weight, time, button state, LED state, and motor state every minute.
+     * Reads weight, button state, LED state, motor state and tank level every few seconds
+     * and publishes the changes.
      */
     xTaskCreate(publish_task, "publish_task", 4096, NULL, 5, NULL);
 
     /**
      * @brief Task for handling MQTT incoming messages.
      *
-     * Sets up the callback function to handle messages received on subscribed MQTT topics.
+     * Starts the worker executing commands and sets up the callback function that
+     * parses messages received on subscribed MQTT topics and queues them for it.
      */
+    commands_init();
     mqtt_set_message_callback(mqtt_message_handler);
 
     /**
@@ -2,16 +2,23 @@
 
 #include "mqtt.h"
 #include "mqtt_client.h"
+#include "mqtt_tls.h"
+#include "connectivity.h"
 #include "esp_log.h"
 #include <string.h>
 #include <stdlib.h>
-#include "hx711.h"
 #include "motor.h"
-#include "led.h"
-#include "buttons.h"
 #include <sys/time.h>
 #include <errno.h>
 #include "alarms.h"
+#include "timebase.h"
+#include "time_format.h"
+#include "topics.h"
+#include "commands.h"
+#include "cbor.h"
+#include "json.h"
+#include "telemetry.h"
+#include "config.h"
 
 /** @brief Tag used for ESP logging */
 static const char *TAG = "MQTT";
@@ -22,6 +29,155 @@ static esp_mqtt_client_handle_t mqtt_client = NULL;
 /** @brief Global callback function for handling incoming MQTT messages */
 static mqtt_callback_t global_mqtt_callback = NULL;
 
+static bool mqtt_routes_sorted(void);
+
+/** @brief Status published as the birth message on connection */
+#define MQTT_STATUS_ONLINE "online"
+
+/** @brief Status published by the broker as the Last Will when the connection is lost */
+#define MQTT_STATUS_OFFLINE "offline"
+
+/** @brief Longest topic accepted on incoming messages */
+#define MQTT_TOPIC_MAX_LEN 127
+
+/**
+ * @brief Reassembly state of an incoming message split over several `MQTT_EVENT_DATA` events.
+ */
+typedef struct {
+    char topic[MQTT_TOPIC_MAX_LEN]; /**< @brief Topic, only carried by the first fragment */
+    size_t topic_len;               /**< @brief Length of the topic */
+    char *data;                     /**< @brief Buffer of the whole payload, NULL when idle */
+    size_t total_len;               /**< @brief Length of the whole payload */
+    size_t received;                /**< @brief Number of payload bytes received so far */
+} mqtt_reassembly_t;
+
+/** @brief Message being reassembled, only used from the MQTT task */
+static mqtt_reassembly_t reassembly = { 0 };
+
+/** @brief Number of incoming messages dropped as oversized, out of order or out of memory */
+static uint32_t mqtt_dropped_messages = 0;
+
+#if CONFIG_MQTT_PROTOCOL_5
+/**
+ * @brief MQTT 5 properties of the message being received, carried by its first fragment.
+ */
+typedef struct {
+    char response_topic[COMMAND_RESPONSE_TOPIC_MAX_LEN + 1]; /**< @brief Response topic, empty for none */
+    uint8_t correlation[COMMAND_CORRELATION_MAX_LEN];        /**< @brief Correlation data */
+    size_t correlation_len;                                  /**< @brief Length of `correlation` */
+} mqtt_request_property_t;
+
+/** @brief Properties of the message being received, only used from the MQTT task */
+static mqtt_request_property_t request_property = { 0 };
+
+/**
+ * @brief Saves the response topic and correlation data of a request for its response.
+ *
+ * Properties that do not fit are dropped, so the request is answered without them.
+ *
+ * @param property Properties of the first fragment of the message, or NULL.
+ */
+static void request_property_save(const esp_mqtt5_event_property_t *property)
+{
+    memset(&request_property, 0, sizeof(request_property));
+    if (property == NULL) {
+        return;
+    }
+    if (property->response_topic != NULL && property->response_topic_len > 0 &&
+        property->response_topic_len <= COMMAND_RESPONSE_TOPIC_MAX_LEN) {
+        memcpy(request_property.response_topic, property->response_topic, property->response_topic_len);
+    }
+    if (property->correlation_data != NULL && property->correlation_data_len <= COMMAND_CORRELATION_MAX_LEN) {
+        memcpy(request_property.correlation, property->correlation_data, property->correlation_data_len);
+        request_property.correlation_len = property->correlation_data_len;
+    }
+}
+#endif
+
+/**
+ * @brief Drops the message being reassembled, if any.
+ */
+static void reassembly_reset(void)
+{
+    free(reassembly.data);
+    reassembly.data = NULL;
+    reassembly.received = 0;
+}
+
+/**
+ * @brief Passes the data of an `MQTT_EVENT_DATA` event to the message callback.
+ *
+ * A message received in a single event is passed as a view of the client buffer,
+ * without copying. Larger messages arrive in fragments at increasing
+ * `current_data_offset`; they are copied into a buffer of `total_data_len` bytes and
+ * passed once complete. Messages above `MQTT_MESSAGE_MAX_SIZE` are dropped.
+ *
+ * @param event The MQTT data event.
+ */
+static void mqtt_handle_data(esp_mqtt_event_handle_t event)
+{
+    if (global_mqtt_callback == NULL) {
+        return;
+    }
+
+#if CONFIG_MQTT_PROTOCOL_5
+    if (event->current_data_offset == 0) {
+        request_property_save(event->property);
+    }
+#endif
+
+    // Common case: the whole message in one event
+    if (event->current_data_offset == 0 && event->data_len == event->total_data_len) {
+        reassembly_reset();
+        if (event->topic_len > MQTT_TOPIC_MAX_LEN) {
+            mqtt_dropped_messages++;
+            ESP_LOGW(TAG, "Dropping message with a %d byte topic", event->topic_len);
+            return;
+        }
+        global_mqtt_callback(event->topic, event->topic_len, event->data, event->data_len);
+        return;
+    }
+
+    if (event->current_data_offset == 0) {
+        // First fragment, the only one carrying the topic
+        reassembly_reset();
+        if (event->total_data_len > MQTT_MESSAGE_MAX_SIZE || event->topic_len > MQTT_TOPIC_MAX_LEN) {
+            mqtt_dropped_messages++;
+            ESP_LOGW(TAG, "Dropping %d byte message (%lu dropped)",
+                     event->total_data_len, (unsigned long)mqtt_dropped_messages);
+            return;
+        }
+        reassembly.data = malloc(event->total_data_len);
+        if (reassembly.data == NULL) {
+            mqtt_dropped_messages++;
+            ESP_LOGE(TAG, "No memory to reassemble %d byte message", event->total_data_len);
+            return;
+        }
+        memcpy(reassembly.topic, event->topic, event->topic_len);
+        reassembly.topic_len = event->topic_len;
+        reassembly.total_len = event->total_data_len;
+    }
+
+    // Fragments of a dropped message are ignored, and a gap drops the message
+    if (reassembly.data == NULL) {
+        return;
+    }
+    if ((size_t)event->current_data_offset != reassembly.received ||
+        reassembly.received + event->data_len > reassembly.total_len) {
+        mqtt_dropped_messages++;
+        ESP_LOGW(TAG, "Dropping message with unexpected fragment at offset %d", event->current_data_offset);
+        reassembly_reset();
+        return;
+    }
+    memcpy(reassembly.data + reassembly.received, event->data, event->data_len);
+    reassembly.received += event->data_len;
+
+    if (reassembly.received == reassembly.total_len) {
+        global_mqtt_callback(reassembly.topic, reassembly.topic_len, reassembly.data, reassembly.total_len);
+        reassembly_reset();
+    }
+}
+
 /**
  * @brief Handler for MQTT events.
  *
@@ -39,43 +195,28 @@ static void mqtt_event_handler_cb(void *handler_args, esp_event_base_t base, int
     esp_mqtt_event_handle_t event = event_data;
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED:
-            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
-            // Subscribe to relevant topics upon connection
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/set/time", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/get/time", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/set/water", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/get/water", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/get/status", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/set/alarm", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/get/alarms", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/del/alarm", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/put/pourwater", 0);
-            esp_mqtt_client_subscribe(mqtt_client, "hydrapet0001/update/set/tare", 0);
-            ESP_LOGI(TAG, "MQTT topic subscriptions completed");
+            ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED (session present: %d)", event->session_present);
+            // Birth message replacing the retained Last Will, ahead of everything queued
+            mqtt_publish_retained(PUBLISH_CLASS_ALARM, topic_get(TOPIC_INFO_STATUS),
+                                  MQTT_STATUS_ONLINE, sizeof(MQTT_STATUS_ONLINE) - 1);
+            // Releases the publisher task, which sends what was queued while disconnected
+            connectivity_set(CONNECTIVITY_MQTT_CONNECTED);
+            // The broker keeps the subscription of a persistent session, with the
+            // QoS 1 commands sent while the device was offline
+            if (!event->session_present) {
+                esp_mqtt_client_subscribe(mqtt_client, topic_get(TOPIC_UPDATE_WILDCARD), 1);
+                ESP_LOGI(TAG, "MQTT topic subscriptions completed");
+            }
             break;
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+            connectivity_clear(CONNECTIVITY_MQTT_CONNECTED);
+            // The rest of a partially received message will not arrive
+            reassembly_reset();
             break;
         case MQTT_EVENT_DATA:
             // Handle incoming MQTT data
-            if (global_mqtt_callback != NULL) {
-                // Copy topic and message to buffers
-                char topic[128];
-                char message[256];
-                memset(topic, 0, sizeof(topic));
-                memset(message, 0, sizeof(message));
-
-                // Copy topic
-                strncpy(topic, event->topic, event->topic_len);
-                topic[event->topic_len] = '\0';
-
-                // Copy message
-                strncpy(message, event->data, event->data_len);
-                message[event->data_len] = '\0';
-
-                // Invoke the callback
-                global_mqtt_callback(topic, message);
-            }
+            mqtt_handle_data(event);
             break;
         // Handle other events as needed
         default:
@@ -94,37 +235,171 @@ void mqtt_init(void)
     esp_mqtt_client_config_t mqtt_cfg = {
         .broker = {
             .address = {
-                .uri = "mqtt://test.mosquitto.org:1883", // Change to your own broker if needed
+                .uri = MQTT_BROKER_URI,
+            },
+        },
+        // A stable client ID lets the broker resume the session after a reconnect
+        .credentials = {
+            .client_id = device_id(),
+        },
+        .session = {
+            .disable_clean_session = true,
+            .keepalive = MQTT_KEEPALIVE_S,
+            // Published by the broker when the connection is lost without a goodbye
+            .last_will = {
+                .topic = topic_get(TOPIC_INFO_STATUS),
+                .msg = MQTT_STATUS_OFFLINE,
+                .msg_len = sizeof(MQTT_STATUS_OFFLINE) - 1,
+                .qos = 1,
+                .retain = 1,
             },
+#if CONFIG_MQTT_PROTOCOL_5
+            // Requests may carry a response topic and correlation data
+            .protocol_ver = MQTT_PROTOCOL_V_5,
+#endif
         },
     };
 
+    // TLS through a transport keeping the session ticket, so reconnects resume the session
+    if (strncmp(MQTT_BROKER_URI, "mqtts://", 8) == 0) {
+        mqtt_cfg.network.transport = mqtt_tls_transport();
+    }
+
     mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     if (mqtt_client == NULL) {
         ESP_LOGE(TAG, "Failed to initialize MQTT client");
         return;
     }
 
+#if CONFIG_MQTT_PROTOCOL_5
+    // MQTT 5 ends a session on disconnection unless it is given an expiry interval
+    esp_mqtt5_connection_property_config_t connect_property = {
+        .session_expiry_interval = MQTT_SESSION_EXPIRY_S,
+    };
+    esp_err_t err = esp_mqtt5_client_set_connect_property(mqtt_client, &connect_property);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set the session expiry interval: %s", esp_err_to_name(err));
+    }
+#endif
+
+    if (!mqtt_routes_sorted()) {
+        ESP_LOGE(TAG, "MQTT route table unsorted, some commands will not be found");
+    }
+
     esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler_cb, NULL);
     esp_mqtt_client_start(mqtt_client);
     ESP_LOGI(TAG, "MQTT initialized.");
 }
 
 /**
- * @brief Publishes a message to a specific MQTT topic.
+ * @brief Queues a text message for a specific MQTT topic.
  *
+ * @param cls Priority class of the message.
  * @param topic The MQTT topic to publish to.
  * @param payload The message payload to publish.
  */
-void mqtt_publish(const char *topic, const char *payload)
+void mqtt_publish(publish_class_t cls, const char *topic, const char *payload)
+{
+    if (publisher_send(cls, topic, payload, strlen(payload))) {
+        ESP_LOGI(TAG, "MQTT publish: %s -> %s", topic, payload);
+    }
+}
+
+/**
+ * @brief Queues a binary message for a specific MQTT topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued for sending, `false` otherwise.
+ */
+bool mqtt_publish_data(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    if (!publisher_send(cls, topic, data, len)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "MQTT publish: %s -> %u bytes", topic, (unsigned)len);
+    return true;
+}
+
+/**
+ * @brief Queues a message the broker retains, replacing the previous one of the topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued for sending, `false` otherwise.
+ */
+bool mqtt_publish_retained(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    if (!publisher_send_retained(cls, topic, data, len)) {
+        return false;
+    }
+    ESP_LOGI(TAG, "MQTT publish retained: %s -> %u bytes", topic, (unsigned)len);
+    return true;
+}
+
+/**
+ * @brief Hands a message to the MQTT client.
+ *
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @param qos MQTT QoS of the message.
+ * @param retain Whether the broker retains the message.
+ * @param correlation MQTT 5 correlation data, or NULL for none; ignored with MQTT 3.1.1.
+ * @param correlation_len Length of the correlation data.
+ * @return `true` if the client accepted the message, `false` otherwise.
+ */
+bool mqtt_send(const char *topic, const void *data, size_t len, int qos, bool retain,
+               const void *correlation, size_t correlation_len)
 {
     if (mqtt_client == NULL) {
         ESP_LOGE(TAG, "MQTT client not initialized");
-        return;
+        return false;
     }
 
-    esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 0);
-    ESP_LOGI(TAG, "MQTT publish: %s -> %s", topic, payload);
+#if CONFIG_MQTT_PROTOCOL_5
+    // The properties apply to the next publish, so they are set for every message
+    esp_mqtt5_publish_property_config_t property = {
+        .correlation_data = correlation,
+        .correlation_data_len = (uint16_t)correlation_len,
+    };
+    esp_mqtt5_client_set_publish_property(mqtt_client, &property);
+#endif
+
+    int msg_id = esp_mqtt_client_publish(mqtt_client, topic, data, (int)len, qos, retain ? 1 : 0);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "MQTT publish failed: %s", topic);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whether the client is connected to the broker.
+ *
+ * @return `true` between the CONNECTED and DISCONNECTED events, `false` otherwise.
+ */
+bool mqtt_is_connected(void)
+{
+    return connectivity_is(CONNECTIVITY_MQTT_CONNECTED);
+}
+
+/**
+ * @brief Returns the number of bytes of QoS 1 messages not yet acknowledged by the broker.
+ *
+ * @return Size of the outbox in bytes, 0 if the client is not initialized.
+ */
+size_t mqtt_outbox_size(void)
+{
+    if (mqtt_client == NULL) {
+        return 0;
+    }
+    int size = esp_mqtt_client_get_outbox_size(mqtt_client);
+    return (size > 0) ? (size_t)size : 0;
 }
 
 /**
@@ -133,37 +408,30 @@ void mqtt_publish(const char *topic, const char *payload)
  * This function constructs a JSON payload containing the current weight, timestamp,
  * button state, LED state, and motor state, then publishes it to the designated topic.
  *
+ * @param cls Priority class of the message.
  * @param weight The measured weight.
- * @param timestamp The timestamp of the measurement.
+ * @param timestamp_us Monotonic timestamp of the measurement, see `timebase_now_us()`.
  * @param button_state The state of the user button.
  * @param led_state The state of the LED.
  * @param pin15_state The state of pin 15 (motor).
  */
-void mqtt_publish_all(int32_t weight, struct tm timestamp, bool button_state, bool led_state, bool pin15_state)
+void mqtt_publish_all(publish_class_t cls, int32_t weight, int64_t timestamp_us, bool button_state, bool led_state,
+                      bool pin15_state)
 {
-    if (mqtt_client == NULL) {
-        ESP_LOGE(TAG, "MQTT client not initialized");
-        return;
-    }
-
-    char topic[50];
     char payload[300]; // Increased size to accommodate all data
-
-    // Topic: hydrapet/get/all
-    snprintf(topic, sizeof(topic), "hydrapet0001/hydrapetinfo/all");
+    char timestamp[TIME_FORMAT_ISO_SIZE];
+    time_format_iso(timebase_to_wall_us(timestamp_us) / 1000000LL, timestamp);
 
     // Create JSON payload with data
     snprintf(payload, sizeof(payload),
-             "{\"weight\": %ld, \"timestamp\": \"%04d-%02d-%02dT%02d:%02d:%02d\", \"button_state\": \"%s\", \"led_state\": \"%s\", \"motor_state\": \"%s\"}",
+             "{\"weight\": %ld, \"timestamp\": \"%s\", \"button_state\": \"%s\", \"led_state\": \"%s\", \"motor_state\": \"%s\"}",
              weight,
-             timestamp.tm_year + 1900, timestamp.tm_mon + 1, timestamp.tm_mday,
-             timestamp.tm_hour, timestamp.tm_min, timestamp.tm_sec,
+             timestamp,
              button_state ? "PRESSED" : "RELEASED",
              led_state ? "ON" : "OFF",
              pin15_state ? "ON" : "OFF");
 
-    esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 0);
-    ESP_LOGI(TAG, "MQTT publish: %s -> %s", topic, payload);
+    mqtt_publish(cls, topic_get(TOPIC_INFO_ALL), payload);
 }
 
 /**
@@ -171,26 +439,17 @@ void mqtt_publish_all(int32_t weight, struct tm timestamp, bool button_state, bo
  *
  * Constructs a JSON payload with the water state and publishes it.
  *
+ * @param cls Priority class of the message.
  * @param water_state The current state of the water as an integer.
  */
-void mqtt_publish_water_state(int water_state)
+void mqtt_publish_water_state(publish_class_t cls, int water_state)
 {
-    if (mqtt_client == NULL) {
-        ESP_LOGE(TAG, "MQTT client not initialized");
-        return;
-    }
-
-    char topic[50];
     char payload[50];
 
-    // Topic: hydrapet0001/hydrapetinfo/water
-    snprintf(topic, sizeof(topic), "hydrapet0001/hydrapetinfo/water");
-
     // Create JSON payload with water state
     snprintf(payload, sizeof(payload), "{\"water_state\": %d}", water_state);
 
-    esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 0);
-    ESP_LOGI(TAG, "MQTT publish: %s -> %s", topic, payload);
+    mqtt_publish(cls, topic_get(TOPIC_INFO_WATER), payload);
 }
 
 /**
@@ -198,36 +457,27 @@ void mqtt_publish_water_state(int water_state)
  *
  * Constructs a JSON payload with the current time and publishes it.
  *
- * @param timestamp The current timestamp.
+ * @param cls Priority class of the message.
+ * @param timestamp_us Monotonic timestamp of the current time, see `timebase_now_us()`.
  */
-void mqtt_publish_current_time(struct tm timestamp)
+void mqtt_publish_current_time(publish_class_t cls, int64_t timestamp_us)
 {
-    if (mqtt_client == NULL) {
-        ESP_LOGE(TAG, "MQTT client not initialized");
-        return;
-    }
-
-    char topic[50];
     char payload[100];
-
-    // Topic: hydrapet0001/hydrapetinfo/time
-    snprintf(topic, sizeof(topic), "hydrapet0001/hydrapetinfo/time");
+    char timestamp[TIME_FORMAT_ISO_SIZE];
+    time_format_iso(timebase_to_wall_us(timestamp_us) / 1000000LL, timestamp);
 
     // Create JSON payload with current time
-    snprintf(payload, sizeof(payload), "{\"current_time\": \"%04d-%02d-%02dT%02d:%02d:%02d\"}",
-             timestamp.tm_year + 1900, timestamp.tm_mon + 1, timestamp.tm_mday,
-             timestamp.tm_hour, timestamp.tm_min, timestamp.tm_sec);
+    snprintf(payload, sizeof(payload), "{\"current_time\": \"%s\"}", timestamp);
 
-    esp_mqtt_client_publish(mqtt_client, topic, payload, 0, 1, 0);
-    ESP_LOGI(TAG, "MQTT publish: %s -> %s", topic, payload);
+    mqtt_publish(cls, topic_get(TOPIC_INFO_TIME), payload);
 }
 
 /**
  * @brief Sets the callback function to handle incoming MQTT messages.
  *
- * @param callback The callback function that takes the topic and message as parameters.
+ * @param callback The callback function receiving views of the topic and message.
  */
-void mqtt_set_message_callback(void (*callback)(const char *, const char *))
+void mqtt_set_message_callback(mqtt_callback_t callback)
 {
     global_mqtt_callback = callback;
     ESP_LOGI(TAG, "MQTT message callback set.");
@@ -246,285 +496,1065 @@ bool get_pin15_state(void) {
 }
 
 /**
- * @brief Sets the system time based on a provided string.
+ * @brief Parses a time string into the system time to set.
  *
- * Parses a time string in the format "YYYY-MM-DDTHH:MM:SS" and sets the system time.
+ * Parses a time string in the format "YYYY-MM-DDTHH:MM:SS" as local time.
  *
- * @param time_str The time string to parse and set.
- * @return `ESP_OK` on success, `ESP_ERR_INVALID_ARG` on parsing errors, or `ESP_FAIL` on system call failures.
+ * @param time_str The time string to parse, not necessarily NUL-terminated.
+ * @param len Length of the time string.
+ * @param epoch_time Pointer where the time in seconds since the epoch is stored.
+ * @return `true` on success, `false` on parsing errors.
  */
-static esp_err_t set_system_time(const char *time_str) {
+static bool parse_system_time(const char *time_str, size_t len, time_t *epoch_time) {
     struct tm tm_time;
-    memset(&tm_time, 0, sizeof(struct tm));
 
     // Parse the string into a tm structure
     // Assumes format "YYYY-MM-DDTHH:MM:SS"
-    if (sscanf(time_str, "%d-%d-%dT%d:%d:%d",
-               &tm_time.tm_year,
-               &tm_time.tm_mon,
-               &tm_time.tm_mday,
-               &tm_time.tm_hour,
-               &tm_time.tm_min,
-               &tm_time.tm_sec) != 6) {
-        ESP_LOGE(TAG, "Invalid time format: %s", time_str);
-        return ESP_ERR_INVALID_ARG;
+    if (!time_parse_iso(time_str, len, &tm_time, NULL)) {
+        ESP_LOGE(TAG, "Invalid time format: %.*s", (int)len, time_str);
+        return false;
     }
 
-    // Adjust values
-    tm_time.tm_year -= 1900; // tm_year: years since 1900
-    tm_time.tm_mon -= 1;     // tm_mon: months since January [0-11]
-
     // Convert tm structure to epoch time
-    time_t epoch_time = mktime(&tm_time);
-    if (epoch_time == -1) {
+    *epoch_time = mktime(&tm_time);
+    if (*epoch_time == -1) {
         ESP_LOGE(TAG, "Error converting time");
-        return ESP_ERR_INVALID_ARG;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a decimal integer, skipping leading whitespace.
+ *
+ * @param p Pointer to the parse position, advanced past the number.
+ * @param end End of the input.
+ * @param value Pointer where the parsed value is stored.
+ * @return `true` if a number was parsed, `false` otherwise.
+ */
+static bool parse_number(const char **p, const char *end, int64_t *value) {
+    const char *s = *p;
+    while (s < end && (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')) {
+        s++;
+    }
+    bool negative = (s < end && *s == '-');
+    if (negative) {
+        s++;
+    }
+    const char *digits = s;
+    int64_t v = 0;
+    // 18 digits never overflow, longer numbers are out of range for all fields anyway
+    while (s < end && *s >= '0' && *s <= '9' && s - digits < 18) {
+        v = v * 10 + (*s - '0');
+        s++;
+    }
+    if (s == digits) {
+        return false;
+    }
+    *value = negative ? -v : v;
+    *p = s;
+    return true;
+}
+
+/**
+ * @brief Formats of command payloads.
+ */
+typedef enum {
+    PAYLOAD_TEXT,   /**< @brief Plain text, such as a timestamp or a number */
+    PAYLOAD_JSON,   /**< @brief JSON object, tokenized into `json_doc` */
+    PAYLOAD_CBOR,   /**< @brief CBOR map */
+} payload_format_t;
+
+/**
+ * @brief View of a command payload, or of one object inside it.
+ */
+typedef struct {
+    payload_format_t format;  /**< @brief Format of the payload */
+    const char *data;         /**< @brief Text, JSON document or CBOR map, not NUL-terminated */
+    size_t len;               /**< @brief Length of `data`; for a CBOR object, of the map alone */
+    int object;               /**< @brief Index of the JSON object in `json_doc` */
+} payload_t;
+
+/** @brief Token pool of the JSON payload being parsed, only used from the MQTT task */
+static json_token_t json_tokens[MQTT_JSON_MAX_TOKENS];
+
+/** @brief Tokens of the JSON payload being parsed, only used from the MQTT task */
+static json_doc_t json_doc;
+
+/**
+ * @brief Detects the format of a command payload and tokenizes JSON objects.
+ *
+ * CBOR maps start with a byte of major type 5 (0xA0-0xBF), which never starts a
+ * text message; payloads starting with '{' are JSON, all others plain text.
+ *
+ * @param payload Pointer where the view of the payload is stored.
+ * @param message The message, not necessarily NUL-terminated.
+ * @param len Length of the message.
+ * @return `true` on success, `false` if the payload is malformed JSON.
+ */
+static bool payload_open(payload_t *payload, const char *message, size_t len) {
+    payload->data = message;
+    payload->len = len;
+    payload->object = 0;
+
+    if (len > 0 && ((uint8_t)message[0] >> 5) == CBOR_TYPE_MAP) {
+        payload->format = PAYLOAD_CBOR;
+        return true;
+    }
+    size_t start = 0;
+    while (start < len && (message[start] == ' ' || message[start] == '\t' ||
+                           message[start] == '\r' || message[start] == '\n')) {
+        start++;
+    }
+    if (start == len || message[start] != '{') {
+        payload->format = PAYLOAD_TEXT;
+        return true;
+    }
+
+    payload->format = PAYLOAD_JSON;
+    int count = json_parse(&json_doc, message, len, json_tokens, MQTT_JSON_MAX_TOKENS);
+    if (count < 0) {
+        ESP_LOGE(TAG, "Invalid JSON payload: %s",
+                 (count == JSON_ERROR_NOMEM) ? "too many tokens" : "malformed");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Extracts an integer value of a top-level key from a JSON object or CBOR map.
+ *
+ * @param payload Pointer to the payload.
+ * @param key The key to look for.
+ * @param value Pointer where the parsed value is stored.
+ * @return `true` if the key was found with an integer value, `false` otherwise.
+ */
+static bool payload_get_number(const payload_t *payload, const char *key, int64_t *value) {
+    if (payload->format == PAYLOAD_CBOR) {
+        cbor_reader_t reader;
+        cbor_reader_init(&reader, payload->data, payload->len);
+        return cbor_map_find(&reader, key) && cbor_read_int(&reader, value);
     }
+    return payload->format == PAYLOAD_JSON && json_object_get_int(&json_doc, payload->object, key, value);
+}
 
-    // Set system time
-    struct timeval tv;
-    tv.tv_sec = epoch_time;
-    tv.tv_usec = 0;
-    if (settimeofday(&tv, NULL) != 0) {
-        ESP_LOGE(TAG, "Failed to set time: %s", strerror(errno));
-        return ESP_FAIL;
+/**
+ * @brief Extracts a string value of a top-level key from a JSON object or CBOR map.
+ *
+ * @param payload Pointer to the payload.
+ * @param key The key to look for.
+ * @param str Pointer where the start of the string is stored, not NUL-terminated.
+ * @param len Pointer where the length of the string is stored.
+ * @return `true` if the key was found with a string value, `false` otherwise.
+ */
+static bool payload_get_text(const payload_t *payload, const char *key, const char **str, size_t *len) {
+    if (payload->format == PAYLOAD_CBOR) {
+        cbor_reader_t reader;
+        cbor_item_t item;
+        cbor_reader_init(&reader, payload->data, payload->len);
+        if (!cbor_map_find(&reader, key) || !cbor_read(&reader, &item) || item.type != CBOR_TYPE_TEXT) {
+            return false;
+        }
+        *str = (const char *)item.data;
+        *len = item.value;
+        return true;
     }
+    return payload->format == PAYLOAD_JSON && json_object_get_string(&json_doc, payload->object, key, str, len);
+}
 
-    ESP_LOGI(TAG, "System time set to: %s", time_str);
-    return ESP_OK;
+/**
+ * @brief Extracts an `int` value of a top-level key from a JSON or CBOR payload.
+ *
+ * @param payload Pointer to the payload.
+ * @param key The key to look for.
+ * @param value Pointer where the parsed value is stored.
+ * @return `true` if the key was found and its value parsed, `false` otherwise.
+ */
+static bool payload_get_int(const payload_t *payload, const char *key, int *value) {
+    int64_t v;
+    if (!payload_get_number(payload, key, &v) || v < INT32_MIN || v > INT32_MAX) {
+        return false;
+    }
+    *value = (int)v;
+    return true;
 }
 
 /**
- * @brief Handles the "pourwater" MQTT message to initiate water filling.
+ * @brief Extracts an alarm ID of a top-level key from a JSON or CBOR payload.
  *
- * Parses the incoming message to extract the target weight and starts the water filling process.
+ * @param payload Pointer to the payload.
+ * @param key The key to look for.
+ * @param id Pointer where the parsed ID is stored.
+ * @return `true` if the key was found and its value parsed, `false` otherwise.
+ */
+static bool payload_get_id(const payload_t *payload, const char *key, uint32_t *id) {
+    int64_t v;
+    if (!payload_get_number(payload, key, &v) || v < 0 || v > UINT32_MAX) {
+        return false;
+    }
+    *id = (uint32_t)v;
+    return true;
+}
+
+/**
+ * @brief Checks whether a request ID can be echoed in a JSON response without escaping.
  *
- * @param message The received MQTT message containing the target weight.
+ * @param id The ID, not necessarily NUL-terminated.
+ * @param len Length of the ID.
+ * @return `true` if the ID only holds letters, digits and "-_.:", `false` otherwise.
  */
-static void handle_pourwater(const char *message) {
-    ESP_LOGI(TAG, "Handling pourwater with message: %s", message);
+static bool request_id_valid(const char *id, size_t len) {
+    if (len == 0 || len > COMMAND_ID_MAX_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = id[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              c == '-' || c == '_' || c == '.' || c == ':')) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    int target_weight = 0;
+/**
+ * @brief Extracts the request ID of a command from a JSON object or CBOR map.
+ *
+ * The ID is the top-level "id" key, a string of up to `COMMAND_ID_MAX_LEN`
+ * characters or a non-negative integer.
+ *
+ * @param payload Pointer to the payload.
+ * @param id Buffer of `COMMAND_ID_MAX_LEN + 1` characters where the ID is stored.
+ * @return `true` if a valid ID was found, `false` otherwise.
+ */
+static bool payload_get_request_id(const payload_t *payload, char *id) {
+    const char *value;
+    size_t value_len;
+    int64_t number;
 
-    // Check if the message starts with '{', suggesting JSON format
-    if (message[0] == '{') {
-        ESP_LOGI(TAG, "Parsing message as JSON.");
-
-        // Look for the key "target_weight"
-        const char *key = "\"target_weight\"";
-        char *key_ptr = strstr(message, key);
-        if (key_ptr != NULL) {
-            // Look for the colon after the key
-            char *colon_ptr = strstr(key_ptr, ":");
-            if (colon_ptr != NULL) {
-                // Parse the value after the colon
-                // Assumes the value is an integer
-                if (sscanf(colon_ptr, ":%d", &target_weight) == 1) {
-                    ESP_LOGI(TAG, "Parsed target_weight from JSON: %d g", target_weight);
-                } else {
-                    ESP_LOGE(TAG, "Failed to parse target_weight value from JSON.");
-                    return;
-                }
-            } else {
-                ESP_LOGE(TAG, "Colon not found after key target_weight.");
-                return;
+    if (payload->format == PAYLOAD_CBOR) {
+        cbor_reader_t reader;
+        cbor_item_t item;
+        cbor_reader_init(&reader, payload->data, payload->len);
+        if (!cbor_map_find(&reader, "id") || !cbor_read(&reader, &item)) {
+            return false;
+        }
+        if (item.type == CBOR_TYPE_UINT) {
+            snprintf(id, COMMAND_ID_MAX_LEN + 1, "%llu", (unsigned long long)item.value);
+            return true;
+        }
+        if (item.type != CBOR_TYPE_TEXT) {
+            return false;
+        }
+        value = (const char *)item.data;
+        value_len = item.value;
+    } else if (payload->format == PAYLOAD_JSON) {
+        int token = json_object_get(&json_doc, payload->object, "id");
+        if (json_get_int(&json_doc, token, &number) && number >= 0) {
+            snprintf(id, COMMAND_ID_MAX_LEN + 1, "%lld", (long long)number);
+            return true;
+        }
+        if (!json_get_string(&json_doc, token, &value, &value_len)) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+
+    if (!request_id_valid(value, value_len)) {
+        ESP_LOGW(TAG, "Ignoring invalid request ID");
+        return false;
+    }
+    memcpy(id, value, value_len);
+    id[value_len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Parses an alarm timestamp from a JSON or CBOR payload.
+ *
+ * The timestamp is a string of the form "YYYY-MM-DDTHH:MM:SS" in local time; CBOR
+ * messages may also give it as an integer number of seconds since the epoch.
+ *
+ * @param payload Pointer to the payload.
+ * @param timestamp Pointer where the local time is stored, with `tm_isdst` left to `mktime`.
+ * @return `true` if the timestamp was found and parsed, `false` otherwise.
+ */
+static bool payload_get_timestamp(const payload_t *payload, struct tm *timestamp) {
+    if (payload->format == PAYLOAD_CBOR) {
+        cbor_reader_t reader;
+        cbor_item_t item;
+        cbor_reader_init(&reader, payload->data, payload->len);
+        if (!cbor_map_find(&reader, "timestamp") || !cbor_read(&reader, &item)) {
+            return false;
+        }
+        if (item.type == CBOR_TYPE_TEXT) {
+            return time_parse_iso((const char *)item.data, item.value, timestamp, NULL);
+        }
+        time_t epoch_time = (time_t)item.value;
+        return item.type == CBOR_TYPE_UINT && localtime_r(&epoch_time, timestamp) != NULL;
+    }
+
+    const char *value;
+    size_t value_len;
+    return payload->format == PAYLOAD_JSON &&
+           json_object_get_string(&json_doc, payload->object, "timestamp", &value, &value_len) &&
+           time_parse_iso(value, value_len, timestamp, NULL);
+}
+
+/**
+ * @brief Parses an alarm from a JSON object or CBOR map.
+ *
+ * Expected format, recurrence fields being optional:
+ * {"timestamp": "YYYY-MM-DDTHH:MM:SS", "target_weight": 200, "repeat_days": 127, "repeat_interval": 3600}
+ *
+ * @param payload Pointer to the object.
+ * @param alarm Pointer where the parsed alarm is stored.
+ * @return `true` if the alarm was parsed, `false` if it is invalid.
+ */
+static bool parse_alarm(const payload_t *payload, Alarm_t *alarm) {
+    int target_weight = 200; // Default value
+    int repeat_days = 0;
+    int repeat_interval = 0;
+
+    if (!payload_get_timestamp(payload, &alarm->timestamp)) {
+        ESP_LOGE(TAG, "Invalid alarm time format");
+        return false;
+    }
+    payload_get_int(payload, "target_weight", &target_weight);
+    payload_get_int(payload, "repeat_days", &repeat_days);
+    payload_get_int(payload, "repeat_interval", &repeat_interval);
+    if (repeat_days < 0 || repeat_days > ALARM_REPEAT_EVERY_DAY || repeat_interval < 0) {
+        ESP_LOGE(TAG, "Invalid alarm recurrence: repeat_days=%d, repeat_interval=%d", repeat_days, repeat_interval);
+        return false;
+    }
+
+    alarm->target_weight = target_weight;
+    alarm->repeat_days = (uint8_t)repeat_days;
+    alarm->repeat_interval = (uint32_t)repeat_interval;
+    return true;
+}
+
+/**
+ * @brief Parses one alarm of a bulk "set/alarms" message into an operation.
+ *
+ * Alarms carrying an "alarm_id" are updated, the others added. An invalid alarm
+ * keeps its position as an `ALARM_OP_INVALID` operation so results line up with the request.
+ *
+ * @param object Pointer to the alarm object.
+ * @param op Pointer where the operation is stored.
+ */
+static void parse_set_op(const payload_t *object, alarm_op_t *op) {
+    memset(op, 0, sizeof(*op));
+    op->type = payload_get_id(object, "alarm_id", &op->id) ? ALARM_OP_UPDATE : ALARM_OP_ADD;
+    if (!parse_alarm(object, &op->alarm)) {
+        op->type = ALARM_OP_INVALID;
+        op->id = ALARM_ID_NONE;
+    }
+}
+
+/**
+ * @brief Checks that a bulk alarms message fits one batch of operations.
+ *
+ * Longer arrays are rejected as a whole rather than partly applied, so a client
+ * never takes a truncated sync for a complete one.
+ *
+ * @param key Key of the array, for the log.
+ * @param size Number of elements of the array.
+ * @return `true` if the array holds at most `ALARMS_BATCH_MAX` elements, `false` otherwise.
+ */
+static bool alarms_array_fits(const char *key, uint64_t size) {
+    if (size > ALARMS_BATCH_MAX) {
+        ESP_LOGE(TAG, "\"%s\" array of %llu entries exceeds %d", key, (unsigned long long)size, ALARMS_BATCH_MAX);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the "alarms" array of a JSON bulk "set/alarms" message.
+ *
+ * @param payload Pointer to the payload.
+ * @param ops Array of `ALARMS_BATCH_MAX` operations to fill.
+ * @param count Pointer where the number of operations is stored.
+ * @return `true` if the array was found with at most `ALARMS_BATCH_MAX` alarms, `false` otherwise.
+ */
+static bool parse_set_ops_json(const payload_t *payload, alarm_op_t *ops, size_t *count) {
+    int array = json_object_get(&json_doc, payload->object, "alarms");
+    if (array < 0 || json_doc.tokens[array].type != JSON_TYPE_ARRAY ||
+        !alarms_array_fits("alarms", json_doc.tokens[array].size)) {
+        return false;
+    }
+
+    // Elements that are not objects fail like invalid alarms
+    int element = array + 1;
+    for (uint16_t i = 0; i < json_doc.tokens[array].size; i++) {
+        payload_t object = { PAYLOAD_JSON, payload->data, payload->len, element };
+        parse_set_op(&object, &ops[(*count)++]);
+        element = json_next(&json_doc, element);
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the "alarms" array of a CBOR bulk "set/alarms" message.
+ *
+ * @param payload Pointer to the payload.
+ * @param ops Array of `ALARMS_BATCH_MAX` operations to fill.
+ * @param count Pointer where the number of operations is stored.
+ * @return `true` if the array was found with at most `ALARMS_BATCH_MAX` well-formed
+ *         alarms, `false` otherwise.
+ */
+static bool parse_set_ops_cbor(const payload_t *payload, alarm_op_t *ops, size_t *count) {
+    cbor_reader_t reader;
+    cbor_item_t array;
+    cbor_reader_init(&reader, payload->data, payload->len);
+    if (!cbor_map_find(&reader, "alarms") || !cbor_read(&reader, &array) || array.type != CBOR_TYPE_ARRAY ||
+        !alarms_array_fits("alarms", array.value)) {
+        return false;
+    }
+
+    // Each alarm map is parsed in place, its extent found by skipping it
+    for (uint64_t i = 0; i < array.value; i++) {
+        const char *map = (const char *)reader.ptr;
+        if (!cbor_skip(&reader)) {
+            return false;
+        }
+        payload_t object = { PAYLOAD_CBOR, map, (const char *)reader.ptr - map, 0 };
+        parse_set_op(&object, &ops[(*count)++]);
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a bulk "set/alarms" MQTT message.
+ *
+ * Expected format, JSON or the equivalent CBOR, up to `ALARMS_BATCH_MAX` alarms; alarms
+ * carrying an "alarm_id" are updated, the others added. Longer messages are rejected:
+ * {"alarms": [{"timestamp": "...", "target_weight": 200}, {"alarm_id": 17, "timestamp": "..."}]}
+ *
+ * @param payload Pointer to the received payload.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_set_alarms(const payload_t *payload, command_t *command) {
+    alarm_op_t *ops = malloc(ALARMS_BATCH_MAX * sizeof(alarm_op_t));
+    if (ops == NULL) {
+        ESP_LOGE(TAG, "No memory for alarm operations");
+        return false;
+    }
+    size_t count = 0;
+
+    bool found = (payload->format == PAYLOAD_CBOR) ? parse_set_ops_cbor(payload, ops, &count)
+               : (payload->format == PAYLOAD_JSON) && parse_set_ops_json(payload, ops, &count);
+    if (!found) {
+        ESP_LOGE(TAG, "Failed to parse \"alarms\" from message.");
+        free(ops);
+        return false;
+    }
+
+    command->type = COMMAND_ALARMS_BATCH;
+    command->args.alarms_batch.op = "set";
+    command->args.alarms_batch.ops = ops;
+    command->args.alarms_batch.count = count;
+    return true;
+}
+
+/**
+ * @brief Parses the "alarm_ids" array of a JSON bulk "del/alarms" message.
+ *
+ * @param payload Pointer to the payload.
+ * @param ops Array of `ALARMS_BATCH_MAX` operations to fill.
+ * @param count Pointer where the number of operations is stored.
+ * @return `true` if the array was found with at most `ALARMS_BATCH_MAX` IDs, `false` otherwise.
+ */
+static bool parse_del_ops_json(const payload_t *payload, alarm_op_t *ops, size_t *count) {
+    int array = json_object_get(&json_doc, payload->object, "alarm_ids");
+    if (array < 0 || json_doc.tokens[array].type != JSON_TYPE_ARRAY ||
+        !alarms_array_fits("alarm_ids", json_doc.tokens[array].size)) {
+        return false;
+    }
+
+    int element = array + 1;
+    for (uint16_t i = 0; i < json_doc.tokens[array].size; i++) {
+        int64_t id;
+        bool valid = json_get_int(&json_doc, element, &id) && id >= 0 && id <= UINT32_MAX;
+        ops[*count].type = valid ? ALARM_OP_DELETE : ALARM_OP_INVALID;
+        ops[*count].id = valid ? (uint32_t)id : ALARM_ID_NONE;
+        (*count)++;
+        element = json_next(&json_doc, element);
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the "alarm_ids" array of a CBOR bulk "del/alarms" message.
+ *
+ * @param payload Pointer to the payload.
+ * @param ops Array of `ALARMS_BATCH_MAX` operations to fill.
+ * @param count Pointer where the number of operations is stored.
+ * @return `true` if the array was found with at most `ALARMS_BATCH_MAX` well-formed
+ *         items, `false` otherwise.
+ */
+static bool parse_del_ops_cbor(const payload_t *payload, alarm_op_t *ops, size_t *count) {
+    cbor_reader_t reader;
+    cbor_item_t array;
+    cbor_reader_init(&reader, payload->data, payload->len);
+    if (!cbor_map_find(&reader, "alarm_ids") || !cbor_read(&reader, &array) || array.type != CBOR_TYPE_ARRAY ||
+        !alarms_array_fits("alarm_ids", array.value)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < array.value; i++) {
+        // Items that are not integers fail like invalid IDs
+        cbor_reader_t item = reader;
+        int64_t id = -1;
+        if (!cbor_read_int(&reader, &id)) {
+            reader = item;
+            if (!cbor_skip(&reader)) {
+                return false;
             }
-        } else {
-            ESP_LOGE(TAG, "Key \"target_weight\" not found in JSON message.");
-            return;
+        }
+        bool valid = (id >= 0 && id <= UINT32_MAX);
+        ops[*count].type = valid ? ALARM_OP_DELETE : ALARM_OP_INVALID;
+        ops[*count].id = valid ? (uint32_t)id : ALARM_ID_NONE;
+        (*count)++;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a bulk "del/alarms" MQTT message.
+ *
+ * Expected format, JSON or the equivalent CBOR, up to `ALARMS_BATCH_MAX` IDs, longer
+ * messages being rejected:
+ * {"alarm_ids": [17, 42]}
+ *
+ * @param payload Pointer to the received payload.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_del_alarms(const payload_t *payload, command_t *command) {
+    alarm_op_t *ops = malloc(ALARMS_BATCH_MAX * sizeof(alarm_op_t));
+    if (ops == NULL) {
+        ESP_LOGE(TAG, "No memory for alarm operations");
+        return false;
+    }
+    size_t count = 0;
+
+    bool found = (payload->format == PAYLOAD_CBOR) ? parse_del_ops_cbor(payload, ops, &count)
+               : (payload->format == PAYLOAD_JSON) && parse_del_ops_json(payload, ops, &count);
+    if (!found) {
+        ESP_LOGE(TAG, "Failed to parse \"alarm_ids\" from message.");
+        free(ops);
+        return false;
+    }
+
+    command->type = COMMAND_ALARMS_BATCH;
+    command->args.alarms_batch.op = "del";
+    command->args.alarms_batch.ops = ops;
+    command->args.alarms_batch.count = count;
+    return true;
+}
+
+/**
+ * @brief Parses a "pourwater" MQTT message to initiate water filling.
+ *
+ * The target weight is given either as JSON {"target_weight": 200}, the equivalent CBOR map
+ * or a plain integer.
+ *
+ * @param payload Pointer to the received payload containing the target weight.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_pourwater(const payload_t *payload, command_t *command) {
+    int target_weight = 0;
+
+    if (payload->format != PAYLOAD_TEXT) {
+        if (!payload_get_int(payload, "target_weight", &target_weight)) {
+            ESP_LOGE(TAG, "Failed to parse \"target_weight\" from message.");
+            return false;
         }
     } else {
-        ESP_LOGI(TAG, "Parsing message as integer.");
         // Parse the message as a simple integer
-        target_weight = atoi(message);
-        if (target_weight <= 0) {
-            ESP_LOGE(TAG, "Invalid target_weight value: %s", message);
-            return;
+        const char *ptr = payload->data;
+        int64_t value;
+        if (!parse_number(&ptr, payload->data + payload->len, &value) || value <= 0 || value > INT32_MAX) {
+            ESP_LOGE(TAG, "Invalid target_weight value: %.*s", (int)payload->len, payload->data);
+            return false;
         }
-        ESP_LOGI(TAG, "Parsed target_weight as int: %d g", target_weight);
+        target_weight = (int)value;
     }
 
     // Validate the target_weight
     if (target_weight <= 0) {
         ESP_LOGE(TAG, "Invalid target_weight after parsing: %d", target_weight);
-        return;
+        return false;
     }
 
-    // Initiate water filling
-    ESP_LOGI(TAG, "Starting water filling to weight: %d g", target_weight);
-    fill_water_to(target_weight);
+    command->type = COMMAND_POUR_WATER;
+    command->args.target_weight = target_weight;
+    return true;
 }
 
 /**
- * @brief Handles the "tare" MQTT message to perform tare calibration.
+ * @brief Parses a "set/water" MQTT message to fill water to a target weight.
  *
- * Executes the tare function and provides visual feedback via LEDs.
+ * @param payload Pointer to the received payload containing the target weight as an integer.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_set_water(const payload_t *payload, command_t *command) {
+    const char *ptr = payload->data;
+    int64_t target_weight;
+
+    if (!parse_number(&ptr, payload->data + payload->len, &target_weight) || target_weight <= 0 ||
+        target_weight > INT32_MAX) {
+        ESP_LOGE(TAG, "Invalid target_weight value: %.*s", (int)payload->len, payload->data);
+        return false;
+    }
+
+    command->type = COMMAND_POUR_WATER;
+    command->args.target_weight = (int32_t)target_weight;
+    return true;
+}
+
+/**
+ * @brief Parses a "set/time" MQTT message to set the system time.
  *
- * @param message The received MQTT message (content is not used in this handler).
+ * @param payload Pointer to the received payload, a timestamp "YYYY-MM-DDTHH:MM:SS",
+ *                or an object {"time": "YYYY-MM-DDTHH:MM:SS"} as in batches.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
  */
-static void handle_tare(const char *message) {
-    ESP_LOGI(TAG, "Handling tare with message: %s", message);
-    
-    led_blink_once();
-    
-    tare();
+static bool parse_set_time(const payload_t *payload, command_t *command) {
+    const char *time_str = payload->data;
+    size_t len = payload->len;
 
-    ESP_LOGI(TAG, "Tare function has been called.");
+    if (payload->format != PAYLOAD_TEXT && !payload_get_text(payload, "time", &time_str, &len)) {
+        ESP_LOGE(TAG, "Failed to parse \"time\" from message.");
+        return false;
+    }
+    command->type = COMMAND_SET_TIME;
+    return parse_system_time(time_str, len, &command->args.time);
 }
 
 /**
- * @brief Callback function to handle incoming MQTT messages.
+ * @brief Parses a "set/encoding" MQTT message selecting the telemetry encoding.
+ *
+ * @param payload Pointer to the received payload, "json" or "cbor".
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_set_encoding(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_SET_ENCODING;
+    if (payload->len == 4 && memcmp(payload->data, "json", 4) == 0) {
+        command->args.encoding = TELEMETRY_ENCODING_JSON;
+    } else if (payload->len == 4 && memcmp(payload->data, "cbor", 4) == 0) {
+        command->args.encoding = TELEMETRY_ENCODING_CBOR;
+    } else {
+        ESP_LOGE(TAG, "Unknown telemetry encoding: %.*s", (int)payload->len, payload->data);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Parses a "set/alarm" MQTT message to add or update one alarm.
  *
- * Determines the topic of the received message and invokes the appropriate handler.
+ * Expected format, recurrence being optional; an "alarm_id" replaces the existing
+ * alarm with that ID instead of adding one:
+ * {"timestamp": "YYYY-MM-DDTHH:MM:SS", "target_weight": 200, "repeat_days": 127, "repeat_interval": 3600}
  *
- * @param topic The MQTT topic of the received message.
- * @param message The MQTT message payload.
+ * @param payload Pointer to the received payload containing the alarm.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
  */
-void mqtt_message_handler(const char *topic, const char *message)
-{
-    ESP_LOGI(TAG, "Received message on topic: %s -> %s", topic, message);
+static bool parse_set_alarm(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_SET_ALARM;
+    command->args.set_alarm.id = ALARM_ID_NONE;
+    payload_get_id(payload, "alarm_id", &command->args.set_alarm.id);
+    return parse_alarm(payload, &command->args.set_alarm.alarm);
+}
 
-    // Handle different topics
-    if (strcmp(topic, "hydrapet0001/update/set/time") == 0) {
-        ESP_LOGI(TAG, "Setting time based on message: %s", message);
+/**
+ * @brief Parses a "get/alarms" MQTT message, optionally selecting one page:
+ * {"cursor": 0, "limit": 10}
+ *
+ * @param payload Pointer to the received payload.
+ * @param command Pointer where the command is stored.
+ * @return `true`, all fields being optional.
+ */
+static bool parse_get_alarms(const payload_t *payload, command_t *command) {
+    int64_t cursor;
 
-        esp_err_t err = set_system_time(message);
-        if (err == ESP_OK) {
-            ESP_LOGI(TAG, "Time has been successfully set.");
-        } else {
-            ESP_LOGE(TAG, "Failed to set time.");
-        }
+    command->type = COMMAND_GET_ALARMS;
+    command->args.get_alarms.cursor = -1;
+    command->args.get_alarms.limit = ALARMS_PAGE_SIZE;
+    // Cursors are alarm IDs; anything else streams all pages
+    if (payload_get_number(payload, "cursor", &cursor) && cursor >= 0 && cursor <= UINT32_MAX) {
+        command->args.get_alarms.cursor = cursor;
     }
-    else if (strcmp(topic, "hydrapet0001/update/get/time") == 0) {
-        // Example: Sending current time
-        ESP_LOGI(TAG, "Sending current time upon request");
-        // Get current time and send it
-        time_t now;
-        struct tm timeinfo;
-        time(&now);
-        localtime_r(&now, &timeinfo);
-        mqtt_publish_current_time(timeinfo);
-    }
-    else if (strcmp(topic, "hydrapet0001/update/set/water") == 0) {
-        // Example: Setting water state
-        ESP_LOGI(TAG, "Setting water state based on message: %s", message);
-        // You can update the water state here, e.g., by controlling a valve
-        // Convert message to int
-        int target_weight = (int )atoi(message);
-        
-        if (target_weight > 0) {
-            fill_water_to(target_weight);
-        } else {
-            ESP_LOGE(TAG, "Invalid target_weight value: %s", message);
-        }
+    payload_get_int(payload, "limit", &command->args.get_alarms.limit);
+    return true;
+}
+
+/**
+ * @brief Parses a "del/alarm" MQTT message identifying one alarm, by ID or by its
+ * next occurrence: {"alarm_id": 17} or {"timestamp": "YYYY-MM-DDTHH:MM:SS"}
+ *
+ * @param payload Pointer to the received payload.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_del_alarm(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_DEL_ALARM;
+    if (payload_get_id(payload, "alarm_id", &command->args.del_alarm.id)) {
+        return true;
     }
-    else if (strcmp(topic, "hydrapet0001/update/get/water") == 0) {
-        // Example: Sending current water state
-        ESP_LOGI(TAG, "Sending current water state upon request");
-        // Get current water state and send it
-        // Assuming water state is weight, adjust as needed
-        int water_state = get_water_weight(); // Adjust to actual function if different
-        mqtt_publish_water_state(water_state);
-    }
-    else if (strcmp(topic, "hydrapet0001/update/get/status") == 0) {
-        // Example: Sending device status
-        ESP_LOGI(TAG, "Sending device status upon request");
-        // Gather all device status information and send it
-        int32_t weight = get_water_weight();
-        time_t now;
-        struct tm current_time;
-        time(&now);
-        localtime_r(&now, &current_time);
-        bool button_state = user_button_state();
-        bool led_state = led_get_state(); // Assuming led_get_state() is available
-        bool pin15_state = get_pin15_state();
-
-        mqtt_publish_all(weight, current_time, button_state, led_state, pin15_state);
-    }
-    else if (strcmp(topic, "hydrapet0001/update/set/alarm") == 0) {
-        // Setting an alarm
-        ESP_LOGI(TAG, "Setting alarm based on message: %s", message);
-        
-        // Parse JSON
-        char timestamp_str[25];
-        int target_weight = 200; // Default value
-
-        // Assume message is in JSON format:
-        // {"timestamp": "YYYY-MM-DDTHH:MM:SS", "target_weight": 200}
-        sscanf(message, "{\"timestamp\": \"%24[^\"]\", \"target_weight\": %d}", timestamp_str, &target_weight);
-
-        // Parse timestamp_str into struct tm
-        struct tm alarm_time;
-        memset(&alarm_time, 0, sizeof(struct tm));
-        if (sscanf(timestamp_str, "%d-%d-%dT%d:%d:%d",
-                   &alarm_time.tm_year,
-                   &alarm_time.tm_mon,
-                   &alarm_time.tm_mday,
-                   &alarm_time.tm_hour,
-                   &alarm_time.tm_min,
-                   &alarm_time.tm_sec) != 6) {
-            ESP_LOGE(TAG, "Invalid alarm time format: %s", timestamp_str);
-            return;
-        }
+    command->args.del_alarm.id = ALARM_ID_NONE;
+    if (!payload_get_timestamp(payload, &command->args.del_alarm.timestamp)) {
+        ESP_LOGE(TAG, "Invalid alarm deletion time format: %.*s", (int)payload->len, payload->data);
+        return false;
+    }
+    return true;
+}
 
-        // Adjust values
-        alarm_time.tm_year -= 1900; // tm_year: years since 1900
-        alarm_time.tm_mon -= 1;     // tm_mon: months since January [0-11]
+/**
+ * @brief Parses a "set/tare" MQTT message to tare the scale.
+ *
+ * @param payload Pointer to the received payload (content is not used by this command).
+ * @param command Pointer where the command is stored.
+ * @return `true`.
+ */
+static bool parse_tare(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_TARE;
+    return true;
+}
 
-        // Add alarm
-        Alarm_t new_alarm;
-        new_alarm.timestamp = alarm_time;
-        new_alarm.target_weight = target_weight;
+/**
+ * @brief Parses a "get/time" MQTT message to publish the current time.
+ *
+ * @param payload Pointer to the received payload (content is not used by this command).
+ * @param command Pointer where the command is stored.
+ * @return `true`.
+ */
+static bool parse_get_time(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_GET_TIME;
+    return true;
+}
 
-        if (add_alarm(&new_alarm)) {
-            ESP_LOGI(TAG, "Alarm has been added.");
-        } else {
-            ESP_LOGE(TAG, "Failed to add alarm.");
-        }
+/**
+ * @brief Parses a "get/water" MQTT message to publish the current water state.
+ *
+ * @param payload Pointer to the received payload (content is not used by this command).
+ * @param command Pointer where the command is stored.
+ * @return `true`.
+ */
+static bool parse_get_water(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_GET_WATER;
+    return true;
+}
+
+/**
+ * @brief Parses a "get/status" MQTT message to publish the device status.
+ *
+ * @param payload Pointer to the received payload (content is not used by this command).
+ * @param command Pointer where the command is stored.
+ * @return `true`.
+ */
+static bool parse_get_status(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_GET_STATUS;
+    return true;
+}
+
+/**
+ * @brief Parses a "get/stats" MQTT message to publish the queue counters of the device.
+ *
+ * @param payload Pointer to the received payload (content is not used by this command).
+ * @param command Pointer where the command is stored.
+ * @return `true`.
+ */
+static bool parse_get_stats(const payload_t *payload, command_t *command) {
+    command->type = COMMAND_GET_STATS;
+    return true;
+}
+
+/**
+ * @brief Route of a command topic to the parser of its payload.
+ */
+typedef struct {
+    const char *suffix; /**< @brief Topic after `TOPIC_UPDATE_PREFIX`, e.g. "set/time" */
+    bool (*parse)(const payload_t *payload, command_t *command); /**< @brief Parser of the message payload */
+    bool batchable;     /**< @brief Whether the command may be part of a "batch" message */
+} mqtt_route_t;
+
+static bool parse_batch(const payload_t *payload, command_t *command);
+
+/**
+ * @brief Command routes, sorted by `suffix` in `strcmp` order for binary search.
+ *
+ * Adding a command takes one entry here, at its sorted position.
+ */
+static const mqtt_route_t mqtt_routes[] = {
+    { "batch",         parse_batch,        false },
+    { "del/alarm",     parse_del_alarm,    true },
+    { "del/alarms",    parse_del_alarms,   false },
+    { "get/alarms",    parse_get_alarms,   false },
+    { "get/stats",     parse_get_stats,    false },
+    { "get/status",    parse_get_status,   false },
+    { "get/time",      parse_get_time,     false },
+    { "get/water",     parse_get_water,    false },
+    { "put/pourwater", parse_pourwater,    true },
+    { "set/alarm",     parse_set_alarm,    true },
+    { "set/alarms",    parse_set_alarms,   false },
+    { "set/encoding",  parse_set_encoding, false },
+    { "set/tare",      parse_tare,         true },
+    { "set/time",      parse_set_time,     true },
+    { "set/water",     parse_set_water,    false },
+};
+
+/** @brief Number of entries in `mqtt_routes` */
+#define MQTT_ROUTES_COUNT (sizeof(mqtt_routes) / sizeof(mqtt_routes[0]))
+
+/**
+ * @brief Topic suffix looked up in the route table, not NUL-terminated.
+ */
+typedef struct {
+    const char *suffix; /**< @brief Start of the suffix */
+    size_t len;         /**< @brief Length of the suffix */
+} mqtt_route_key_t;
+
+/**
+ * @brief Compares a topic suffix with a route, for `bsearch`.
+ *
+ * @param key Pointer to the `mqtt_route_key_t` of the topic suffix.
+ * @param elem Pointer to the route.
+ * @return Negative, zero or positive as the suffix sorts before, equal to or after the route suffix.
+ */
+static int compare_route(const void *key, const void *elem) {
+    const mqtt_route_key_t *route_key = key;
+    const char *suffix = ((const mqtt_route_t *)elem)->suffix;
+    int cmp = strncmp(route_key->suffix, suffix, route_key->len);
+    if (cmp != 0) {
+        return cmp;
     }
-    else if (strcmp(topic, "hydrapet0001/update/get/alarms") == 0) {
-        // Retrieving list of alarms
-        ESP_LOGI(TAG, "Retrieving list of alarms upon request.");
-        get_alarms();
-    }
-    else if (strcmp(topic, "hydrapet0001/update/del/alarm") == 0) {
-        // Deleting an alarm
-        ESP_LOGI(TAG, "Deleting alarm based on message: %s", message);
-        
-        // Parse JSON
-        char timestamp_str[25];
-        sscanf(message, "{\"timestamp\": \"%24[^\"]\"}", timestamp_str);
-
-        // Parse timestamp_str into struct tm
-        struct tm del_alarm_time;
-        memset(&del_alarm_time, 0, sizeof(struct tm));
-        if (sscanf(timestamp_str, "%d-%d-%dT%d:%d:%d",
-                   &del_alarm_time.tm_year,
-                   &del_alarm_time.tm_mon,
-                   &del_alarm_time.tm_mday,
-                   &del_alarm_time.tm_hour,
-                   &del_alarm_time.tm_min,
-                   &del_alarm_time.tm_sec) != 6) {
-            ESP_LOGE(TAG, "Invalid alarm deletion time format: %s", timestamp_str);
-            return;
+    // Equal up to the end of one of them: the shorter one sorts first
+    size_t suffix_len = strlen(suffix);
+    if (suffix_len == route_key->len) {
+        return 0;
+    }
+    return (suffix_len > route_key->len) ? -1 : 1;
+}
+
+/**
+ * @brief Checks that `mqtt_routes` is sorted, as required by `bsearch`.
+ *
+ * @return `true` if the routes are sorted, `false` otherwise.
+ */
+static bool mqtt_routes_sorted(void) {
+    for (size_t i = 1; i < MQTT_ROUTES_COUNT; i++) {
+        if (strcmp(mqtt_routes[i - 1].suffix, mqtt_routes[i].suffix) >= 0) {
+            ESP_LOGE(TAG, "MQTT route \"%s\" out of order", mqtt_routes[i].suffix);
+            return false;
         }
-        // Adjust values
-        del_alarm_time.tm_year -= 1900; // tm_year: years since 1900
-        del_alarm_time.tm_mon -= 1;     // tm_mon: months since January [0-11]
+    }
+    return true;
+}
 
-        // Delete alarm
-        if (delete_alarm(&del_alarm_time)) {
-            ESP_LOGI(TAG, "Alarm has been deleted.");
+/**
+ * @brief Looks up the route of a topic suffix.
+ *
+ * @param suffix Topic after `TOPIC_UPDATE_PREFIX`, not NUL-terminated.
+ * @param len Length of the suffix.
+ * @return Pointer to the route, or NULL if there is none.
+ */
+static const mqtt_route_t *find_route(const char *suffix, size_t len) {
+    mqtt_route_key_t key = { suffix, len };
+    return bsearch(&key, mqtt_routes, MQTT_ROUTES_COUNT, sizeof(mqtt_route_t), compare_route);
+}
+
+/**
+ * @brief Parses one command of a "batch" message and appends it to the batch.
+ *
+ * One alarm set, or deleted by ID, becomes an alarm operation so that
+ * consecutive ones are applied together.
+ *
+ * @param object Pointer to the command object, naming its command topic in "cmd".
+ * @param batch Pointer to the batch.
+ * @return `true` if the command was appended, `false` if it is invalid or not allowed in batches.
+ */
+static bool parse_batch_step(const payload_t *object, command_batch_t *batch) {
+    const char *name;
+    size_t name_len;
+    if (!payload_get_text(object, "cmd", &name, &name_len)) {
+        ESP_LOGE(TAG, "Batch command %u without \"cmd\"", (unsigned)batch->count);
+        return false;
+    }
+    const mqtt_route_t *route = find_route(name, name_len);
+    if (route == NULL || !route->batchable) {
+        ESP_LOGE(TAG, "Command not allowed in batches: %.*s", (int)name_len, name);
+        return false;
+    }
+
+    command_t command;
+    memset(&command, 0, sizeof(command));
+    if (!route->parse(object, &command)) {
+        return false;
+    }
+
+    command_step_t *step = &batch->steps[batch->count++];
+    bool alarm_op = (command.type == COMMAND_SET_ALARM) ||
+                    (command.type == COMMAND_DEL_ALARM && command.args.del_alarm.id != ALARM_ID_NONE);
+    if (!alarm_op) {
+        step->type = command.type;
+        step->args = command.args;
+        return true;
+    }
+
+    alarm_op_t *op = &batch->ops[batch->op_count++];
+    memset(op, 0, sizeof(*op));
+    if (command.type == COMMAND_SET_ALARM) {
+        op->id = command.args.set_alarm.id;
+        op->type = (op->id != ALARM_ID_NONE) ? ALARM_OP_UPDATE : ALARM_OP_ADD;
+        op->alarm = command.args.set_alarm.alarm;
+    } else {
+        op->type = ALARM_OP_DELETE;
+        op->id = command.args.del_alarm.id;
+    }
+    step->type = COMMAND_ALARMS_BATCH;
+    step->args.alarms_batch.op = "batch";
+    step->args.alarms_batch.ops = op;
+    step->args.alarms_batch.count = 1;
+    return true;
+}
+
+/**
+ * @brief Parses a "batch" MQTT message carrying several commands.
+ *
+ * Expected format, JSON or the equivalent CBOR, up to `COMMANDS_BATCH_MAX` commands
+ * named by their topic after "update/" and taking the fields of their message:
+ * {"id": "sync-1", "commands": [{"cmd": "set/time", "time": "2025-01-27T07:59:00"},
+ *  {"cmd": "set/alarm", "timestamp": "2025-01-27T08:00:00", "target_weight": 150},
+ *  {"cmd": "del/alarm", "alarm_id": 17}, {"cmd": "set/tare"}, {"cmd": "put/pourwater", "target_weight": 200}]}
+ * The whole batch is rejected if any command is invalid.
+ *
+ * @param payload Pointer to the received payload.
+ * @param command Pointer where the command is stored.
+ * @return `true` if a command was parsed, `false` otherwise.
+ */
+static bool parse_batch(const payload_t *payload, command_t *command) {
+    cbor_reader_t reader;
+    cbor_item_t array;
+    int json_array = -1;
+    uint64_t count = 0;
+    bool found = false;
+
+    if (payload->format == PAYLOAD_CBOR) {
+        cbor_reader_init(&reader, payload->data, payload->len);
+        found = cbor_map_find(&reader, "commands") && cbor_read(&reader, &array) && array.type == CBOR_TYPE_ARRAY;
+        count = found ? array.value : 0;
+    } else if (payload->format == PAYLOAD_JSON) {
+        json_array = json_object_get(&json_doc, payload->object, "commands");
+        found = json_array >= 0 && json_doc.tokens[json_array].type == JSON_TYPE_ARRAY;
+        count = found ? json_doc.tokens[json_array].size : 0;
+    }
+    if (!found) {
+        ESP_LOGE(TAG, "Failed to parse \"commands\" from message.");
+        return false;
+    }
+    if (count > COMMANDS_BATCH_MAX) {
+        ESP_LOGE(TAG, "Batch of %llu commands exceeds %d", (unsigned long long)count, COMMANDS_BATCH_MAX);
+        return false;
+    }
+
+    command_batch_t *batch = calloc(1, sizeof(command_batch_t));
+    if (batch == NULL) {
+        ESP_LOGE(TAG, "No memory for batch");
+        return false;
+    }
+
+    int element = json_array + 1;
+    for (uint64_t i = 0; i < count; i++) {
+        payload_t object = { payload->format, payload->data, payload->len, element };
+        if (payload->format == PAYLOAD_CBOR) {
+            object.data = (const char *)reader.ptr;
+            if (!cbor_skip(&reader)) {
+                free(batch);
+                return false;
+            }
+            object.len = (const char *)reader.ptr - object.data;
         } else {
-            ESP_LOGE(TAG, "Failed to delete alarm.");
+            element = json_next(&json_doc, element);
+        }
+        if (!parse_batch_step(&object, batch)) {
+            ESP_LOGE(TAG, "Rejecting batch at command %u", (unsigned)i);
+            free(batch);
+            return false;
         }
     }
-    else if (strcmp(topic, "hydrapet0001/update/put/pourwater") == 0) {
-        // Handle pouring water based on received weight
-        handle_pourwater(message);
+
+    command->type = COMMAND_BATCH;
+    command->args.batch = batch;
+    return true;
+}
+
+/**
+ * @brief Callback function to handle incoming MQTT messages.
+ *
+ * Strips the command prefix from the topic, looks up the parser of the rest in the
+ * sorted route table and queues the parsed command for the commands worker, so the
+ * MQTT task never blocks on the commands themselves. Topic and message are views into the MQTT client or
+ * reassembly buffer and are not NUL-terminated.
+ *
+ * Requests carrying an "id", or with MQTT 5 a response topic, are answered
+ * through `commands_respond()`, here when they cannot be queued.
+ *
+ * @param topic The MQTT topic of the received message.
+ * @param topic_length Length of the topic.
+ * @param message The MQTT message payload.
+ * @param len Length of the payload.
+ */
+void mqtt_message_handler(const char *topic, size_t topic_length, const char *message, size_t len)
+{
+    ESP_LOGI(TAG, "Received message on topic: %.*s (%u bytes)", (int)topic_length, topic, (unsigned)len);
+
+    size_t prefix_len = topic_len(TOPIC_UPDATE_PREFIX);
+    if (topic_length < prefix_len || memcmp(topic, topic_get(TOPIC_UPDATE_PREFIX), prefix_len) != 0) {
+        ESP_LOGW(TAG, "Ignoring message on unexpected topic: %.*s", (int)topic_length, topic);
+        return;
+    }
+
+    command_t command;
+    memset(&command, 0, sizeof(command));
+    command_reply_t *reply = &command.reply;
+    reply->received_us = timebase_now_us();
+    // The payload is tokenized once here, parsers only look tokens up
+    payload_t payload;
+    bool valid = payload_open(&payload, message, len);
+    if (valid) {
+        payload_get_request_id(&payload, reply->id);
+    }
+#if CONFIG_MQTT_PROTOCOL_5
+    memcpy(reply->response_topic, request_property.response_topic, sizeof(reply->response_topic));
+    memcpy(reply->correlation, request_property.correlation, request_property.correlation_len);
+    reply->correlation_len = request_property.correlation_len;
+#endif
+
+    const mqtt_route_t *route = find_route(topic + prefix_len, topic_length - prefix_len);
+    if (route == NULL) {
+        ESP_LOGW(TAG, "No handler for topic: %.*s", (int)topic_length, topic);
+        commands_respond(reply, COMMAND_STATUS_UNKNOWN);
+        return;
+    }
+    reply->name = route->suffix;
+
+    // Only parse here, the worker task executes the command
+    if (!valid || !route->parse(&payload, &command)) {
+        commands_respond(reply, COMMAND_STATUS_INVALID);
+        return;
     }
-    else if (strcmp(topic, "hydrapet0001/update/set/tare") == 0) {
-        // Handle tare
-        handle_tare(message);
+    if (!commands_post(&command)) {
+        commands_respond(reply, COMMAND_STATUS_BUSY);
     }
 }
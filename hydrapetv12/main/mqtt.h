@@ -3,9 +3,10 @@
 #ifndef MQTT_H
 #define MQTT_H
 
-#include <stdint.h>   // For int32_t
-#include <time.h>     // For struct tm
+#include <stdint.h>   // For int32_t, int64_t
 #include <stdbool.h>  // For bool
+#include <stddef.h>   // For size_t
+#include "publisher.h"
 
 /**
  * @brief Initializes the MQTT client.
@@ -16,14 +17,69 @@
 void mqtt_init(void);
 
 /**
- * @brief Publishes a message to a specific MQTT topic.
+ * @brief Queues a text message for a specific MQTT topic.
  *
- * Sends the provided payload to the designated MQTT topic.
+ * The message is sent by the publisher task according to the priority, rate
+ * and QoS of its class, see `publisher.h`.
  *
+ * @param cls Priority class of the message.
  * @param topic The MQTT topic to publish to.
  * @param payload The message payload to publish.
  */
-void mqtt_publish(const char *topic, const char *payload);
+void mqtt_publish(publish_class_t cls, const char *topic, const char *payload);
+
+/**
+ * @brief Queues a binary message for a specific MQTT topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued for sending, `false` otherwise.
+ */
+bool mqtt_publish_data(publish_class_t cls, const char *topic, const void *data, size_t len);
+
+/**
+ * @brief Queues a message the broker retains, replacing the previous one of the topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued for sending, `false` otherwise.
+ */
+bool mqtt_publish_retained(publish_class_t cls, const char *topic, const void *data, size_t len);
+
+/**
+ * @brief Hands a message to the MQTT client.
+ *
+ * Only called by the publisher task; other modules use `mqtt_publish()`.
+ *
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @param qos MQTT QoS of the message.
+ * @param retain Whether the broker retains the message.
+ * @param correlation MQTT 5 correlation data, or NULL for none; ignored with MQTT 3.1.1.
+ * @param correlation_len Length of the correlation data.
+ * @return `true` if the client accepted the message, `false` otherwise.
+ */
+bool mqtt_send(const char *topic, const void *data, size_t len, int qos, bool retain,
+               const void *correlation, size_t correlation_len);
+
+/**
+ * @brief Checks whether the client is connected to the broker.
+ *
+ * @return `true` between the CONNECTED and DISCONNECTED events, `false` otherwise.
+ */
+bool mqtt_is_connected(void);
+
+/**
+ * @brief Returns the number of bytes of QoS 1 messages not yet acknowledged by the broker.
+ *
+ * @return Size of the outbox in bytes, 0 if the client is not initialized.
+ */
+size_t mqtt_outbox_size(void);
 
 /**
  * @brief Publishes all relevant data to a specific MQTT topic.
@@ -31,60 +87,70 @@ void mqtt_publish(const char *topic, const char *payload);
  * Constructs a JSON payload containing the current weight, timestamp,
  * button state, LED state, and motor state, then publishes it.
  *
+ * @param cls Priority class of the message.
  * @param weight The measured weight.
- * @param timestamp The timestamp of the measurement.
+ * @param timestamp_us Monotonic timestamp of the measurement, see `timebase_now_us()`.
  * @param button_state The state of the user button.
  * @param led_state The state of the LED.
  * @param pin15_state The state of pin 15 (motor).
  */
-void mqtt_publish_all(int32_t weight, struct tm timestamp, bool button_state, bool led_state, bool pin15_state);
+void mqtt_publish_all(publish_class_t cls, int32_t weight, int64_t timestamp_us, bool button_state, bool led_state,
+                      bool pin15_state);
 
 /**
  * @brief Publishes the current water state to a specific MQTT topic.
  *
  * Constructs a JSON payload with the water state and publishes it.
  *
+ * @param cls Priority class of the message.
  * @param water_state The current state of the water as an integer.
  */
-void mqtt_publish_water_state(int water_state);
+void mqtt_publish_water_state(publish_class_t cls, int water_state);
 
 /**
  * @brief Publishes the current system time to a specific MQTT topic.
  *
  * Constructs a JSON payload with the current time and publishes it.
  *
- * @param timestamp The current timestamp.
+ * @param cls Priority class of the message.
+ * @param timestamp_us Monotonic timestamp of the current time, see `timebase_now_us()`.
  */
-void mqtt_publish_current_time(struct tm timestamp);
+void mqtt_publish_current_time(publish_class_t cls, int64_t timestamp_us);
 
 /**
- * @brief Sets the callback function to handle incoming MQTT messages.
+ * @brief Type definition for the MQTT message callback function.
  *
- * Assigns a user-defined callback function that will be invoked upon receiving MQTT messages.
+ * The callback receives views of the topic and payload, which are not NUL-terminated
+ * and only valid during the call. Messages split over several fragments are
+ * reassembled before the callback is invoked.
  *
- * @param callback The callback function that takes the topic and message as parameters.
+ * @param topic The MQTT topic of the received message.
+ * @param topic_length Length of the topic.
+ * @param message The MQTT message payload.
+ * @param len Length of the payload.
  */
-void mqtt_set_message_callback(void (*callback)(const char *, const char *));
+typedef void (*mqtt_callback_t)(const char *topic, size_t topic_length, const char *message, size_t len);
 
 /**
- * @brief Type definition for the MQTT message callback function.
+ * @brief Sets the callback function to handle incoming MQTT messages.
  *
- * The callback function should accept two parameters: the topic and the message.
+ * Assigns a user-defined callback function that will be invoked upon receiving MQTT messages.
  *
- * @param topic The MQTT topic of the received message.
- * @param message The MQTT message payload.
+ * @param callback The callback function receiving views of the topic and message.
  */
-typedef void (*mqtt_callback_t)(const char *topic, const char *message);
+void mqtt_set_message_callback(mqtt_callback_t callback);
 
 /**
  * @brief Callback function to handle incoming MQTT messages.
  *
  * Determines the topic of the received message and invokes the appropriate handler.
  *
- * @param topic The MQTT topic of the received message.
- * @param message The MQTT message payload.
+ * @param topic The MQTT topic of the received message, not NUL-terminated.
+ * @param topic_length Length of the topic.
+ * @param message The MQTT message payload, not NUL-terminated.
+ * @param len Length of the payload.
  */
-void mqtt_message_handler(const char *topic, const char *message);
+void mqtt_message_handler(const char *topic, size_t topic_length, const char *message, size_t len);
 
 /**
  * @brief Initiates the process of filling water to a specified weight.
@@ -0,0 +1,346 @@
+// mqtt_tls.c
+
+#include "mqtt_tls.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_tls.h"
+#include "esp_crt_bundle.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/platform_util.h"
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+
+static const char *TAG = "MQTT TLS";
+
+/** @brief Default port of MQTT over TLS */
+#define MQTT_TLS_DEFAULT_PORT 8883
+
+/** @brief Size of a TLS 1.2 master secret */
+#define MQTT_TLS_MASTER_SIZE 48
+
+/** @brief Connection of the transport, or NULL while closed; only used from the MQTT task */
+static esp_tls_t *tls = NULL;
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+/** @brief Session of the last connection, offered on the next one, or NULL */
+static esp_tls_client_session_t *cached_session = NULL;
+
+/** @brief Master secret of `cached_session`, telling whether a connection resumed it */
+static uint8_t cached_master[MQTT_TLS_MASTER_SIZE];
+#endif
+
+/** @brief Handshake counters, guarded by `stats_lock` */
+static mqtt_tls_stats_t stats;
+
+/** @brief Total duration of the full handshakes, in milliseconds */
+static uint64_t full_total_ms = 0;
+
+/** @brief Total duration of the handshakes resuming the cached session, in milliseconds */
+static uint64_t resumed_total_ms = 0;
+
+/** @brief Spinlock guarding the counters, read from other tasks */
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Waits until the socket of the connection is readable or writable.
+ *
+ * @param write Whether to wait for room to write rather than data to read.
+ * @param timeout_ms Longest wait in milliseconds, negative to wait forever.
+ * @return 1 if ready, 0 on timeout, -1 on error.
+ */
+static int tls_poll(bool write, int timeout_ms)
+{
+    int sockfd;
+    if (tls == NULL || esp_tls_get_conn_sockfd(tls, &sockfd) != ESP_OK) {
+        return -1;
+    }
+
+    fd_set ready;
+    fd_set errors;
+    FD_ZERO(&ready);
+    FD_ZERO(&errors);
+    FD_SET(sockfd, &ready);
+    FD_SET(sockfd, &errors);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+
+    int ret = select(sockfd + 1, write ? NULL : &ready, write ? &ready : NULL, &errors,
+                     (timeout_ms >= 0) ? &timeout : NULL);
+    if (ret > 0 && FD_ISSET(sockfd, &errors)) {
+        ESP_LOGE(TAG, "Socket error on poll");
+        return -1;
+    }
+    return (ret > 0) ? 1 : ret;
+}
+
+/**
+ * @brief Waits for data to read, including data already decrypted by the TLS layer.
+ *
+ * @param t Transport handle (unused).
+ * @param timeout_ms Longest wait in milliseconds.
+ * @return 1 if data is available, 0 on timeout, -1 on error.
+ */
+static int tls_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    if (tls != NULL && esp_tls_get_bytes_avail(tls) > 0) {
+        return 1;
+    }
+    return tls_poll(false, timeout_ms);
+}
+
+/**
+ * @brief Waits for room to write.
+ *
+ * @param t Transport handle (unused).
+ * @param timeout_ms Longest wait in milliseconds.
+ * @return 1 if writable, 0 on timeout, -1 on error.
+ */
+static int tls_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    return tls_poll(true, timeout_ms);
+}
+
+/**
+ * @brief Records the duration of a successful handshake.
+ *
+ * @param offered Whether the cached session was offered.
+ * @param resumed Whether the broker resumed it.
+ * @param duration_ms Duration of the handshake in milliseconds.
+ */
+static void record_handshake(bool offered, bool resumed, uint32_t duration_ms)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    if (offered) {
+        stats.offered++;
+    }
+    if (resumed) {
+        stats.resumed++;
+        resumed_total_ms += duration_ms;
+    } else {
+        stats.full++;
+        full_total_ms += duration_ms;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+}
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+/**
+ * @brief Returns the current session of the connection.
+ *
+ * @return The session, or NULL if the connection does not use TLS 1.2.
+ */
+static const mbedtls_ssl_session *connection_session(void)
+{
+    const mbedtls_ssl_context *ssl = esp_tls_get_ssl_context(tls);
+    if (ssl == NULL || mbedtls_ssl_get_version_number(ssl) != MBEDTLS_SSL_VERSION_TLS1_2) {
+        return NULL;
+    }
+    return ssl->MBEDTLS_PRIVATE(session);
+}
+
+/**
+ * @brief Checks whether the connection just established resumed the cached session.
+ *
+ * mbedTLS does not report whether the broker accepted the offered ticket, and the
+ * session ID echoed on resumption is the one the client drew at random, not the ID
+ * of the cached session. A resumed TLS 1.2 session keeps the master secret of the
+ * session it resumes, a full handshake derives a new one.
+ *
+ * @return `true` if the session was resumed, `false` after a full handshake.
+ */
+static bool session_resumed(void)
+{
+    const mbedtls_ssl_session *session = connection_session();
+    return session != NULL &&
+           memcmp(session->MBEDTLS_PRIVATE(master), cached_master, sizeof(cached_master)) == 0;
+}
+
+/**
+ * @brief Drops the cached session, if any.
+ */
+static void forget_session(void)
+{
+    if (cached_session != NULL) {
+        esp_tls_free_client_session(cached_session);
+        cached_session = NULL;
+    }
+    mbedtls_platform_zeroize(cached_master, sizeof(cached_master));
+}
+#endif
+
+/**
+ * @brief Opens the TLS connection, offering the cached session if any.
+ *
+ * @param t Transport handle (unused).
+ * @param host Host name of the broker, also checked against its certificate.
+ * @param port Port of the broker.
+ * @param timeout_ms Longest duration of the connection and handshake in milliseconds.
+ * @return 0 on success, -1 on failure.
+ */
+static int tls_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms = timeout_ms,
+    };
+    bool offered = false;
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    cfg.client_session = cached_session;
+    offered = (cached_session != NULL);
+#endif
+
+    tls = esp_tls_init();
+    if (tls == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate the TLS connection");
+        return -1;
+    }
+
+    int64_t start_us = esp_timer_get_time();
+    if (esp_tls_conn_new_sync(host, strlen(host), port, &cfg, tls) <= 0) {
+        esp_tls_conn_destroy(tls);
+        tls = NULL;
+        taskENTER_CRITICAL(&stats_lock);
+        stats.failed++;
+        taskEXIT_CRITICAL(&stats_lock);
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        // Do not offer a session the broker may have choked on again
+        forget_session();
+#endif
+        ESP_LOGE(TAG, "TLS connection to %s:%d failed", host, port);
+        return -1;
+    }
+    uint32_t duration_ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    bool resumed = false;
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    resumed = offered && session_resumed();
+    // Keep the ticket of this connection for the next one
+    esp_tls_client_session_t *session = esp_tls_get_client_session(tls);
+    if (session != NULL) {
+        forget_session();
+        cached_session = session;
+        const mbedtls_ssl_session *current = connection_session();
+        if (current != NULL) {
+            memcpy(cached_master, current->MBEDTLS_PRIVATE(master), sizeof(cached_master));
+        }
+    }
+#endif
+    record_handshake(offered, resumed, duration_ms);
+
+    ESP_LOGI(TAG, "TLS connected to %s:%d in %lu ms (%s)", host, port, (unsigned long)duration_ms,
+             resumed ? "session resumed" : offered ? "session refused, full handshake" : "full handshake");
+    return 0;
+}
+
+/**
+ * @brief Reads decrypted data.
+ *
+ * @param t Transport handle.
+ * @param buffer Buffer receiving the data.
+ * @param len Size of the buffer.
+ * @param timeout_ms Longest wait for data in milliseconds.
+ * @return Number of bytes read, 0 on timeout, or a negative `ERR_TCP_TRANSPORT_*` error.
+ */
+static int tls_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    if (tls == NULL) {
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    if (esp_tls_get_bytes_avail(tls) <= 0) {
+        int ready = tls_poll_read(t, timeout_ms);
+        if (ready <= 0) {
+            return (ready == 0) ? ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT : ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+        }
+    }
+
+    ssize_t ret = esp_tls_conn_read(tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    if (ret == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (ret < 0) {
+        ESP_LOGE(TAG, "TLS read failed: -0x%x", (unsigned)-ret);
+        return ERR_TCP_TRANSPORT_CONNECTION_FAILED;
+    }
+    return (int)ret;
+}
+
+/**
+ * @brief Encrypts and writes data.
+ *
+ * @param t Transport handle.
+ * @param buffer Data to write.
+ * @param len Length of the data.
+ * @param timeout_ms Longest wait for room to write in milliseconds.
+ * @return Number of bytes written, 0 on timeout, or -1 on error.
+ */
+static int tls_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    int ready = tls_poll_write(t, timeout_ms);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    ssize_t ret = esp_tls_conn_write(tls, buffer, len);
+    if (ret == ESP_TLS_ERR_SSL_WANT_READ || ret == ESP_TLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    if (ret < 0) {
+        ESP_LOGE(TAG, "TLS write failed: -0x%x", (unsigned)-ret);
+        return -1;
+    }
+    return (int)ret;
+}
+
+/**
+ * @brief Closes the TLS connection, keeping the cached session.
+ *
+ * @param t Transport handle (unused).
+ * @return 0.
+ */
+static int tls_close(esp_transport_handle_t t)
+{
+    if (tls != NULL) {
+        esp_tls_conn_destroy(tls);
+        tls = NULL;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the TLS transport of the MQTT client for `mqtts://` brokers.
+ *
+ * @return The transport, or NULL if it could not be created.
+ */
+esp_transport_handle_t mqtt_tls_transport(void)
+{
+    esp_transport_handle_t transport = esp_transport_init();
+    if (transport == NULL) {
+        ESP_LOGE(TAG, "Failed to create the TLS transport");
+        return NULL;
+    }
+    esp_transport_set_default_port(transport, MQTT_TLS_DEFAULT_PORT);
+    esp_transport_set_func(transport, tls_connect, tls_read, tls_write, tls_close,
+                           tls_poll_read, tls_poll_write, tls_close);
+    return transport;
+}
+
+/**
+ * @brief Retrieves the handshake counters and average durations.
+ *
+ * @param stats_out Pointer where the counters are stored.
+ */
+void mqtt_tls_get_stats(mqtt_tls_stats_t *stats_out)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    *stats_out = stats;
+    stats_out->full_avg_ms = (stats.full > 0) ? (uint32_t)(full_total_ms / stats.full) : 0;
+    stats_out->resumed_avg_ms = (stats.resumed > 0) ? (uint32_t)(resumed_total_ms / stats.resumed) : 0;
+    taskEXIT_CRITICAL(&stats_lock);
+}
@@ -0,0 +1,41 @@
+// mqtt_tls.h
+
+#ifndef MAIN_MQTT_TLS_H_
+#define MAIN_MQTT_TLS_H_
+
+#include <stdint.h>   /**< @brief For uint32_t */
+#include "esp_transport.h"
+
+/**
+ * @brief Handshake counters of the TLS transport.
+ */
+typedef struct {
+    uint32_t full;              /**< @brief Full handshakes, the cached session refused or not offered */
+    uint32_t resumed;           /**< @brief Handshakes that resumed the cached session */
+    uint32_t offered;           /**< @brief Handshakes offering the cached session, resumed or not */
+    uint32_t failed;            /**< @brief Handshakes that failed */
+    uint32_t full_avg_ms;       /**< @brief Average duration of the full handshakes */
+    uint32_t resumed_avg_ms;    /**< @brief Average duration of the resumed handshakes */
+} mqtt_tls_stats_t;
+
+/**
+ * @brief Returns the TLS transport of the MQTT client for `mqtts://` brokers.
+ *
+ * The server certificate is verified against the ESP-IDF certificate bundle. With
+ * `CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS` enabled, the session ticket of the last
+ * connection is kept in RAM and offered on the next one, so a reconnect resumes the
+ * session instead of repeating the full handshake. Resumption is only recognised with
+ * TLS 1.2. The transport is owned by the MQTT client once passed in its configuration.
+ *
+ * @return The transport, or NULL if it could not be created.
+ */
+esp_transport_handle_t mqtt_tls_transport(void);
+
+/**
+ * @brief Retrieves the handshake counters and average durations.
+ *
+ * @param stats_out Pointer where the counters are stored.
+ */
+void mqtt_tls_get_stats(mqtt_tls_stats_t *stats_out);
+
+#endif /* MAIN_MQTT_TLS_H_ */
@@ -0,0 +1,288 @@
+// nvs_journal.c
+
+#include "nvs_journal.h"
+#include "nvs_flash.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "NVS JOURNAL";
+
+/** @brief NVS key of the journal header */
+#define HEADER_KEY "hdr"
+
+/** @brief Maximum size of a journal record */
+#define MAX_RECORD_SIZE 64
+
+/**
+ * @brief Journal header, written as a single blob.
+ */
+typedef struct {
+    uint8_t version;      /**< @brief Record format version */
+    uint32_t generation;  /**< @brief Generation of the current snapshot */
+    uint32_t chunks;      /**< @brief Number of chunks of the current snapshot */
+    uint32_t head;        /**< @brief Sequence number of the first record after the snapshot */
+} nvs_journal_header_t;
+
+/**
+ * @brief Builds the NVS key of a journal record.
+ *
+ * @param key Buffer receiving the key (at least 16 bytes).
+ * @param seq Sequence number of the record.
+ */
+static void record_key(char *key, uint32_t seq)
+{
+    snprintf(key, 16, "j%lu", (unsigned long)seq);
+}
+
+/**
+ * @brief Builds the NVS key of a snapshot chunk.
+ *
+ * Consecutive generations use alternating key sets so a new snapshot never
+ * overwrites the current one.
+ *
+ * @param key Buffer receiving the key (at least 16 bytes).
+ * @param generation Generation of the snapshot.
+ * @param index Index of the chunk.
+ */
+static void chunk_key(char *key, uint32_t generation, uint32_t index)
+{
+    snprintf(key, 16, "s%lu_%lu", (unsigned long)(generation & 1), (unsigned long)index);
+}
+
+/**
+ * @brief Writes the journal header.
+ *
+ * @param journal Pointer to the journal.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+static esp_err_t write_header(nvs_journal_t *journal)
+{
+    nvs_journal_header_t header = {
+        .version = journal->version,
+        .generation = journal->generation,
+        .chunks = journal->chunks,
+        .head = journal->head,
+    };
+    return nvs_set_blob(journal->handle, HEADER_KEY, &header, sizeof(header));
+}
+
+/**
+ * @brief Opens a journal stored in an NVS partition and namespace.
+ *
+ * @param journal Pointer to the journal to open.
+ * @param partition Label of the NVS partition.
+ * @param name_space NVS namespace holding the journal.
+ * @param version Record format version of the caller.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_open(nvs_journal_t *journal, const char *partition, const char *name_space, uint8_t version)
+{
+    esp_err_t err = nvs_flash_init_partition(partition);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
+        err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "Erasing NVS partition %s", partition);
+        nvs_flash_erase_partition(partition);
+        err = nvs_flash_init_partition(partition);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to init NVS partition %s: %s", partition, esp_err_to_name(err));
+        return err;
+    }
+
+    err = nvs_open_from_partition(partition, name_space, NVS_READWRITE, &journal->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace %s: %s", name_space, esp_err_to_name(err));
+        return err;
+    }
+
+    journal->version = version;
+    journal->generation = 0;
+    journal->chunks = 0;
+    journal->head = 0;
+    journal->tail = 0;
+
+    nvs_journal_header_t header;
+    size_t len = sizeof(header);
+    err = nvs_get_blob(journal->handle, HEADER_KEY, &header, &len);
+    if (err == ESP_OK && len == sizeof(header) && header.version == version) {
+        journal->generation = header.generation;
+        journal->chunks = header.chunks;
+        journal->head = header.head;
+        journal->tail = header.head;
+        return ESP_OK;
+    }
+
+    if (err != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Discarding incompatible journal in %s", name_space);
+        nvs_erase_all(journal->handle);
+    }
+    err = write_header(journal);
+    if (err == ESP_OK) {
+        err = nvs_commit(journal->handle);
+    }
+    return err;
+}
+
+/**
+ * @brief Replays the snapshot and all records appended after it.
+ *
+ * Records are read from the head sequence number until the first missing key,
+ * which also determines where the next record will be appended.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param snapshot_cb Callback receiving the snapshot parts.
+ * @param record_cb Callback receiving each record.
+ * @param ctx User context passed to the callbacks.
+ * @return `ESP_OK` on success, or an error code from the NVS API or a callback.
+ */
+esp_err_t nvs_journal_replay(nvs_journal_t *journal, nvs_journal_snapshot_cb_t snapshot_cb,
+                             nvs_journal_record_cb_t record_cb, void *ctx)
+{
+    char key[16];
+
+    uint8_t *chunk = malloc(NVS_JOURNAL_CHUNK_SIZE);
+    if (chunk == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint32_t i = 0; i < journal->chunks; i++) {
+        size_t len = NVS_JOURNAL_CHUNK_SIZE;
+        chunk_key(key, journal->generation, i);
+        esp_err_t err = nvs_get_blob(journal->handle, key, chunk, &len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Snapshot chunk %s unreadable: %s", key, esp_err_to_name(err));
+            free(chunk);
+            return err;
+        }
+        err = snapshot_cb(chunk, len, ctx);
+        if (err != ESP_OK) {
+            free(chunk);
+            return err;
+        }
+    }
+    free(chunk);
+
+    uint8_t record[MAX_RECORD_SIZE];
+    journal->tail = journal->head;
+    while (1) {
+        size_t len = sizeof(record);
+        record_key(key, journal->tail);
+        if (nvs_get_blob(journal->handle, key, record, &len) != ESP_OK) {
+            break;
+        }
+        esp_err_t err = record_cb(record, len, ctx);
+        if (err != ESP_OK) {
+            return err;
+        }
+        journal->tail++;
+    }
+
+    ESP_LOGI(TAG, "Replayed %lu snapshot chunks and %lu records",
+             (unsigned long)journal->chunks, (unsigned long)nvs_journal_length(journal));
+    return ESP_OK;
+}
+
+/**
+ * @brief Appends a record to the journal and commits it.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param record Pointer to the record.
+ * @param len Length of the record in bytes.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_append(nvs_journal_t *journal, const void *record, size_t len)
+{
+    if (len > MAX_RECORD_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    char key[16];
+    record_key(key, journal->tail);
+    esp_err_t err = nvs_set_blob(journal->handle, key, record, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(journal->handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to append record %s: %s", key, esp_err_to_name(err));
+        return err;
+    }
+    journal->tail++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Replaces the snapshot and drops all records appended so far.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param snapshot Pointer to the full state to store.
+ * @param len Length of the state in bytes.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_compact(nvs_journal_t *journal, const void *snapshot, size_t len)
+{
+    char key[16];
+    const uint8_t *data = snapshot;
+    uint32_t new_generation = journal->generation + 1;
+    uint32_t new_chunks = 0;
+    esp_err_t err = ESP_OK;
+
+    // Write the new snapshot next to the current one
+    for (size_t offset = 0; offset < len; offset += NVS_JOURNAL_CHUNK_SIZE) {
+        size_t chunk_len = len - offset;
+        if (chunk_len > NVS_JOURNAL_CHUNK_SIZE) {
+            chunk_len = NVS_JOURNAL_CHUNK_SIZE;
+        }
+        chunk_key(key, new_generation, new_chunks);
+        err = nvs_set_blob(journal->handle, key, data + offset, chunk_len);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write snapshot chunk %s: %s", key, esp_err_to_name(err));
+            return err;
+        }
+        new_chunks++;
+    }
+
+    // Switch to the new snapshot
+    uint32_t old_generation = journal->generation;
+    uint32_t old_chunks = journal->chunks;
+    uint32_t old_head = journal->head;
+    journal->generation = new_generation;
+    journal->chunks = new_chunks;
+    journal->head = journal->tail;
+    err = write_header(journal);
+    if (err == ESP_OK) {
+        err = nvs_commit(journal->handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to switch snapshot: %s", esp_err_to_name(err));
+        journal->generation = old_generation;
+        journal->chunks = old_chunks;
+        journal->head = old_head;
+        return err;
+    }
+
+    // Drop the previous snapshot and the folded records
+    for (uint32_t i = 0; i < old_chunks; i++) {
+        chunk_key(key, old_generation, i);
+        nvs_erase_key(journal->handle, key);
+    }
+    for (uint32_t seq = old_head; seq != journal->head; seq++) {
+        record_key(key, seq);
+        nvs_erase_key(journal->handle, key);
+    }
+    nvs_commit(journal->handle);
+
+    ESP_LOGI(TAG, "Compacted journal into %lu snapshot chunks (%u bytes)", (unsigned long)new_chunks, (unsigned)len);
+    return ESP_OK;
+}
+
+/**
+ * @brief Returns the number of records appended since the last compaction.
+ *
+ * @param journal Pointer to the opened journal.
+ * @return Number of records in the journal.
+ */
+uint32_t nvs_journal_length(const nvs_journal_t *journal)
+{
+    return journal->tail - journal->head;
+}
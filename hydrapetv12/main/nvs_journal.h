@@ -0,0 +1,110 @@
+// nvs_journal.h
+
+#ifndef MAIN_NVS_JOURNAL_H_
+#define MAIN_NVS_JOURNAL_H_
+
+#include <stdint.h>   /**< @brief For uint32_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include "esp_err.h"
+#include "nvs.h"
+
+/** @brief Maximum size of a single snapshot chunk stored as one NVS blob */
+#define NVS_JOURNAL_CHUNK_SIZE 1984
+
+/**
+ * @brief Append-only journal of records stored in an NVS namespace.
+ *
+ * The journal state is a snapshot (written in chunks by `nvs_journal_compact()`)
+ * followed by the records appended since. Each append costs a single small NVS
+ * write; compaction folds the records into a new snapshot.
+ */
+typedef struct {
+    nvs_handle_t handle;   /**< @brief Handle of the opened NVS namespace */
+    uint8_t version;       /**< @brief Record format version of the caller */
+    uint32_t generation;   /**< @brief Generation of the current snapshot */
+    uint32_t chunks;       /**< @brief Number of chunks of the current snapshot */
+    uint32_t head;         /**< @brief Sequence number of the first record after the snapshot */
+    uint32_t tail;         /**< @brief Sequence number of the next record to append */
+} nvs_journal_t;
+
+/**
+ * @brief Callback receiving consecutive parts of the snapshot during replay.
+ *
+ * @param data Pointer to the snapshot part.
+ * @param len Length of the part in bytes.
+ * @param ctx User context passed to `nvs_journal_replay()`.
+ * @return `ESP_OK` to go on, or an error code stopping the replay.
+ */
+typedef esp_err_t (*nvs_journal_snapshot_cb_t)(const void *data, size_t len, void *ctx);
+
+/**
+ * @brief Callback receiving each journal record during replay, in append order.
+ *
+ * @param record Pointer to the record.
+ * @param len Length of the record in bytes.
+ * @param ctx User context passed to `nvs_journal_replay()`.
+ * @return `ESP_OK` to go on, or an error code stopping the replay.
+ */
+typedef esp_err_t (*nvs_journal_record_cb_t)(const void *record, size_t len, void *ctx);
+
+/**
+ * @brief Opens a journal stored in an NVS partition and namespace.
+ *
+ * Initializes the NVS partition if needed. A journal written with a different
+ * record format version is erased.
+ *
+ * @param journal Pointer to the journal to open.
+ * @param partition Label of the NVS partition.
+ * @param name_space NVS namespace holding the journal.
+ * @param version Record format version of the caller.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_open(nvs_journal_t *journal, const char *partition, const char *name_space, uint8_t version);
+
+/**
+ * @brief Replays the snapshot and all records appended after it.
+ *
+ * Must be called once after `nvs_journal_open()` and before appending.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param snapshot_cb Callback receiving the snapshot parts.
+ * @param record_cb Callback receiving each record.
+ * @param ctx User context passed to the callbacks.
+ * @return `ESP_OK` on success, or an error code from the NVS API or a callback.
+ */
+esp_err_t nvs_journal_replay(nvs_journal_t *journal, nvs_journal_snapshot_cb_t snapshot_cb,
+                             nvs_journal_record_cb_t record_cb, void *ctx);
+
+/**
+ * @brief Appends a record to the journal and commits it.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param record Pointer to the record.
+ * @param len Length of the record in bytes.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_append(nvs_journal_t *journal, const void *record, size_t len);
+
+/**
+ * @brief Replaces the snapshot and drops all records appended so far.
+ *
+ * The new snapshot is written next to the previous one and becomes current
+ * with a single header write, so an interrupted compaction leaves the previous
+ * state intact.
+ *
+ * @param journal Pointer to the opened journal.
+ * @param snapshot Pointer to the full state to store.
+ * @param len Length of the state in bytes.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t nvs_journal_compact(nvs_journal_t *journal, const void *snapshot, size_t len);
+
+/**
+ * @brief Returns the number of records appended since the last compaction.
+ *
+ * @param journal Pointer to the opened journal.
+ * @return Number of records in the journal.
+ */
+uint32_t nvs_journal_length(const nvs_journal_t *journal);
+
+#endif /* MAIN_NVS_JOURNAL_H_ */
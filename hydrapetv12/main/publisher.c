@@ -0,0 +1,341 @@
+// publisher.c
+
+#include "publisher.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "mqtt.h"
+#include "connectivity.h"
+
+static const char *TAG = "PUBLISHER";
+
+/** @brief Token bucket credit of one message, in millionths of a message */
+#define TOKEN_COST 1000000LL
+
+/**
+ * @brief Settings of a priority class.
+ */
+typedef struct {
+    const char *name;     /**< @brief Name of the class in logs */
+    uint32_t depth;       /**< @brief Number of messages the queue holds */
+    int qos;              /**< @brief MQTT QoS of the messages */
+    uint32_t rate;        /**< @brief Sustained messages per second, 0 for no limit */
+    uint32_t burst;       /**< @brief Messages that can be sent at once after an idle period */
+} publish_class_config_t;
+
+/**
+ * @brief Settings of each class, indexed by `publish_class_t`.
+ *
+ * Alarms and responses are acknowledged by the broker. Telemetry and bulk exports
+ * are sent with QoS 0, a lost reading being superseded by the next one or the
+ * heartbeat, so they take no room in the outbox of the MQTT client.
+ */
+static const publish_class_config_t class_config[PUBLISH_CLASS_COUNT] = {
+    [PUBLISH_CLASS_ALARM]     = { "alarm",     8, 1,  0,  0 },
+    [PUBLISH_CLASS_RESPONSE]  = { "response",  8, 1, 10, 10 },
+    [PUBLISH_CLASS_TELEMETRY] = { "telemetry", 8, 0,  2,  5 },
+    [PUBLISH_CLASS_BULK]      = { "bulk",      8, 0,  5,  2 },
+};
+
+/**
+ * @brief Message waiting in a class queue, allocated with its topic and payload.
+ */
+typedef struct {
+    const char *topic;          /**< @brief Topic, stored after the payload */
+    size_t len;                 /**< @brief Length of the payload */
+    const void *correlation;    /**< @brief MQTT 5 correlation data, stored after the topic, or NULL */
+    size_t correlation_len;     /**< @brief Length of the correlation data */
+    bool retain;                /**< @brief Whether the broker retains the message */
+    uint8_t data[];             /**< @brief Payload, NUL-terminated topic and correlation data */
+} outbound_t;
+
+/**
+ * @brief State of a priority class.
+ */
+typedef struct {
+    QueueHandle_t queue;       /**< @brief Queue of `outbound_t` pointers */
+    int64_t tokens;            /**< @brief Credit of the token bucket, in `TOKEN_COST` per message */
+    int64_t refilled_us;       /**< @brief Time of the last refill */
+    publisher_stats_t stats;   /**< @brief Counters, guarded by `stats_lock` */
+} publish_class_state_t;
+
+/** @brief State of each class, indexed by `publish_class_t` */
+static publish_class_state_t classes[PUBLISH_CLASS_COUNT];
+
+/** @brief Spinlock guarding the counters, updated from all producer tasks */
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Handle of the publisher task, notified when a message is queued */
+static TaskHandle_t publisher_task_handle = NULL;
+
+/**
+ * @brief Adds the credit earned since the last refill to the bucket of a class.
+ *
+ * @param cls Priority class.
+ * @param now_us Current time in microseconds.
+ */
+static void refill(publish_class_t cls, int64_t now_us)
+{
+    publish_class_state_t *state = &classes[cls];
+    int64_t capacity = (int64_t)class_config[cls].burst * TOKEN_COST;
+
+    state->tokens += (now_us - state->refilled_us) * class_config[cls].rate;
+    if (state->tokens > capacity) {
+        state->tokens = capacity;
+    }
+    state->refilled_us = now_us;
+}
+
+/**
+ * @brief Sends the next message allowed by the priorities and rates.
+ *
+ * @param wait Pointer to the ticks until a waiting message of a rate-limited
+ *             class is allowed, lowered if this class is sooner.
+ * @return `true` if a message was sent, `false` if none can be sent now.
+ */
+static bool send_next(TickType_t *wait)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    for (int cls = 0; cls < PUBLISH_CLASS_COUNT; cls++) {
+        publish_class_state_t *state = &classes[cls];
+        if (uxQueueMessagesWaiting(state->queue) == 0) {
+            continue;
+        }
+        if (class_config[cls].rate > 0) {
+            refill(cls, now_us);
+            if (state->tokens < TOKEN_COST) {
+                int64_t wait_us = (TOKEN_COST - state->tokens) / class_config[cls].rate;
+                TickType_t ticks = pdMS_TO_TICKS(wait_us / 1000) + 1;
+                *wait = (ticks < *wait) ? ticks : *wait;
+                // Lower classes may still have credit
+                continue;
+            }
+        }
+
+        outbound_t *message;
+        if (xQueueReceive(state->queue, &message, 0) != pdTRUE) {
+            continue;
+        }
+        bool sent = mqtt_send(message->topic, message->data, message->len, class_config[cls].qos,
+                              message->retain, message->correlation, message->correlation_len);
+        free(message);
+        if (class_config[cls].rate > 0) {
+            state->tokens -= TOKEN_COST;
+        }
+
+        taskENTER_CRITICAL(&stats_lock);
+        if (sent) {
+            state->stats.sent++;
+        } else {
+            state->stats.failed++;
+        }
+        taskEXIT_CRITICAL(&stats_lock);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Task sending the queued messages of all classes in order of priority.
+ *
+ * Messages wait in their queues while the client is disconnected, so the
+ * queues rather than the MQTT outbox bound what is kept during an outage.
+ *
+ * @param pvParameters Pointer to task parameters (unused).
+ */
+static void publisher_task(void *pvParameters)
+{
+    while (1) {
+        // Sleep while the broker is unreachable
+        connectivity_wait(CONNECTIVITY_MQTT_CONNECTED, portMAX_DELAY);
+
+        TickType_t wait = portMAX_DELAY;
+        if (send_next(&wait)) {
+            continue;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+/**
+ * @brief Creates the queues of all classes and starts the publisher task.
+ */
+void publisher_init(void)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    for (int cls = 0; cls < PUBLISH_CLASS_COUNT; cls++) {
+        classes[cls].queue = xQueueCreate(class_config[cls].depth, sizeof(outbound_t *));
+        if (classes[cls].queue == NULL) {
+            ESP_LOGE(TAG, "Failed to create %s queue", class_config[cls].name);
+            return;
+        }
+        classes[cls].tokens = (int64_t)class_config[cls].burst * TOKEN_COST;
+        classes[cls].refilled_us = now_us;
+    }
+
+    xTaskCreate(publisher_task, "publisher_task", 3072, NULL, 6, &publisher_task_handle);
+    ESP_LOGI(TAG, "Publisher started.");
+}
+
+/**
+ * @brief Copies a message into the queue of its class.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @param correlation MQTT 5 correlation data, or NULL for none.
+ * @param correlation_len Length of the correlation data.
+ * @param retain Whether the broker retains the message.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+static bool enqueue(publish_class_t cls, const char *topic, const void *data, size_t len,
+                    const void *correlation, size_t correlation_len, bool retain)
+{
+    publish_class_state_t *state = &classes[cls];
+    if (state->queue == NULL) {
+        ESP_LOGE(TAG, "Publisher not initialized");
+        return false;
+    }
+
+    size_t topic_size = strlen(topic) + 1;
+    if (correlation == NULL) {
+        correlation_len = 0;
+    }
+    size_t size = len + topic_size + correlation_len;
+    outbound_t *message = malloc(sizeof(outbound_t) + size);
+    if (message == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate %u bytes for %s", (unsigned)size, topic);
+        return false;
+    }
+    memcpy(message->data, data, len);
+    memcpy(message->data + len, topic, topic_size);
+    message->topic = (const char *)message->data + len;
+    message->len = len;
+    message->retain = retain;
+    message->correlation = NULL;
+    message->correlation_len = correlation_len;
+    if (correlation_len > 0) {
+        memcpy(message->data + len + topic_size, correlation, correlation_len);
+        message->correlation = message->data + len + topic_size;
+    }
+
+    // Never wait: bulk producers pace themselves with `publisher_space()`
+    if (xQueueSend(state->queue, &message, 0) != pdTRUE) {
+        free(message);
+        taskENTER_CRITICAL(&stats_lock);
+        uint32_t dropped = ++state->stats.dropped;
+        taskEXIT_CRITICAL(&stats_lock);
+        ESP_LOGW(TAG, "%s queue full, dropped message to %s (%lu dropped)",
+                 class_config[cls].name, topic, (unsigned long)dropped);
+        return false;
+    }
+
+    uint32_t waiting = uxQueueMessagesWaiting(state->queue);
+    taskENTER_CRITICAL(&stats_lock);
+    state->stats.queued++;
+    if (waiting > state->stats.high_water) {
+        state->stats.high_water = waiting;
+    }
+    taskEXIT_CRITICAL(&stats_lock);
+
+    publisher_wake();
+    return true;
+}
+
+/**
+ * @brief Queues a message for the publisher task.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    return enqueue(cls, topic, data, len, NULL, 0, false);
+}
+
+/**
+ * @brief Queues a message answering an MQTT 5 request, with the correlation data of the request.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @param correlation Correlation data of the request, copied, or NULL for none.
+ * @param correlation_len Length of the correlation data.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send_correlated(publish_class_t cls, const char *topic, const void *data, size_t len,
+                               const void *correlation, size_t correlation_len)
+{
+    return enqueue(cls, topic, data, len, correlation, correlation_len, false);
+}
+
+/**
+ * @brief Queues a message the broker retains for new subscribers of its topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send_retained(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    return enqueue(cls, topic, data, len, NULL, 0, true);
+}
+
+/**
+ * @brief Returns the number of messages a class can queue without waiting or dropping.
+ *
+ * @param cls Priority class.
+ * @return Free places in the queue of the class.
+ */
+size_t publisher_space(publish_class_t cls)
+{
+    return (classes[cls].queue != NULL) ? uxQueueSpacesAvailable(classes[cls].queue) : 0;
+}
+
+/**
+ * @brief Wakes the publisher task, e.g. when a message was queued.
+ */
+void publisher_wake(void)
+{
+    if (publisher_task_handle != NULL) {
+        xTaskNotifyGive(publisher_task_handle);
+    }
+}
+
+/**
+ * @brief Retrieves the counters of a class.
+ *
+ * @param cls Priority class.
+ * @param stats_out Pointer where the counters are stored.
+ */
+void publisher_get_stats(publish_class_t cls, publisher_stats_t *stats_out)
+{
+    taskENTER_CRITICAL(&stats_lock);
+    *stats_out = classes[cls].stats;
+    taskEXIT_CRITICAL(&stats_lock);
+    stats_out->depth = (classes[cls].queue != NULL) ? uxQueueMessagesWaiting(classes[cls].queue) : 0;
+}
+
+/**
+ * @brief Returns the name of a class, as used in logs and statistics.
+ *
+ * @param cls Priority class.
+ * @return Name of the class, e.g. "telemetry".
+ */
+const char *publisher_class_name(publish_class_t cls)
+{
+    return class_config[cls].name;
+}
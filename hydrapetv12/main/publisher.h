@@ -0,0 +1,109 @@
+// publisher.h
+
+#ifndef MAIN_PUBLISHER_H_
+#define MAIN_PUBLISHER_H_
+
+#include <stdint.h>   /**< @brief For uint32_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include <stdbool.h>  /**< @brief For bool */
+
+/**
+ * @brief Priority classes of outgoing MQTT messages, highest priority first.
+ *
+ * A message is only sent when no message of a higher class is waiting and
+ * allowed by its rate, so a bulk export never delays an alarm.
+ */
+typedef enum {
+    PUBLISH_CLASS_ALARM,      /**< @brief Alarms and faults, such as the water tank running low */
+    PUBLISH_CLASS_RESPONSE,   /**< @brief Replies to commands */
+    PUBLISH_CLASS_TELEMETRY,  /**< @brief Periodic telemetry */
+    PUBLISH_CLASS_BULK,       /**< @brief Bulk exports, such as alarm lists and stored telemetry */
+    PUBLISH_CLASS_COUNT,      /**< @brief Number of classes */
+} publish_class_t;
+
+/**
+ * @brief Counters of one priority class.
+ */
+typedef struct {
+    uint32_t queued;      /**< @brief Number of messages queued */
+    uint32_t sent;        /**< @brief Number of messages handed to the MQTT client */
+    uint32_t dropped;     /**< @brief Number of messages dropped because the queue was full */
+    uint32_t failed;      /**< @brief Number of messages rejected by the MQTT client */
+    uint32_t depth;       /**< @brief Number of messages waiting */
+    uint32_t high_water;  /**< @brief Largest number of messages waiting at once */
+} publisher_stats_t;
+
+/**
+ * @brief Creates the queues of all classes and starts the publisher task.
+ */
+void publisher_init(void);
+
+/**
+ * @brief Queues a message for the publisher task.
+ *
+ * The topic and payload are copied. The call never waits: a message is dropped at
+ * once when the queue of its class is full, so bulk producers check `publisher_space()`.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send(publish_class_t cls, const char *topic, const void *data, size_t len);
+
+/**
+ * @brief Queues a message answering an MQTT 5 request, with the correlation data of the request.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @param correlation Correlation data of the request, copied, or NULL for none.
+ * @param correlation_len Length of the correlation data.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send_correlated(publish_class_t cls, const char *topic, const void *data, size_t len,
+                               const void *correlation, size_t correlation_len);
+
+/**
+ * @brief Queues a message the broker retains for new subscribers of its topic.
+ *
+ * @param cls Priority class of the message.
+ * @param topic The MQTT topic to publish to.
+ * @param data The message payload.
+ * @param len Length of the payload in bytes.
+ * @return `true` if the message was queued, `false` if it was dropped.
+ */
+bool publisher_send_retained(publish_class_t cls, const char *topic, const void *data, size_t len);
+
+/**
+ * @brief Returns the number of messages a class can queue without waiting or dropping.
+ *
+ * @param cls Priority class.
+ * @return Free places in the queue of the class.
+ */
+size_t publisher_space(publish_class_t cls);
+
+/**
+ * @brief Wakes the publisher task, e.g. when a message was queued.
+ */
+void publisher_wake(void);
+
+/**
+ * @brief Retrieves the counters of a class.
+ *
+ * @param cls Priority class.
+ * @param stats_out Pointer where the counters are stored.
+ */
+void publisher_get_stats(publish_class_t cls, publisher_stats_t *stats_out);
+
+/**
+ * @brief Returns the name of a class, as used in logs and statistics.
+ *
+ * @param cls Priority class.
+ * @return Name of the class, e.g. "telemetry".
+ */
+const char *publisher_class_name(publish_class_t cls);
+
+#endif /* MAIN_PUBLISHER_H_ */
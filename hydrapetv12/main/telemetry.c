@@ -0,0 +1,508 @@
+// telemetry.c
+
+#include "telemetry.h"
+#include "esp_log.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+#include "mqtt.h"
+#include "hx711.h"
+#include "led.h"
+#include "buttons.h"
+#include "motor.h"
+#include "water_level_sensor.h"
+#include "timebase.h"
+#include "time_format.h"
+#include "topics.h"
+#include "cbor.h"
+#include "telemetry_store.h"
+#include "config.h"
+
+static const char *TAG = "TELEMETRY";
+
+/** @brief NVS namespace holding the device settings */
+#define DEVICE_NAMESPACE "device"
+
+/** @brief NVS key of the telemetry encoding */
+#define ENCODING_KEY "encoding"
+
+/** @brief Encoding of telemetry messages */
+static telemetry_encoding_t encoding = TELEMETRY_ENCODING_JSON;
+
+/**
+ * @brief Loads the telemetry encoding of the device and opens the store of offline telemetry.
+ */
+void telemetry_init(void)
+{
+    nvs_handle_t handle;
+    uint8_t value = TELEMETRY_ENCODING_JSON;
+    if (nvs_open(DEVICE_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        nvs_get_u8(handle, ENCODING_KEY, &value);
+        nvs_close(handle);
+    }
+    encoding = (value == TELEMETRY_ENCODING_CBOR) ? TELEMETRY_ENCODING_CBOR : TELEMETRY_ENCODING_JSON;
+    ESP_LOGI(TAG, "Telemetry encoding: %s", (encoding == TELEMETRY_ENCODING_CBOR) ? "CBOR" : "JSON");
+
+    telemetry_store_init();
+}
+
+/**
+ * @brief Selects and persists the telemetry encoding of the device.
+ *
+ * @param new_encoding The encoding of the following telemetry messages.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t telemetry_set_encoding(telemetry_encoding_t new_encoding)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(DEVICE_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK) {
+        err = nvs_set_u8(handle, ENCODING_KEY, (uint8_t)new_encoding);
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store telemetry encoding: %s", esp_err_to_name(err));
+        return err;
+    }
+    encoding = new_encoding;
+    return ESP_OK;
+}
+
+/**
+ * @brief Reads all telemetry fields once.
+ *
+ * @param sample Pointer where the reading is stored.
+ */
+void telemetry_read(telemetry_sample_t *sample)
+{
+    sample->weight = get_water_weight();
+    sample->timestamp_us = timebase_now_us();
+    sample->button_pressed = user_button_state();
+    sample->led_on = led_get_state();
+    sample->motor_on = get_motor_state();
+    sample->tank_low = water_level_sensor_state();
+}
+
+/** @brief Last published value of each field, only used from the publish task */
+static telemetry_sample_t last_published;
+
+/** @brief Monotonic time of the last complete message, valid once `has_published` is set */
+static int64_t last_full_us = 0;
+
+/** @brief Whether a complete message has been published since boot */
+static bool has_published = false;
+
+/** @brief Whether the retained state snapshot lags behind `last_published` */
+static bool state_stale = true;
+
+/**
+ * @brief Publishes a reading to the legacy per-field topics.
+ *
+ * @param sample Pointer to the reading.
+ */
+static void publish_legacy(const telemetry_sample_t *sample)
+{
+    mqtt_publish_all(PUBLISH_CLASS_TELEMETRY, sample->weight, sample->timestamp_us, sample->button_pressed,
+                     sample->led_on, sample->motor_on);
+    mqtt_publish_water_state(PUBLISH_CLASS_TELEMETRY, sample->weight);
+    mqtt_publish_current_time(PUBLISH_CLASS_TELEMETRY, sample->timestamp_us);
+    mqtt_publish(PUBLISH_CLASS_TELEMETRY, topic_get(TOPIC_INFO_WATERTANKLEVEL),
+                 sample->tank_low ? "Below 30%" : "Water tank is full");
+}
+
+/**
+ * @brief Appends a boolean field to a telemetry message.
+ *
+ * @param payload Buffer of the message.
+ * @param size Size of the buffer.
+ * @param offset Length of the message so far.
+ * @param name Name of the field.
+ * @param value Value of the field.
+ * @return Length of the message with the field.
+ */
+static size_t append_bool(char *payload, size_t size, size_t offset, const char *name, bool value)
+{
+    int len = snprintf(payload + offset, size - offset, ", \"%s\": %s", name, value ? "true" : "false");
+    return offset + len;
+}
+
+/**
+ * @brief Encodes selected fields of a reading as a JSON telemetry message.
+ *
+ * @param payload Buffer of the message.
+ * @param size Size of the buffer.
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields to include.
+ * @param wall_us Wall-clock time of the reading in microseconds since the epoch.
+ * @return Length of the message, `size` or more if it did not fit the buffer.
+ */
+static size_t encode_json(char *payload, size_t size, const telemetry_sample_t *sample, uint32_t fields,
+                          int64_t wall_us)
+{
+    char timestamp[TIME_FORMAT_ISO_SIZE];
+    size_t offset;
+
+    // Every field below adds at most 20 bytes, so callers leave that much room
+    // and only the total needs checking
+    time_format_iso(wall_us / 1000000LL, timestamp);
+    offset = snprintf(payload, size, "{\"v\": %d, \"timestamp\": \"%s\"", TELEMETRY_VERSION, timestamp);
+    if (fields & TELEMETRY_FIELD_WEIGHT) {
+        offset += snprintf(payload + offset, size - offset, ", \"weight\": %ld", (long)sample->weight);
+    }
+    if (fields & TELEMETRY_FIELD_BUTTON) {
+        offset = append_bool(payload, size, offset, "button", sample->button_pressed);
+    }
+    if (fields & TELEMETRY_FIELD_LED) {
+        offset = append_bool(payload, size, offset, "led", sample->led_on);
+    }
+    if (fields & TELEMETRY_FIELD_MOTOR) {
+        offset = append_bool(payload, size, offset, "motor", sample->motor_on);
+    }
+    if (fields & TELEMETRY_FIELD_TANK_LOW) {
+        offset = append_bool(payload, size, offset, "tank_low", sample->tank_low);
+    }
+    offset += snprintf(payload + offset, size - offset, "}");
+    return offset;
+}
+
+/**
+ * @brief Encodes selected fields of a reading as a CBOR telemetry map.
+ *
+ * A complete message takes about 20 bytes against about 130 bytes of JSON, and is
+ * encoded without formatting the timestamp or any number as text.
+ *
+ * @param writer Pointer to the encoder, `overflow` is set if the map did not fit.
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields to include.
+ * @param wall_us Wall-clock time of the reading in microseconds since the epoch.
+ */
+static void encode_cbor(cbor_writer_t *writer, const telemetry_sample_t *sample, uint32_t fields, int64_t wall_us)
+{
+    cbor_put_map(writer, 2 + __builtin_popcount(fields));
+    cbor_put_uint(writer, TELEMETRY_KEY_VERSION);
+    cbor_put_uint(writer, TELEMETRY_VERSION);
+    cbor_put_uint(writer, TELEMETRY_KEY_TIMESTAMP);
+    cbor_put_int(writer, wall_us / 1000000LL);
+    if (fields & TELEMETRY_FIELD_WEIGHT) {
+        cbor_put_uint(writer, TELEMETRY_KEY_WEIGHT);
+        cbor_put_int(writer, sample->weight);
+    }
+    if (fields & TELEMETRY_FIELD_BUTTON) {
+        cbor_put_uint(writer, TELEMETRY_KEY_BUTTON);
+        cbor_put_bool(writer, sample->button_pressed);
+    }
+    if (fields & TELEMETRY_FIELD_LED) {
+        cbor_put_uint(writer, TELEMETRY_KEY_LED);
+        cbor_put_bool(writer, sample->led_on);
+    }
+    if (fields & TELEMETRY_FIELD_MOTOR) {
+        cbor_put_uint(writer, TELEMETRY_KEY_MOTOR);
+        cbor_put_bool(writer, sample->motor_on);
+    }
+    if (fields & TELEMETRY_FIELD_TANK_LOW) {
+        cbor_put_uint(writer, TELEMETRY_KEY_TANK_LOW);
+        cbor_put_bool(writer, sample->tank_low);
+    }
+}
+
+/**
+ * @brief Publishes selected fields of a reading as a JSON telemetry message.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields to include.
+ * @return `true` if the message was published, `false` if it did not fit its buffer.
+ */
+static bool publish_json(const telemetry_sample_t *sample, uint32_t fields)
+{
+    char payload[160];
+
+    size_t len = encode_json(payload, sizeof(payload), sample, fields, timebase_to_wall_us(sample->timestamp_us));
+    if (len >= sizeof(payload)) {
+        ESP_LOGE(TAG, "Telemetry message truncated");
+        return false;
+    }
+    mqtt_publish(PUBLISH_CLASS_TELEMETRY, topic_get(TOPIC_INFO_TELEMETRY), payload);
+    return true;
+}
+
+/**
+ * @brief Publishes selected fields of a reading as a CBOR telemetry message.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields to include.
+ * @return `true` if the message was published, `false` if it did not fit its buffer.
+ */
+static bool publish_cbor(const telemetry_sample_t *sample, uint32_t fields)
+{
+    uint8_t payload[48];
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, payload, sizeof(payload));
+    encode_cbor(&writer, sample, fields, timebase_to_wall_us(sample->timestamp_us));
+    if (writer.overflow) {
+        ESP_LOGE(TAG, "Telemetry message truncated");
+        return false;
+    }
+    mqtt_publish_data(PUBLISH_CLASS_TELEMETRY, topic_get(TOPIC_INFO_TELEMETRY_CBOR), payload, writer.len);
+    return true;
+}
+
+/**
+ * @brief Publishes selected fields of a reading in the encoding of the device.
+ *
+ * While the broker is unreachable, or older messages are still waiting to be
+ * flushed, the message is stored instead so messages keep their order.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields to include.
+ * @return `true` if the message was published or stored, `false` if it did not fit its buffer.
+ */
+static bool publish_fields(const telemetry_sample_t *sample, uint32_t fields)
+{
+    if (!mqtt_is_connected() || telemetry_store_count() > 0) {
+        telemetry_store_push(sample, fields);
+        return true;
+    }
+
+    bool published = (encoding == TELEMETRY_ENCODING_CBOR) ? publish_cbor(sample, fields)
+                                                           : publish_json(sample, fields);
+    if (published && TELEMETRY_LEGACY_TOPICS) {
+        publish_legacy(sample);
+    }
+    return published;
+}
+
+/**
+ * @brief Determines the fields of a reading that changed since they were last published.
+ *
+ * @param sample Pointer to the reading.
+ * @return Mask of the changed `telemetry_field_t` fields.
+ */
+static uint32_t changed_fields(const telemetry_sample_t *sample)
+{
+    uint32_t fields = 0;
+    int32_t weight_change = sample->weight - last_published.weight;
+
+    if (weight_change >= TELEMETRY_WEIGHT_DEADBAND_G || weight_change <= -TELEMETRY_WEIGHT_DEADBAND_G) {
+        fields |= TELEMETRY_FIELD_WEIGHT;
+    }
+    if (sample->button_pressed != last_published.button_pressed) {
+        fields |= TELEMETRY_FIELD_BUTTON;
+    }
+    if (sample->led_on != last_published.led_on) {
+        fields |= TELEMETRY_FIELD_LED;
+    }
+    if (sample->motor_on != last_published.motor_on) {
+        fields |= TELEMETRY_FIELD_MOTOR;
+    }
+    if (sample->tank_low != last_published.tank_low) {
+        fields |= TELEMETRY_FIELD_TANK_LOW;
+    }
+    return fields;
+}
+
+/**
+ * @brief Records the published fields of a reading as the new reference for changes.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the published `telemetry_field_t` fields.
+ */
+static void remember_fields(const telemetry_sample_t *sample, uint32_t fields)
+{
+    if (fields & TELEMETRY_FIELD_WEIGHT) {
+        last_published.weight = sample->weight;
+    }
+    if (fields & TELEMETRY_FIELD_BUTTON) {
+        last_published.button_pressed = sample->button_pressed;
+    }
+    if (fields & TELEMETRY_FIELD_LED) {
+        last_published.led_on = sample->led_on;
+    }
+    if (fields & TELEMETRY_FIELD_MOTOR) {
+        last_published.motor_on = sample->motor_on;
+    }
+    if (fields & TELEMETRY_FIELD_TANK_LOW) {
+        last_published.tank_low = sample->tank_low;
+    }
+    last_published.timestamp_us = sample->timestamp_us;
+    if (fields == TELEMETRY_FIELD_ALL) {
+        last_full_us = sample->timestamp_us;
+        has_published = true;
+    }
+}
+
+/**
+ * @brief Publishes the last published value of every field as the retained state snapshot.
+ *
+ * New subscribers receive the snapshot at once instead of waiting for the next
+ * heartbeat. It is only refreshed when a field changed, and while no stored
+ * telemetry is waiting, so it is never older than what was already delivered.
+ */
+static void publish_state(void)
+{
+    if (!state_stale || !has_published || !mqtt_is_connected() || telemetry_store_count() > 0) {
+        return;
+    }
+
+    int64_t wall_us = timebase_to_wall_us(last_published.timestamp_us);
+    bool sent;
+    if (encoding == TELEMETRY_ENCODING_CBOR) {
+        uint8_t payload[48];
+        cbor_writer_t writer;
+
+        cbor_writer_init(&writer, payload, sizeof(payload));
+        encode_cbor(&writer, &last_published, TELEMETRY_FIELD_ALL, wall_us);
+        sent = !writer.overflow && mqtt_publish_retained(PUBLISH_CLASS_TELEMETRY, topic_get(TOPIC_INFO_STATE),
+                                                         payload, writer.len);
+    } else {
+        char payload[160];
+
+        size_t len = encode_json(payload, sizeof(payload), &last_published, TELEMETRY_FIELD_ALL, wall_us);
+        sent = len < sizeof(payload) && mqtt_publish_retained(PUBLISH_CLASS_TELEMETRY, topic_get(TOPIC_INFO_STATE),
+                                                               payload, len);
+    }
+    state_stale = !sent;
+}
+
+/**
+ * @brief Publishes a reading as a single telemetry message.
+ *
+ * @param sample Pointer to the reading.
+ */
+void telemetry_publish(const telemetry_sample_t *sample)
+{
+    if (publish_fields(sample, TELEMETRY_FIELD_ALL)) {
+        remember_fields(sample, TELEMETRY_FIELD_ALL);
+        state_stale = true;
+        publish_state();
+    }
+}
+
+/**
+ * @brief Publishes the fields of a reading that changed since they were last published.
+ *
+ * @param sample Pointer to the reading.
+ * @return `true` if a message was published or stored, `false` if nothing changed.
+ */
+bool telemetry_report(const telemetry_sample_t *sample)
+{
+    uint32_t changed = has_published ? changed_fields(sample) : TELEMETRY_FIELD_ALL;
+    uint32_t fields = changed;
+
+    if (!has_published || sample->timestamp_us - last_full_us >= TELEMETRY_HEARTBEAT_S * 1000000LL) {
+        // Heartbeat, so subscribers see the device alive and resynchronise all fields
+        fields = TELEMETRY_FIELD_ALL;
+    }
+    if (fields == 0 || !publish_fields(sample, fields)) {
+        return false;
+    }
+    remember_fields(sample, fields);
+    state_stale |= (changed != 0);
+    publish_state();
+    return true;
+}
+
+/** @brief Messages of the batch being flushed, only used from the publish task */
+static telemetry_record_t batch_records[TELEMETRY_FLUSH_BATCH_SIZE];
+
+/** @brief Payload of the batch being flushed, only used from the publish task */
+static uint8_t batch_payload[TELEMETRY_FLUSH_BATCH_SIZE * 144];
+
+/**
+ * @brief Publishes stored messages as one batch message in the encoding of the device.
+ *
+ * A JSON batch is an array of telemetry messages, a CBOR batch an array of
+ * telemetry maps. Messages that do not fit the payload are left for the next batch.
+ *
+ * @param records Array of stored messages, oldest first.
+ * @param count Number of messages.
+ * @return Number of messages published, 0 on failure.
+ */
+static size_t publish_batch(const telemetry_record_t *records, size_t count)
+{
+    size_t len = 0;
+
+    if (encoding == TELEMETRY_ENCODING_CBOR) {
+        cbor_writer_t writer;
+        size_t fitted = 0;
+        // The head of an array of up to 23 items is one byte, patched once the items are known
+        cbor_writer_init(&writer, batch_payload, sizeof(batch_payload));
+        cbor_put_array(&writer, 0);
+        for (; fitted < count && fitted < 23; fitted++) {
+            size_t before = writer.len;
+            encode_cbor(&writer, &records[fitted].sample, records[fitted].fields, records[fitted].wall_us);
+            if (writer.overflow) {
+                writer.len = before;
+                break;
+            }
+        }
+        batch_payload[0] |= (uint8_t)fitted;
+        count = fitted;
+        len = writer.len;
+    } else {
+        char *payload = (char *)batch_payload;
+        size_t fitted = 0;
+        payload[len++] = '[';
+        for (; fitted < count; fitted++) {
+            const char *separator = (fitted > 0) ? ", " : "";
+            size_t separator_len = strlen(separator);
+            // Keep room for the separator and the closing bracket
+            size_t room = sizeof(batch_payload) - len - separator_len - 1;
+            size_t item = encode_json(payload + len + separator_len, room, &records[fitted].sample,
+                                      records[fitted].fields, records[fitted].wall_us);
+            if (item >= room) {
+                break;
+            }
+            memcpy(payload + len, separator, separator_len);
+            len += separator_len + item;
+        }
+        payload[len++] = ']';
+        count = fitted;
+    }
+
+    if (count == 0) {
+        ESP_LOGE(TAG, "Stored telemetry message does not fit a batch");
+        return 0;
+    }
+    topic_id_t topic = (encoding == TELEMETRY_ENCODING_CBOR) ? TOPIC_INFO_TELEMETRY_CBOR_BATCH
+                                                             : TOPIC_INFO_TELEMETRY_BATCH;
+    return mqtt_publish_data(PUBLISH_CLASS_BULK, topic_get(topic), batch_payload, len) ? count : 0;
+}
+
+/**
+ * @brief Publishes telemetry stored while the broker was unreachable.
+ *
+ * @return `true` if the store is empty, `false` if messages are still waiting.
+ */
+bool telemetry_flush(void)
+{
+    // The bulk class paces the batches; only queue what it takes without waiting
+    while (publisher_space(PUBLISH_CLASS_BULK) > 0) {
+        if (telemetry_store_count() == 0) {
+            // Catch the snapshot up with what was stored while offline
+            publish_state();
+            return true;
+        }
+        if (!mqtt_is_connected()) {
+            return false;
+        }
+        // Leave the broker time to acknowledge what was sent before sending more
+        size_t outbox = mqtt_outbox_size();
+        if (outbox > TELEMETRY_FLUSH_OUTBOX_MAX) {
+            ESP_LOGD(TAG, "Flush paused, %u bytes not acknowledged", (unsigned)outbox);
+            return false;
+        }
+
+        size_t count = telemetry_store_peek(batch_records, TELEMETRY_FLUSH_BATCH_SIZE);
+        size_t published = (count > 0) ? publish_batch(batch_records, count) : 0;
+        if (published == 0) {
+            return false;
+        }
+        telemetry_store_consume(published);
+        ESP_LOGI(TAG, "Flushed %u stored readings, %u waiting", (unsigned)published, (unsigned)telemetry_store_count());
+    }
+    return telemetry_store_count() == 0;
+}
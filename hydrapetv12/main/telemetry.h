@@ -0,0 +1,124 @@
+// telemetry.h
+
+#ifndef MAIN_TELEMETRY_H_
+#define MAIN_TELEMETRY_H_
+
+#include <stdint.h>   /**< @brief For int32_t, int64_t */
+#include <stdbool.h>  /**< @brief For bool */
+#include "esp_err.h"
+
+/** @brief Version of the telemetry message format, changed on incompatible changes */
+#define TELEMETRY_VERSION 1
+
+/** @brief Fields of a telemetry message, as bits of a field mask */
+typedef enum {
+    TELEMETRY_FIELD_WEIGHT   = 1 << 0, /**< @brief `weight` */
+    TELEMETRY_FIELD_BUTTON   = 1 << 1, /**< @brief `button_pressed` */
+    TELEMETRY_FIELD_LED      = 1 << 2, /**< @brief `led_on` */
+    TELEMETRY_FIELD_MOTOR    = 1 << 3, /**< @brief `motor_on` */
+    TELEMETRY_FIELD_TANK_LOW = 1 << 4, /**< @brief `tank_low` */
+    TELEMETRY_FIELD_ALL      = 0x1F,   /**< @brief All fields */
+} telemetry_field_t;
+
+/** @brief Encoding of telemetry messages */
+typedef enum {
+    TELEMETRY_ENCODING_JSON = 0, /**< @brief JSON on `<device_id>/hydrapetinfo/telemetry` */
+    TELEMETRY_ENCODING_CBOR = 1, /**< @brief CBOR on `<device_id>/hydrapetinfo/telemetry/cbor` */
+} telemetry_encoding_t;
+
+/**
+ * @brief Keys of the CBOR telemetry map.
+ *
+ * Small integers keep each key to a single byte; see `tools/cbor_decode.py`.
+ */
+typedef enum {
+    TELEMETRY_KEY_VERSION   = 0, /**< @brief `TELEMETRY_VERSION` */
+    TELEMETRY_KEY_TIMESTAMP = 1, /**< @brief Wall-clock time in seconds since the epoch (UTC) */
+    TELEMETRY_KEY_WEIGHT    = 2, /**< @brief Weight in grams */
+    TELEMETRY_KEY_BUTTON    = 3, /**< @brief Button pressed */
+    TELEMETRY_KEY_LED       = 4, /**< @brief LED on */
+    TELEMETRY_KEY_MOTOR     = 5, /**< @brief Motor on */
+    TELEMETRY_KEY_TANK_LOW  = 6, /**< @brief Tank level below 30% */
+} telemetry_key_t;
+
+/**
+ * @brief Structure representing one reading of all telemetry fields.
+ */
+typedef struct {
+    int64_t timestamp_us;  /**< @brief Monotonic time of the reading, see `timebase_now_us()` */
+    int32_t weight;        /**< @brief Measured weight in grams */
+    bool button_pressed;   /**< @brief State of the user button */
+    bool led_on;           /**< @brief State of the LED */
+    bool motor_on;         /**< @brief State of the motor */
+    bool tank_low;         /**< @brief Water tank level below 30% */
+} telemetry_sample_t;
+
+/**
+ * @brief Loads the telemetry encoding of the device and opens the store of offline telemetry.
+ *
+ * The encoding is read from the "encoding" key of the "device" NVS namespace and
+ * defaults to JSON. Must be called after NVS is initialized.
+ */
+void telemetry_init(void);
+
+/**
+ * @brief Selects and persists the telemetry encoding of the device.
+ *
+ * @param encoding The encoding of the following telemetry messages.
+ * @return `ESP_OK` on success, or an error code from the NVS API.
+ */
+esp_err_t telemetry_set_encoding(telemetry_encoding_t encoding);
+
+/**
+ * @brief Reads all telemetry fields once.
+ *
+ * @param sample Pointer where the reading is stored.
+ */
+void telemetry_read(telemetry_sample_t *sample);
+
+/**
+ * @brief Publishes a reading as a single telemetry message.
+ *
+ * The message is published to `<device_id>/hydrapetinfo/telemetry` as
+ * {"v": 1, "timestamp": "...", "weight": 200, "button": false, "led": true, "motor": false, "tank_low": false},
+ * or with `TELEMETRY_ENCODING_CBOR` to `<device_id>/hydrapetinfo/telemetry/cbor` as a
+ * map keyed by `telemetry_key_t`.
+ * With `TELEMETRY_LEGACY_TOPICS` set, the reading is also published to the
+ * `all`, `water`, `time` and `watertanklevel` topics.
+ *
+ * @param sample Pointer to the reading.
+ */
+void telemetry_publish(const telemetry_sample_t *sample);
+
+/**
+ * @brief Publishes the fields of a reading that changed since they were last published.
+ *
+ * The weight counts as changed once it differs from the last published weight by
+ * `TELEMETRY_WEIGHT_DEADBAND_G` or more, the other fields on any change. The message
+ * has the format of `telemetry_publish()` and only carries the changed fields. The
+ * first reading and every reading `TELEMETRY_HEARTBEAT_S` after the last complete
+ * message are published with all fields.
+ *
+ * While the broker is unreachable, or stored messages are waiting for
+ * `telemetry_flush()`, the message is stored with the time of the reading instead.
+ *
+ * @param sample Pointer to the reading.
+ * @return `true` if a message was published or stored, `false` if nothing changed.
+ */
+bool telemetry_report(const telemetry_sample_t *sample);
+
+/**
+ * @brief Publishes telemetry stored while the broker was unreachable.
+ *
+ * Stored messages are published oldest first in batches of up to
+ * `TELEMETRY_FLUSH_BATCH_SIZE` to `<device_id>/hydrapetinfo/telemetry/batch` as a
+ * JSON array of telemetry messages, or with `TELEMETRY_ENCODING_CBOR` to
+ * `<device_id>/hydrapetinfo/telemetry/cbor/batch` as a CBOR array of telemetry maps.
+ * Batches are queued in the bulk publish class while it has room, which paces
+ * them, and none while more than `TELEMETRY_FLUSH_OUTBOX_MAX` bytes await acknowledgement.
+ *
+ * @return `true` if the store is empty, `false` if messages are still waiting.
+ */
+bool telemetry_flush(void);
+
+#endif /* MAIN_TELEMETRY_H_ */
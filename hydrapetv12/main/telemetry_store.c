@@ -0,0 +1,446 @@
+// telemetry_store.c
+
+#include "telemetry_store.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include <string.h>
+#include "timebase.h"
+#include "config.h"
+
+static const char *TAG = "TELEMETRY_STORE";
+
+/** @brief Size of a flash sector, the unit of erasure of the ring */
+#define SECTOR_SIZE 4096
+
+/** @brief Magic number at the start of every sector in use ("TLM1") */
+#define SECTOR_MAGIC 0x544C4D31
+
+/** @brief Bytes reserved at the start of every sector for its header */
+#define SECTOR_HEADER_SIZE 16
+
+/** @brief Number of records in one sector */
+#define RECORDS_PER_SECTOR ((SECTOR_SIZE - SECTOR_HEADER_SIZE) / sizeof(flash_record_t))
+
+/** @brief Number of records read from flash at once while scanning */
+#define SCAN_CHUNK 16
+
+/** @brief Value of `marker` once a record is completely written */
+#define RECORD_WRITTEN 0x5A
+
+/** @brief Value of `state` of a record not yet published (erased flash) */
+#define RECORD_PENDING 0xFF
+
+/** @brief Value of `state` of a published record, written without erasing */
+#define RECORD_SENT 0x00
+
+/** @brief Bits of `flags` of a flash record */
+#define FLAG_BUTTON   (1 << 0)
+#define FLAG_LED      (1 << 1)
+#define FLAG_MOTOR    (1 << 2)
+#define FLAG_TANK_LOW (1 << 3)
+
+/**
+ * @brief Header at the start of every sector in use.
+ */
+typedef struct {
+    uint32_t magic;  /**< @brief `SECTOR_MAGIC` */
+    uint32_t seq;    /**< @brief Sequence number, incremented for every sector started */
+} sector_header_t;
+
+/**
+ * @brief Record of the flash ring.
+ *
+ * A record is written with `marker` erased, then `marker` is programmed, so a
+ * record cut short by a reset is recognised. `state` is cleared once the record
+ * is published, which flash allows without an erase.
+ */
+typedef struct {
+    int64_t wall_us;  /**< @brief Wall-clock time of the reading in microseconds since the epoch */
+    int32_t weight;   /**< @brief Weight in grams */
+    uint8_t fields;   /**< @brief Mask of the `telemetry_field_t` fields of the message */
+    uint8_t flags;    /**< @brief `FLAG_*` bits of the boolean fields */
+    uint8_t state;    /**< @brief `RECORD_PENDING` or `RECORD_SENT` */
+    uint8_t marker;   /**< @brief `RECORD_WRITTEN` once complete */
+} flash_record_t;
+
+/**
+ * @brief Position of a record slot in the flash ring.
+ */
+typedef struct {
+    uint32_t sector;  /**< @brief Index of the sector in the partition */
+    uint32_t index;   /**< @brief Index of the record in the sector */
+} ring_pos_t;
+
+/** @brief Messages waiting in RAM, oldest at `ram_head` */
+static telemetry_record_t ram[TELEMETRY_STORE_RAM_RECORDS];
+
+/** @brief Index of the oldest message in `ram` */
+static size_t ram_head = 0;
+
+/** @brief Number of messages in `ram` */
+static size_t ram_count = 0;
+
+/** @brief Partition of the flash ring, `NULL` when messages are kept in RAM only */
+static const esp_partition_t *partition = NULL;
+
+/** @brief Number of sectors of the flash ring */
+static uint32_t sector_count = 0;
+
+/** @brief Next free slot of the flash ring */
+static ring_pos_t write_pos = { 0 };
+
+/** @brief Whether the sector of `write_pos` is erased and has its header */
+static bool write_ready = false;
+
+/** @brief Oldest pending record of the flash ring, valid while `flash_count` is not 0 */
+static ring_pos_t read_pos = { 0 };
+
+/** @brief Number of pending records in the flash ring */
+static size_t flash_count = 0;
+
+/** @brief Sequence number of the next sector started */
+static uint32_t next_seq = 0;
+
+/** @brief Number of messages lost because the store was full */
+static uint32_t dropped = 0;
+
+/**
+ * @brief Computes the offset of a record slot in the partition.
+ *
+ * @param pos Position of the slot.
+ * @return Offset in bytes.
+ */
+static size_t record_offset(ring_pos_t pos)
+{
+    return (size_t)pos.sector * SECTOR_SIZE + SECTOR_HEADER_SIZE + pos.index * sizeof(flash_record_t);
+}
+
+/**
+ * @brief Moves a position to the next record slot, wrapping around the ring.
+ *
+ * @param pos Pointer to the position.
+ */
+static void advance(ring_pos_t *pos)
+{
+    if (++pos->index == RECORDS_PER_SECTOR) {
+        pos->index = 0;
+        pos->sector = (pos->sector + 1) % sector_count;
+    }
+}
+
+/**
+ * @brief Checks whether two positions are the same slot.
+ *
+ * @param a First position.
+ * @param b Second position.
+ * @return `true` if both refer to the same slot, `false` otherwise.
+ */
+static bool same_pos(ring_pos_t a, ring_pos_t b)
+{
+    return a.sector == b.sector && a.index == b.index;
+}
+
+/**
+ * @brief Checks whether a record slot is still erased.
+ *
+ * @param entry Pointer to the slot contents.
+ * @return `true` if every byte is erased, `false` otherwise.
+ */
+static bool slot_erased(const flash_record_t *entry)
+{
+    const uint8_t *bytes = (const uint8_t *)entry;
+    for (size_t i = 0; i < sizeof(*entry); i++) {
+        if (bytes[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Erases a sector and writes its header, dropping the records still pending in it.
+ *
+ * @param sector Index of the sector.
+ * @return `true` on success, `false` on a flash error.
+ */
+static bool start_sector(uint32_t sector)
+{
+    if (flash_count > 0 && read_pos.sector == sector) {
+        // The ring is full, the oldest sector makes room for the newest readings
+        size_t lost = RECORDS_PER_SECTOR - read_pos.index;
+        lost = (lost < flash_count) ? lost : flash_count;
+        flash_count -= lost;
+        dropped += lost;
+        read_pos.sector = (sector + 1) % sector_count;
+        read_pos.index = 0;
+        ESP_LOGW(TAG, "Flash ring full, dropped %u readings (%lu dropped)", (unsigned)lost, (unsigned long)dropped);
+    }
+
+    sector_header_t header = { .magic = SECTOR_MAGIC, .seq = next_seq };
+    if (esp_partition_erase_range(partition, (size_t)sector * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(partition, (size_t)sector * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start flash ring sector %lu", (unsigned long)sector);
+        return false;
+    }
+    next_seq++;
+    return true;
+}
+
+/**
+ * @brief Appends a message to the flash ring.
+ *
+ * @param record Pointer to the message, with `wall_us` set.
+ * @return `true` on success, `false` on a flash error.
+ */
+static bool flash_append(const telemetry_record_t *record)
+{
+    if (!write_ready) {
+        if (!start_sector(write_pos.sector)) {
+            return false;
+        }
+        write_ready = true;
+    }
+
+    flash_record_t entry = {
+        .wall_us = record->wall_us,
+        .weight = record->sample.weight,
+        .fields = (uint8_t)record->fields,
+        .flags = (record->sample.button_pressed ? FLAG_BUTTON : 0) |
+                 (record->sample.led_on ? FLAG_LED : 0) |
+                 (record->sample.motor_on ? FLAG_MOTOR : 0) |
+                 (record->sample.tank_low ? FLAG_TANK_LOW : 0),
+        .state = RECORD_PENDING,
+        .marker = 0xFF,
+    };
+    size_t offset = record_offset(write_pos);
+    uint8_t marker = RECORD_WRITTEN;
+    bool written = esp_partition_write(partition, offset, &entry, sizeof(entry)) == ESP_OK &&
+                   esp_partition_write(partition, offset + offsetof(flash_record_t, marker), &marker, 1) == ESP_OK;
+
+    // The slot is used even if the write failed, a partly written record is skipped later
+    if (written) {
+        if (flash_count == 0) {
+            read_pos = write_pos;
+        }
+        flash_count++;
+    }
+    advance(&write_pos);
+    if (write_pos.index == 0) {
+        write_ready = false;
+    }
+    return written;
+}
+
+/**
+ * @brief Reads the next pending record of the flash ring.
+ *
+ * Published and partly written records before it are skipped.
+ *
+ * @param pos Pointer to the position to read from, moved to the record.
+ * @param entry Pointer where the record is stored.
+ * @return `true` if a record was read, `false` at the end of the ring or on a flash error.
+ */
+static bool flash_next(ring_pos_t *pos, flash_record_t *entry)
+{
+    while (!same_pos(*pos, write_pos)) {
+        if (esp_partition_read(partition, record_offset(*pos), entry, sizeof(*entry)) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read flash ring");
+            return false;
+        }
+        if (entry->marker == RECORD_WRITTEN && entry->state == RECORD_PENDING) {
+            return true;
+        }
+        advance(pos);
+    }
+    return false;
+}
+
+/**
+ * @brief Finds the newest sector, the end of the ring and the pending records after a reset.
+ */
+static void flash_recover(void)
+{
+    bool found = false;
+    uint32_t newest = 0;
+    uint32_t oldest = 0;
+    uint32_t newest_seq = 0;
+    uint32_t oldest_seq = 0;
+
+    for (uint32_t sector = 0; sector < sector_count; sector++) {
+        sector_header_t header;
+        if (esp_partition_read(partition, (size_t)sector * SECTOR_SIZE, &header, sizeof(header)) != ESP_OK ||
+            header.magic != SECTOR_MAGIC) {
+            continue;
+        }
+        // Compare sequence numbers by difference so they may wrap
+        if (!found || (int32_t)(header.seq - newest_seq) > 0) {
+            newest = sector;
+            newest_seq = header.seq;
+        }
+        if (!found || (int32_t)(header.seq - oldest_seq) < 0) {
+            oldest = sector;
+            oldest_seq = header.seq;
+        }
+        found = true;
+    }
+    if (!found) {
+        return;
+    }
+    next_seq = newest_seq + 1;
+
+    // Records are appended in order and published in order, so a single pass over
+    // the sectors from the oldest to the newest finds the end and the pending records
+    uint32_t span = (newest + sector_count - oldest) % sector_count + 1;
+    ring_pos_t end = { .sector = newest, .index = 0 };
+    for (uint32_t i = 0; i < span; i++) {
+        uint32_t sector = (oldest + i) % sector_count;
+        for (uint32_t index = 0; index < RECORDS_PER_SECTOR; index += SCAN_CHUNK) {
+            flash_record_t chunk[SCAN_CHUNK];
+            uint32_t n = (RECORDS_PER_SECTOR - index < SCAN_CHUNK) ? RECORDS_PER_SECTOR - index : SCAN_CHUNK;
+            ring_pos_t pos = { .sector = sector, .index = index };
+            if (esp_partition_read(partition, record_offset(pos), chunk, n * sizeof(flash_record_t)) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read flash ring");
+                break;
+            }
+            for (uint32_t j = 0; j < n; j++) {
+                pos.index = index + j;
+                if (sector == newest && !slot_erased(&chunk[j])) {
+                    end.index = pos.index + 1;
+                }
+                if (chunk[j].marker != RECORD_WRITTEN || chunk[j].state != RECORD_PENDING) {
+                    continue;
+                }
+                if (flash_count == 0) {
+                    read_pos = pos;
+                }
+                flash_count++;
+            }
+        }
+    }
+
+    write_pos = end;
+    write_ready = true;
+    if (write_pos.index == RECORDS_PER_SECTOR) {
+        write_pos.index = 0;
+        write_pos.sector = (newest + 1) % sector_count;
+        write_ready = false;
+    }
+}
+
+/**
+ * @brief Opens the flash ring and recovers the messages not yet published before the last reset.
+ */
+void telemetry_store_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TELEMETRY_STORE_PARTITION);
+    if (partition == NULL || partition->size < 2 * SECTOR_SIZE) {
+        ESP_LOGW(TAG, "No \"%s\" partition, offline telemetry is kept in RAM only", TELEMETRY_STORE_PARTITION);
+        partition = NULL;
+        return;
+    }
+    sector_count = partition->size / SECTOR_SIZE;
+
+    flash_recover();
+    ESP_LOGI(TAG, "Flash ring of %lu readings, %u waiting",
+             (unsigned long)(sector_count * RECORDS_PER_SECTOR), (unsigned)flash_count);
+}
+
+/**
+ * @brief Appends a telemetry message to the store.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields of the message.
+ */
+void telemetry_store_push(const telemetry_sample_t *sample, uint32_t fields)
+{
+    if (ram_count == TELEMETRY_STORE_RAM_RECORDS) {
+        // Move the oldest message to flash, converting its time while the monotonic clock is valid
+        telemetry_record_t *oldest = &ram[ram_head];
+        oldest->wall_us = timebase_to_wall_us(oldest->sample.timestamp_us);
+        if (partition == NULL || !flash_append(oldest)) {
+            dropped++;
+            ESP_LOGW(TAG, "Telemetry store full, dropped a reading (%lu dropped)", (unsigned long)dropped);
+        }
+        ram_head = (ram_head + 1) % TELEMETRY_STORE_RAM_RECORDS;
+        ram_count--;
+    }
+
+    telemetry_record_t *record = &ram[(ram_head + ram_count) % TELEMETRY_STORE_RAM_RECORDS];
+    record->sample = *sample;
+    record->wall_us = 0;
+    record->fields = fields;
+    ram_count++;
+}
+
+/**
+ * @brief Returns the number of messages waiting in the store.
+ *
+ * @return Number of messages in RAM and in the flash ring.
+ */
+size_t telemetry_store_count(void)
+{
+    return ram_count + flash_count;
+}
+
+/**
+ * @brief Copies the oldest waiting messages without removing them.
+ *
+ * @param records Array where the messages are stored, oldest first.
+ * @param max Size of the array.
+ * @return Number of messages copied.
+ */
+size_t telemetry_store_peek(telemetry_record_t *records, size_t max)
+{
+    size_t count = 0;
+
+    if (flash_count > 0) {
+        ring_pos_t pos = read_pos;
+        flash_record_t entry;
+        while (count < max && count < flash_count && flash_next(&pos, &entry)) {
+            telemetry_record_t *record = &records[count++];
+            memset(record, 0, sizeof(*record));
+            record->wall_us = entry.wall_us;
+            record->fields = entry.fields;
+            record->sample.weight = entry.weight;
+            record->sample.button_pressed = (entry.flags & FLAG_BUTTON) != 0;
+            record->sample.led_on = (entry.flags & FLAG_LED) != 0;
+            record->sample.motor_on = (entry.flags & FLAG_MOTOR) != 0;
+            record->sample.tank_low = (entry.flags & FLAG_TANK_LOW) != 0;
+            advance(&pos);
+        }
+        return count;
+    }
+
+    for (; count < max && count < ram_count; count++) {
+        records[count] = ram[(ram_head + count) % TELEMETRY_STORE_RAM_RECORDS];
+        records[count].wall_us = timebase_to_wall_us(records[count].sample.timestamp_us);
+    }
+    return count;
+}
+
+/**
+ * @brief Removes the oldest waiting messages once they are published.
+ *
+ * @param count Number of messages returned by the last `telemetry_store_peek()` to remove.
+ */
+void telemetry_store_consume(size_t count)
+{
+    if (flash_count > 0) {
+        flash_record_t entry;
+        uint8_t state = RECORD_SENT;
+        while (count > 0 && flash_count > 0 && flash_next(&read_pos, &entry)) {
+            if (esp_partition_write(partition, record_offset(read_pos) + offsetof(flash_record_t, state),
+                                    &state, 1) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to mark flash ring record as published");
+            }
+            advance(&read_pos);
+            flash_count--;
+            count--;
+        }
+        return;
+    }
+
+    count = (count < ram_count) ? count : ram_count;
+    ram_head = (ram_head + count) % TELEMETRY_STORE_RAM_RECORDS;
+    ram_count -= count;
+}
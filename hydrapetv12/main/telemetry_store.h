@@ -0,0 +1,67 @@
+// telemetry_store.h
+
+#ifndef MAIN_TELEMETRY_STORE_H_
+#define MAIN_TELEMETRY_STORE_H_
+
+#include <stdint.h>   /**< @brief For int64_t, uint32_t */
+#include <stddef.h>   /**< @brief For size_t */
+#include "telemetry.h"
+
+/** @brief Label of the data partition holding the flash ring */
+#define TELEMETRY_STORE_PARTITION "telemetry"
+
+/**
+ * @brief Structure representing a telemetry message held back while the broker is unreachable.
+ */
+typedef struct {
+    telemetry_sample_t sample;  /**< @brief The reading; `timestamp_us` is only valid in the boot that stored it */
+    int64_t wall_us;            /**< @brief Wall-clock time of the reading in microseconds since the epoch */
+    uint32_t fields;            /**< @brief Mask of the `telemetry_field_t` fields of the message */
+} telemetry_record_t;
+
+/**
+ * @brief Opens the flash ring and recovers the messages not yet published before the last reset.
+ *
+ * Without a `TELEMETRY_STORE_PARTITION` partition the messages are kept in RAM only.
+ */
+void telemetry_store_init(void);
+
+/**
+ * @brief Appends a telemetry message to the store.
+ *
+ * The message is kept in RAM. Once `TELEMETRY_STORE_RAM_RECORDS` messages are
+ * waiting, the oldest is moved to the flash ring, whose oldest sector is erased
+ * when it is full. Only called from the publish task.
+ *
+ * @param sample Pointer to the reading.
+ * @param fields Mask of the `telemetry_field_t` fields of the message.
+ */
+void telemetry_store_push(const telemetry_sample_t *sample, uint32_t fields);
+
+/**
+ * @brief Returns the number of messages waiting in the store.
+ *
+ * @return Number of messages in RAM and in the flash ring.
+ */
+size_t telemetry_store_count(void);
+
+/**
+ * @brief Copies the oldest waiting messages without removing them.
+ *
+ * Messages from the flash ring are returned before those in RAM, and never in
+ * the same call, so `wall_us` of every record is set and the order is kept.
+ *
+ * @param records Array where the messages are stored, oldest first.
+ * @param max Size of the array.
+ * @return Number of messages copied.
+ */
+size_t telemetry_store_peek(telemetry_record_t *records, size_t max);
+
+/**
+ * @brief Removes the oldest waiting messages once they are published.
+ *
+ * @param count Number of messages returned by the last `telemetry_store_peek()` to remove.
+ */
+void telemetry_store_consume(size_t count);
+
+#endif /* MAIN_TELEMETRY_STORE_H_ */
@@ -0,0 +1,196 @@
+// time_format.c
+
+#include "time_format.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+/** @brief Two-digit renderings of 0..99 */
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/** @brief Length of the cached prefix "YYYY-MM-DDTHH:" */
+#define PREFIX_LEN 14
+
+/**
+ * @brief Cached rendering of the current local hour.
+ *
+ * The cache covers one hour rather than one day so that a daylight saving
+ * change, which happens on an hour boundary, is never rendered from a stale
+ * offset.
+ */
+typedef struct {
+    time_t start;              /**< @brief First second covered by the prefix */
+    time_t end;                /**< @brief First second past the prefix */
+    char prefix[PREFIX_LEN];   /**< @brief Rendered "YYYY-MM-DDTHH:" */
+} hour_cache_t;
+
+/** @brief Cached hour, `end` 0 while empty */
+static hour_cache_t hour_cache;
+
+/** @brief Spinlock guarding `hour_cache` */
+static portMUX_TYPE hour_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Writes a number 0..99 as two digits.
+ *
+ * @param buf Output buffer of at least 2 bytes.
+ * @param value Number to write.
+ */
+static inline void put2(char *buf, int value)
+{
+    memcpy(buf, &digit_pairs[2 * value], 2);
+}
+
+/**
+ * @brief Renders the "YYYY-MM-DDTHH:" prefix of a broken-down time.
+ *
+ * @param tm_in Broken-down time.
+ * @param buf Output buffer of at least `PREFIX_LEN` bytes.
+ */
+static void render_prefix(const struct tm *tm_in, char *buf)
+{
+    int year = tm_in->tm_year + 1900;
+    put2(buf, (year / 100) % 100);
+    put2(buf + 2, year % 100);
+    buf[4] = '-';
+    put2(buf + 5, tm_in->tm_mon + 1);
+    buf[7] = '-';
+    put2(buf + 8, tm_in->tm_mday);
+    buf[10] = 'T';
+    put2(buf + 11, tm_in->tm_hour);
+    buf[13] = ':';
+}
+
+/**
+ * @brief Formats a time as local ISO-8601 "YYYY-MM-DDTHH:MM:SS".
+ *
+ * @param t Time in seconds since the epoch.
+ * @param buf Output buffer of at least `TIME_FORMAT_ISO_SIZE` bytes.
+ * @return Number of characters written, excluding the terminating NUL.
+ */
+size_t time_format_iso(time_t t, char *buf)
+{
+    hour_cache_t cache;
+    taskENTER_CRITICAL(&hour_cache_lock);
+    cache = hour_cache;
+    taskEXIT_CRITICAL(&hour_cache_lock);
+
+    if (t < cache.start || t >= cache.end) {
+        struct tm tm_t;
+        localtime_r(&t, &tm_t);
+        render_prefix(&tm_t, cache.prefix);
+        cache.start = t - tm_t.tm_min * 60 - tm_t.tm_sec;
+        cache.end = cache.start + 3600;
+
+        taskENTER_CRITICAL(&hour_cache_lock);
+        hour_cache = cache;
+        taskEXIT_CRITICAL(&hour_cache_lock);
+    }
+
+    int seconds = (int)(t - cache.start);
+    memcpy(buf, cache.prefix, PREFIX_LEN);
+    put2(buf + 14, seconds / 60);
+    buf[16] = ':';
+    put2(buf + 17, seconds % 60);
+    buf[TIME_FORMAT_ISO_LEN] = '\0';
+    return TIME_FORMAT_ISO_LEN;
+}
+
+/**
+ * @brief Formats a broken-down time as ISO-8601 "YYYY-MM-DDTHH:MM:SS".
+ *
+ * @param tm_in Broken-down time.
+ * @param buf Output buffer of at least `TIME_FORMAT_ISO_SIZE` bytes.
+ * @return Number of characters written, excluding the terminating NUL.
+ */
+size_t time_format_iso_tm(const struct tm *tm_in, char *buf)
+{
+    render_prefix(tm_in, buf);
+    put2(buf + 14, tm_in->tm_min);
+    buf[16] = ':';
+    put2(buf + 17, tm_in->tm_sec);
+    buf[TIME_FORMAT_ISO_LEN] = '\0';
+    return TIME_FORMAT_ISO_LEN;
+}
+
+/**
+ * @brief Parses an unsigned decimal field.
+ *
+ * @param p Pointer to the parse position, advanced past the digits.
+ * @param end End of the input.
+ * @param max_digits Maximum number of digits to consume.
+ * @param value Pointer where the value is stored.
+ * @return `true` if at least one digit was read, `false` otherwise.
+ */
+static bool parse_field(const char **p, const char *end, int max_digits, int *value)
+{
+    const char *s = *p;
+    int v = 0;
+    int n = 0;
+    while (n < max_digits && s + n < end && s[n] >= '0' && s[n] <= '9') {
+        v = v * 10 + (s[n] - '0');
+        n++;
+    }
+    if (n == 0) {
+        return false;
+    }
+    *value = v;
+    *p = s + n;
+    return true;
+}
+
+/**
+ * @brief Parses an ISO-8601 timestamp "YYYY-MM-DDTHH:MM:SS".
+ *
+ * @param str Input starting with the timestamp, not necessarily NUL-terminated.
+ * @param len Length of the input in bytes.
+ * @param tm_out Pointer where the parsed time is stored.
+ * @param end Optional pointer receiving the first character after the timestamp.
+ * @return `true` if a timestamp was parsed, `false` otherwise.
+ */
+bool time_parse_iso(const char *str, size_t len, struct tm *tm_out, const char **end)
+{
+    static const char separators[] = "--T::";
+    int fields[6];
+    const char *p = str;
+    const char *str_end = str + len;
+
+    for (int i = 0; i < 6; i++) {
+        if (!parse_field(&p, str_end, (i == 0) ? 4 : 2, &fields[i])) {
+            return false;
+        }
+        if (i < 5) {
+            if (p == str_end || *p != separators[i]) {
+                return false;
+            }
+            p++;
+        }
+    }
+    if (fields[1] < 1 || fields[1] > 12 || fields[2] < 1 || fields[2] > 31 ||
+        fields[3] > 23 || fields[4] > 59 || fields[5] > 60) {
+        return false;
+    }
+
+    memset(tm_out, 0, sizeof(struct tm));
+    tm_out->tm_year = fields[0] - 1900; // tm_year: years since 1900
+    tm_out->tm_mon = fields[1] - 1;     // tm_mon: months since January [0-11]
+    tm_out->tm_mday = fields[2];
+    tm_out->tm_hour = fields[3];
+    tm_out->tm_min = fields[4];
+    tm_out->tm_sec = fields[5];
+    tm_out->tm_isdst = -1;
+    if (end != NULL) {
+        *end = p;
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+// time_format.h
+
+#ifndef MAIN_TIME_FORMAT_H_
+#define MAIN_TIME_FORMAT_H_
+
+#include <stdbool.h>  /**< @brief For bool */
+#include <stddef.h>   /**< @brief For size_t */
+#include <time.h>     /**< @brief For time_t, struct tm */
+
+/** @brief Length of an ISO-8601 timestamp "YYYY-MM-DDTHH:MM:SS", without the terminating NUL */
+#define TIME_FORMAT_ISO_LEN 19
+
+/** @brief Size of a buffer holding an ISO-8601 timestamp and its terminating NUL */
+#define TIME_FORMAT_ISO_SIZE (TIME_FORMAT_ISO_LEN + 1)
+
+/**
+ * @brief Formats a time as local ISO-8601 "YYYY-MM-DDTHH:MM:SS".
+ *
+ * The calendar conversion is cached, so consecutive calls within the same hour
+ * only render the minutes and seconds.
+ *
+ * @param t Time in seconds since the epoch.
+ * @param buf Output buffer of at least `TIME_FORMAT_ISO_SIZE` bytes.
+ * @return Number of characters written, excluding the terminating NUL.
+ */
+size_t time_format_iso(time_t t, char *buf);
+
+/**
+ * @brief Formats a broken-down time as ISO-8601 "YYYY-MM-DDTHH:MM:SS".
+ *
+ * @param tm_in Broken-down time.
+ * @param buf Output buffer of at least `TIME_FORMAT_ISO_SIZE` bytes.
+ * @return Number of characters written, excluding the terminating NUL.
+ */
+size_t time_format_iso_tm(const struct tm *tm_in, char *buf);
+
+/**
+ * @brief Parses an ISO-8601 timestamp "YYYY-MM-DDTHH:MM:SS".
+ *
+ * Fields may omit their leading zeros, as accepted by the previous `sscanf` parsing.
+ * The result is a local time with `tm_isdst` set to -1, ready for `mktime()`.
+ *
+ * @param str Input starting with the timestamp, not necessarily NUL-terminated.
+ * @param len Length of the input in bytes.
+ * @param tm_out Pointer where the parsed time is stored.
+ * @param end Optional pointer receiving the first character after the timestamp.
+ * @return `true` if a timestamp was parsed, `false` otherwise.
+ */
+bool time_parse_iso(const char *str, size_t len, struct tm *tm_out, const char **end);
+
+#endif /* MAIN_TIME_FORMAT_H_ */
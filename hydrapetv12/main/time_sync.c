@@ -0,0 +1,201 @@
+// time_sync.c
+
+#include "time_sync.h"
+#include "alarms.h"
+#include "timebase.h"
+#include "config.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include "esp_sntp.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "TIME SYNC";
+
+/** @brief Weight of a new drift sample in the drift average */
+#define DRIFT_SMOOTHING 0.25f
+
+/** @brief Whether the system time has been synchronised or set */
+static volatile bool time_valid = false;
+
+/** @brief System time last set by a sync or manually, in microseconds since the epoch, or 0 if never */
+static int64_t ref_wall_us = 0;
+
+/** @brief Monotonic time at which `ref_wall_us` was set, in microseconds */
+static int64_t ref_mono_us = 0;
+
+/** @brief Server time of the last SNTP sync in microseconds since the epoch, or 0 if none */
+static int64_t last_sync_wall_us = 0;
+
+/** @brief Monotonic time of the last SNTP sync in microseconds */
+static int64_t last_sync_mono_us = 0;
+
+/** @brief Averaged drift of the local clock in parts per million */
+static float drift_ppm = 0.0f;
+
+/** @brief Whether `drift_ppm` holds at least one sample */
+static bool drift_valid = false;
+
+/** @brief Periodic timer realigning the timebase with the clock while it is slewed */
+static esp_timer_handle_t slew_timer = NULL;
+
+/**
+ * @brief Records the system time just set, and returns the time the clock showed before.
+ *
+ * The previous time is extrapolated from the last reference on the monotonic clock,
+ * since the system clock has already been changed by the time this is called.
+ *
+ * @param wall_us System time in microseconds since the epoch, as read after the change.
+ * @param mono_us Monotonic time in microseconds at which it was set.
+ * @return Previous system time in microseconds, or `wall_us` if no reference exists yet.
+ */
+static int64_t update_reference(int64_t wall_us, int64_t mono_us)
+{
+    int64_t before_us = (ref_wall_us != 0) ? ref_wall_us + (mono_us - ref_mono_us) : wall_us;
+    ref_wall_us = wall_us;
+    ref_mono_us = mono_us;
+    return before_us;
+}
+
+/**
+ * @brief Callback of the slew timer, realigning the timebase with the system clock.
+ *
+ * Stops the timer once the SNTP client reports the slew finished.
+ *
+ * @param arg Timer argument (unused).
+ */
+static void slew_timer_cb(void *arg)
+{
+    timebase_sync_wall();
+    if (sntp_get_sync_status() != SNTP_SYNC_STATUS_IN_PROGRESS) {
+        esp_timer_stop(slew_timer);
+        ESP_LOGI(TAG, "Clock slew finished");
+    }
+}
+
+/**
+ * @brief Callback of the SNTP client, called after each synchronisation.
+ *
+ * Runs in the LwIP task. The drift is measured against the monotonic clock, which
+ * is not affected by the clock being stepped or slewed. While the clock is slewed it
+ * still differs from the server time, so the timebase and the alarms follow what the
+ * clock shows rather than the time received.
+ *
+ * @param tv Time received from the server.
+ */
+static void time_sync_cb(struct timeval *tv)
+{
+    int64_t wall_us = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec;
+    int64_t mono_us = esp_timer_get_time();
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t clock_us = (int64_t)now.tv_sec * 1000000LL + now.tv_usec;
+
+    if (last_sync_wall_us != 0 && mono_us > last_sync_mono_us) {
+        int64_t elapsed_us = mono_us - last_sync_mono_us;
+        float sample = (float)(wall_us - last_sync_wall_us - elapsed_us) * 1e6f / (float)elapsed_us;
+        drift_ppm = drift_valid ? drift_ppm + DRIFT_SMOOTHING * (sample - drift_ppm) : sample;
+        drift_valid = true;
+    }
+    last_sync_wall_us = wall_us;
+    last_sync_mono_us = mono_us;
+
+    int64_t before_us = update_reference(clock_us, mono_us);
+    bool stepped = (sntp_get_sync_status() == SNTP_SYNC_STATUS_COMPLETED);
+    ESP_LOGI(TAG, "SNTP sync: %s, offset %lld ms, drift %.1f ppm",
+             stepped ? "stepped" : "slewing",
+             (long long)((wall_us - before_us) / 1000LL),
+             drift_ppm);
+
+    timebase_sync_wall();
+    if (slew_timer != NULL) {
+        esp_timer_stop(slew_timer);
+        if (!stepped) {
+            esp_timer_start_periodic(slew_timer, (uint64_t)SNTP_SLEW_RESAMPLE_MS * 1000);
+        }
+    }
+    time_valid = true;
+    alarms_clock_changed(before_us / 1000000LL, clock_us / 1000000LL);
+}
+
+/**
+ * @brief Starts SNTP time synchronisation.
+ *
+ * Synchronises with `SNTP_SERVER` as soon as an IP address is obtained and then every
+ * `SNTP_SYNC_INTERVAL_MS`. Smooth sync slews the clock with `adjtime()`; the SNTP client
+ * falls back to stepping for the first sync and for offsets too large to slew. While
+ * the clock is slewed the timebase is realigned every `SNTP_SLEW_RESAMPLE_MS`.
+ */
+void time_sync_init(void)
+{
+    // Start from whatever the clock holds, e.g. after a software reset
+    timebase_sync_wall();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = slew_timer_cb,
+        .name = "sntp_slew",
+    };
+    if (esp_timer_create(&timer_args, &slew_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create the slew timer");
+    }
+
+    esp_sntp_config_t config = ESP_NETIF_SNTP_DEFAULT_CONFIG(SNTP_SERVER);
+    config.smooth_sync = true;
+    config.sync_cb = time_sync_cb;
+
+    esp_err_t err = esp_netif_sntp_init(&config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start SNTP: %s", esp_err_to_name(err));
+        return;
+    }
+    sntp_set_sync_interval(SNTP_SYNC_INTERVAL_MS);
+    ESP_LOGI(TAG, "SNTP started with server %s", SNTP_SERVER);
+}
+
+/**
+ * @brief Sets the system time manually, as received over MQTT.
+ *
+ * @param t New time in seconds since the epoch.
+ * @return `ESP_OK` on success, `ESP_FAIL` if the clock could not be set.
+ */
+esp_err_t time_sync_set_time(time_t t)
+{
+    time_t before = time(NULL);
+
+    struct timeval tv;
+    tv.tv_sec = t;
+    tv.tv_usec = 0;
+    if (settimeofday(&tv, NULL) != 0) {
+        ESP_LOGE(TAG, "Failed to set time: %s", strerror(errno));
+        return ESP_FAIL;
+    }
+
+    update_reference((int64_t)t * 1000000LL, esp_timer_get_time());
+    timebase_sync_wall();
+    time_valid = true;
+    // Alarm due times are relative to the wall clock
+    alarms_clock_changed(before, t);
+    return ESP_OK;
+}
+
+/**
+ * @brief Checks whether the system time is valid.
+ *
+ * @return `true` if the system time is valid, `false` otherwise.
+ */
+bool time_sync_is_valid(void)
+{
+    return time_valid;
+}
+
+/**
+ * @brief Returns the drift of the local clock measured between SNTP syncs.
+ *
+ * @return Drift in parts per million, or 0 until two syncs have been received.
+ */
+float time_sync_drift_ppm(void)
+{
+    return drift_ppm;
+}
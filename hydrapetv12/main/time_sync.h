@@ -0,0 +1,48 @@
+// time_sync.h
+
+#ifndef MAIN_TIME_SYNC_H_
+#define MAIN_TIME_SYNC_H_
+
+#include <stdbool.h>  /**< @brief For bool */
+#include <time.h>     /**< @brief For time_t */
+#include "esp_err.h"
+
+/**
+ * @brief Starts SNTP time synchronisation.
+ *
+ * Synchronises with `SNTP_SERVER` as soon as an IP address is obtained and then every
+ * `SNTP_SYNC_INTERVAL_MS`. Small corrections slew the clock; only the first sync and
+ * corrections too large to slew step it. Must be called after the network interface
+ * is initialized.
+ */
+void time_sync_init(void);
+
+/**
+ * @brief Sets the system time manually, as received over MQTT.
+ *
+ * Steps the clock and marks the time as valid. A later SNTP sync takes precedence.
+ *
+ * @param t New time in seconds since the epoch.
+ * @return `ESP_OK` on success, `ESP_FAIL` if the clock could not be set.
+ */
+esp_err_t time_sync_set_time(time_t t);
+
+/**
+ * @brief Checks whether the system time is valid.
+ *
+ * The time is valid once synchronised over SNTP or set manually. Until then it counts
+ * from 1970 and must not be used to fire alarms.
+ *
+ * @return `true` if the system time is valid, `false` otherwise.
+ */
+bool time_sync_is_valid(void);
+
+/**
+ * @brief Returns the drift of the local clock measured between SNTP syncs.
+ *
+ * @return Drift in parts per million, positive if the local clock runs slow, or 0
+ *         until two syncs have been received.
+ */
+float time_sync_drift_ppm(void);
+
+#endif /* MAIN_TIME_SYNC_H_ */
@@ -0,0 +1,60 @@
+// timebase.c
+
+#include "timebase.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include <sys/time.h>
+
+/** @brief Wall-clock time at monotonic time zero, in microseconds since the epoch */
+static int64_t wall_offset_us = 0;
+
+/** @brief Spinlock guarding `wall_offset_us`, which is not written atomically */
+static portMUX_TYPE wall_offset_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Returns the current monotonic time.
+ *
+ * @return Microseconds since boot.
+ */
+int64_t timebase_now_us(void)
+{
+    return esp_timer_get_time();
+}
+
+/**
+ * @brief Re-reads the offset between the system clock and the monotonic time.
+ */
+void timebase_sync_wall(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    timebase_set_wall((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec, esp_timer_get_time());
+}
+
+/**
+ * @brief Sets the wall-clock time corresponding to a monotonic time.
+ *
+ * @param wall_us Wall-clock time in microseconds since the epoch.
+ * @param mono_us Monotonic time at which `wall_us` was valid.
+ */
+void timebase_set_wall(int64_t wall_us, int64_t mono_us)
+{
+    taskENTER_CRITICAL(&wall_offset_lock);
+    wall_offset_us = wall_us - mono_us;
+    taskEXIT_CRITICAL(&wall_offset_lock);
+}
+
+/**
+ * @brief Converts a monotonic timestamp to wall-clock time.
+ *
+ * @param mono_us Monotonic timestamp from `timebase_now_us()`.
+ * @return Microseconds since the epoch.
+ */
+int64_t timebase_to_wall_us(int64_t mono_us)
+{
+    taskENTER_CRITICAL(&wall_offset_lock);
+    int64_t offset_us = wall_offset_us;
+    taskEXIT_CRITICAL(&wall_offset_lock);
+    return mono_us + offset_us;
+}
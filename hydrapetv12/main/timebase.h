@@ -0,0 +1,45 @@
+// timebase.h
+
+#ifndef MAIN_TIMEBASE_H_
+#define MAIN_TIMEBASE_H_
+
+#include <stdint.h>   /**< @brief For int64_t */
+
+/**
+ * @brief Returns the current monotonic time.
+ *
+ * All samples and events are timestamped with this value. It has microsecond
+ * resolution, is cheap to read and is not affected by changes of the system clock.
+ *
+ * @return Microseconds since boot.
+ */
+int64_t timebase_now_us(void);
+
+/**
+ * @brief Re-reads the offset between the system clock and the monotonic time.
+ *
+ * Must be called whenever the system clock is set.
+ */
+void timebase_sync_wall(void);
+
+/**
+ * @brief Sets the wall-clock time corresponding to a monotonic time.
+ *
+ * Called by `timebase_sync_wall()` with what the system clock shows. The time
+ * received from a time server is not passed here, since the clock only reaches
+ * it gradually while it is slewed and timestamps must follow the clock.
+ *
+ * @param wall_us Wall-clock time in microseconds since the epoch.
+ * @param mono_us Monotonic time at which `wall_us` was valid.
+ */
+void timebase_set_wall(int64_t wall_us, int64_t mono_us);
+
+/**
+ * @brief Converts a monotonic timestamp to wall-clock time.
+ *
+ * @param mono_us Monotonic timestamp from `timebase_now_us()`.
+ * @return Microseconds since the epoch.
+ */
+int64_t timebase_to_wall_us(int64_t mono_us);
+
+#endif /* MAIN_TIMEBASE_H_ */
@@ -0,0 +1,115 @@
+// topics.c
+
+#include "topics.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "nvs.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static const char *TAG = "TOPICS";
+
+/** @brief NVS namespace holding the device ID override */
+#define DEVICE_NAMESPACE "device"
+
+/** @brief NVS key of the device ID override */
+#define DEVICE_ID_KEY "id"
+
+/** @brief Suffixes of the topics after the device ID, indexed by `topic_id_t` */
+static const char *const topic_suffixes[TOPIC_COUNT] = {
+    [TOPIC_INFO_ALL]                  = "/hydrapetinfo/all",
+    [TOPIC_INFO_WATER]                = "/hydrapetinfo/water",
+    [TOPIC_INFO_TIME]                 = "/hydrapetinfo/time",
+    [TOPIC_INFO_WATERTANKLEVEL]       = "/hydrapetinfo/watertanklevel",
+    [TOPIC_INFO_ALARMS]               = "/hydrapetinfo/alarms",
+    [TOPIC_INFO_ALARM]                = "/hydrapetinfo/alarm",
+    [TOPIC_INFO_RESPONSE]             = "/hydrapetinfo/response",
+    [TOPIC_INFO_STATUS]               = "/hydrapetinfo/status",
+    [TOPIC_INFO_STATE]                = "/hydrapetinfo/state",
+    [TOPIC_INFO_TELEMETRY]            = "/hydrapetinfo/telemetry",
+    [TOPIC_INFO_TELEMETRY_CBOR]       = "/hydrapetinfo/telemetry/cbor",
+    [TOPIC_INFO_TELEMETRY_BATCH]      = "/hydrapetinfo/telemetry/batch",
+    [TOPIC_INFO_TELEMETRY_CBOR_BATCH] = "/hydrapetinfo/telemetry/cbor/batch",
+    [TOPIC_UPDATE_PREFIX]             = "/update/",
+    [TOPIC_UPDATE_WILDCARD]           = "/update/#",
+};
+
+/** @brief Device ID */
+static char device_id_buf[DEVICE_ID_MAX_LEN + 1] = "hydrapet";
+
+/** @brief Topic strings, indexed by `topic_id_t` */
+static char topics[TOPIC_COUNT][TOPIC_MAX_LEN + 1];
+
+/** @brief Lengths of the topic strings, indexed by `topic_id_t` */
+static size_t topic_lens[TOPIC_COUNT];
+
+/**
+ * @brief Reads the device ID override from NVS.
+ *
+ * @return `true` if an override is set, `false` otherwise.
+ */
+static bool read_device_id_override(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(DEVICE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(device_id_buf);
+    esp_err_t err = nvs_get_str(handle, DEVICE_ID_KEY, device_id_buf, &len);
+    nvs_close(handle);
+    return err == ESP_OK && len > 1;
+}
+
+/**
+ * @brief Determines the device ID and builds all topics.
+ */
+void topics_init(void)
+{
+    if (!read_device_id_override()) {
+        uint8_t mac[6] = { 0 };
+        if (esp_efuse_mac_get_default(mac) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to read factory MAC address");
+        }
+        snprintf(device_id_buf, sizeof(device_id_buf), "hydrapet%02x%02x%02x%02x%02x%02x",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        int len = snprintf(topics[i], sizeof(topics[i]), "%s%s", device_id_buf, topic_suffixes[i]);
+        topic_lens[i] = (len < (int)sizeof(topics[i])) ? (size_t)len : sizeof(topics[i]) - 1;
+    }
+    ESP_LOGI(TAG, "Device ID: %s", device_id_buf);
+}
+
+/**
+ * @brief Returns the device ID.
+ *
+ * @return The device ID, valid for the lifetime of the program.
+ */
+const char *device_id(void)
+{
+    return device_id_buf;
+}
+
+/**
+ * @brief Returns a topic of the device.
+ *
+ * @param id The topic.
+ * @return The topic string, valid for the lifetime of the program.
+ */
+const char *topic_get(topic_id_t id)
+{
+    return topics[id];
+}
+
+/**
+ * @brief Returns the length of a topic of the device.
+ *
+ * @param id The topic.
+ * @return Length of the topic string.
+ */
+size_t topic_len(topic_id_t id)
+{
+    return topic_lens[id];
+}
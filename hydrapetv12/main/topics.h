@@ -0,0 +1,71 @@
+// topics.h
+
+#ifndef MAIN_TOPICS_H_
+#define MAIN_TOPICS_H_
+
+#include <stddef.h>   /**< @brief For size_t */
+
+/** @brief Maximum length of the device ID, without the terminating NUL */
+#define DEVICE_ID_MAX_LEN 31
+
+/** @brief Maximum length of a topic, without the terminating NUL */
+#define TOPIC_MAX_LEN 71
+
+/**
+ * @brief MQTT topics of the device, built once by `topics_init()`.
+ *
+ * The comments show each topic for the device ID "hydrapet0001".
+ */
+typedef enum {
+    TOPIC_INFO_ALL,                  /**< @brief hydrapet0001/hydrapetinfo/all */
+    TOPIC_INFO_WATER,                /**< @brief hydrapet0001/hydrapetinfo/water */
+    TOPIC_INFO_TIME,                 /**< @brief hydrapet0001/hydrapetinfo/time */
+    TOPIC_INFO_WATERTANKLEVEL,       /**< @brief hydrapet0001/hydrapetinfo/watertanklevel */
+    TOPIC_INFO_ALARMS,               /**< @brief hydrapet0001/hydrapetinfo/alarms */
+    TOPIC_INFO_ALARM,                /**< @brief hydrapet0001/hydrapetinfo/alarm */
+    TOPIC_INFO_RESPONSE,             /**< @brief hydrapet0001/hydrapetinfo/response */
+    TOPIC_INFO_STATUS,               /**< @brief hydrapet0001/hydrapetinfo/status, retained "online" or "offline" */
+    TOPIC_INFO_STATE,                /**< @brief hydrapet0001/hydrapetinfo/state, retained state snapshot */
+    TOPIC_INFO_TELEMETRY,            /**< @brief hydrapet0001/hydrapetinfo/telemetry */
+    TOPIC_INFO_TELEMETRY_CBOR,       /**< @brief hydrapet0001/hydrapetinfo/telemetry/cbor */
+    TOPIC_INFO_TELEMETRY_BATCH,      /**< @brief hydrapet0001/hydrapetinfo/telemetry/batch */
+    TOPIC_INFO_TELEMETRY_CBOR_BATCH, /**< @brief hydrapet0001/hydrapetinfo/telemetry/cbor/batch */
+    TOPIC_UPDATE_PREFIX,             /**< @brief hydrapet0001/update/, prefix of all command topics */
+    TOPIC_UPDATE_WILDCARD,           /**< @brief hydrapet0001/update/#, subscription to all commands */
+    TOPIC_COUNT,                     /**< @brief Number of topics */
+} topic_id_t;
+
+/**
+ * @brief Determines the device ID and builds all topics.
+ *
+ * The device ID is read from the "id" key of the "device" NVS namespace if set,
+ * so existing units can keep their ID, and otherwise derived from the factory
+ * MAC address as "hydrapet" followed by 12 hex digits. Must be called after NVS
+ * is initialized and before any topic is used.
+ */
+void topics_init(void);
+
+/**
+ * @brief Returns the device ID.
+ *
+ * @return The device ID, valid for the lifetime of the program.
+ */
+const char *device_id(void);
+
+/**
+ * @brief Returns a topic of the device.
+ *
+ * @param id The topic.
+ * @return The topic string, valid for the lifetime of the program.
+ */
+const char *topic_get(topic_id_t id);
+
+/**
+ * @brief Returns the length of a topic of the device.
+ *
+ * @param id The topic.
+ * @return Length of the topic string.
+ */
+size_t topic_len(topic_id_t id);
+
+#endif /* MAIN_TOPICS_H_ */
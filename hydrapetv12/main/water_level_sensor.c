@@ -2,12 +2,12 @@
 
 #include "water_level_sensor.h"
 #include "led.h"
-#include "wifi.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "hx711.h"
 #include "mqtt.h"
+#include "topics.h"
 #include "esp_log.h"
 #include <errno.h>
 
@@ -50,16 +50,16 @@ void water_level_sensor_init(void)
  * @brief Publishes the current water tank level status via MQTT.
  *
  * This function checks the state of the water level sensor and publishes an appropriate
- * message to the MQTT topic `hydrapet0001/hydrapetinfo/watertanklevel`.
+ * message to the MQTT topic `<device_id>/hydrapetinfo/watertanklevel`.
  *
  * @note The payload is a simple string indicating whether the water level is below 30% or full.
  */
 void mqtt_publish_water_tank_level(void) {
     if (water_level_sensor_state() == 1) {
-        mqtt_publish("hydrapet0001/hydrapetinfo/watertanklevel", "Below 30%");
+        mqtt_publish(PUBLISH_CLASS_ALARM, topic_get(TOPIC_INFO_WATERTANKLEVEL), "Below 30%");
     }
     else {
-        mqtt_publish("hydrapet0001/hydrapetinfo/watertanklevel", "Water tank is full");
+        mqtt_publish(PUBLISH_CLASS_ALARM, topic_get(TOPIC_INFO_WATERTANKLEVEL), "Water tank is full");
     }
 }
 
@@ -68,8 +68,8 @@ void mqtt_publish_water_tank_level(void) {
  *
  * This task continuously monitors the water level sensor state. When a transition
  * from high to low is detected (indicating that the water level has dropped below 30%),
- * it logs the event, attempts to reconnect to Wi-Fi if disconnected, blinks an LED for
- * visual feedback, and publishes the water tank level status via MQTT.
+ * it logs the event, blinks an LED for visual feedback, and publishes the water tank
+ * level status via MQTT, queued until the broker is reachable.
  *
  * @param pvParameters Pointer to task parameters (unused).
  */
@@ -83,14 +83,7 @@ void water_level_sensor_task(void *pvParameters)
         {
             // Water level has dropped below 30% (falling edge detected)
             ESP_LOGI(TAG, "Water level is below 30 percent");
-            
-            if(!is_wifi_connected())
-            {
-                ESP_LOGW(TAG, "Wi-Fi is not connected! (trying to connect again)");
-                while(!wifi_reconnect()){
-                     vTaskDelay(pdMS_TO_TICKS(200));
-                }
-            }
+
             led_blink_once();
 
             mqtt_publish_water_tank_level();
@@ -29,7 +29,7 @@ void water_level_sensor_init(void);
  * @brief Publishes the current water tank level status via MQTT.
  *
  * This function checks the state of the water level sensor and publishes an appropriate
- * message to the MQTT topic `hydrapet0001/hydrapetinfo/watertanklevel`.
+ * message to the MQTT topic `<device_id>/hydrapetinfo/watertanklevel`.
  *
  * @note The payload is a simple string indicating whether the water level is below 30% or full.
  */
@@ -40,8 +40,8 @@ void mqtt_publish_water_tank_level(void);
  *
  * This task continuously monitors the water level sensor state. When a transition
  * from high to low is detected (indicating that the water level has dropped below 30%),
- * it logs the event, attempts to reconnect to Wi-Fi if disconnected, blinks an LED for
- * visual feedback, and publishes the water tank level status via MQTT.
+ * it logs the event, blinks an LED for visual feedback, and publishes the water tank
+ * level status via MQTT, queued until the broker is reachable.
  *
  * @param pvParameters Pointer to task parameters (unused).
  */
@@ -4,51 +4,109 @@
 #include "esp_log.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
-#include "nvs_flash.h"
-#include "led.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "connectivity.h"
 #include "config.h"
 #include <string.h>
 
 static const char *TAG = "WIFI";
 
-static bool s_connected = false;
-static bool s_connect_attempt = false;
+/**
+ * @brief States of the connection manager.
+ */
+typedef enum {
+    WIFI_STATE_STOPPED,      /**< @brief Not started yet */
+    WIFI_STATE_CONNECTING,   /**< @brief Association or DHCP in progress */
+    WIFI_STATE_CONNECTED,    /**< @brief Associated with an IP address */
+    WIFI_STATE_BACKOFF,      /**< @brief Waiting before the next attempt */
+} wifi_state_t;
+
+/** @brief Current state, guarded by `state_lock` */
+static wifi_state_t state = WIFI_STATE_STOPPED;
 
-#define EXAMPLE_ESP_MAXIMUM_RETRY  10                /**< @brief Maximum number of connection retries */
+/** @brief Failed attempts since the last connection, guarded by `state_lock` */
+static uint32_t failed_attempts = 0;
 
-static int s_retry_num = 0;
-static EventGroupHandle_t s_wifi_event_group;
-#define WIFI_CONNECTED_BIT BIT0                      /**< @brief Event bit for successful connection */
-#define WIFI_FAIL_BIT      BIT1                      /**< @brief Event bit for failed connection */
+/** @brief Spinlock guarding the state, changed from the event loop, the retry timer and callers of `wifi_reconnect()` */
+static portMUX_TYPE state_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief One-shot timer starting the next attempt once the backoff delay elapsed */
+static esp_timer_handle_t retry_timer = NULL;
+
+/**
+ * @brief Returns the delay before the next attempt after some failed attempts.
+ *
+ * The delay doubles with each failure from `WIFI_RETRY_MIN_MS` up to
+ * `WIFI_RETRY_MAX_MS`, and a random half of it is dropped so that devices
+ * losing the same access point do not retry in lockstep.
+ *
+ * @param attempts Number of failed attempts, at least 1.
+ * @return Delay in milliseconds.
+ */
+static uint32_t backoff_delay_ms(uint32_t attempts)
+{
+    uint32_t delay_ms = WIFI_RETRY_MAX_MS;
+    if (attempts - 1 < 31 && ((uint32_t)WIFI_RETRY_MIN_MS << (attempts - 1)) < WIFI_RETRY_MAX_MS) {
+        delay_ms = (uint32_t)WIFI_RETRY_MIN_MS << (attempts - 1);
+    }
+    return delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+}
 
-/** @brief Variable to track the Wi-Fi connection status */
-static bool wifi_connected = false;
+/**
+ * @brief Counts a failed attempt and schedules the next one after the backoff delay.
+ *
+ * @return Number of failed attempts since the last connection.
+ */
+static uint32_t schedule_retry(void)
+{
+    taskENTER_CRITICAL(&state_lock);
+    uint32_t attempts = ++failed_attempts;
+    state = WIFI_STATE_BACKOFF;
+    taskEXIT_CRITICAL(&state_lock);
+
+    uint32_t delay_ms = backoff_delay_ms(attempts);
+    ESP_LOGI(TAG, "Next connection attempt in %lu ms", (unsigned long)delay_ms);
+    esp_timer_stop(retry_timer);
+    esp_timer_start_once(retry_timer, (uint64_t)delay_ms * 1000);
+    return attempts;
+}
 
 /**
- * @brief Checks if the device is currently connected to Wi-Fi.
+ * @brief Starts a connection attempt.
  *
- * @return `true` if connected, `false` otherwise.
+ * Called from the event loop and the retry timer, never blocks.
  */
-bool is_wifi_connected(void)
+static void start_attempt(void)
 {
-    return wifi_connected;
+    taskENTER_CRITICAL(&state_lock);
+    state = WIFI_STATE_CONNECTING;
+    taskEXIT_CRITICAL(&state_lock);
+
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        // No disconnection event follows an attempt that did not start
+        ESP_LOGW(TAG, "Failed to start a connection attempt: %s", esp_err_to_name(err));
+        schedule_retry();
+    }
 }
 
 /**
- * @brief Sets the Wi-Fi connection status.
+ * @brief Callback of the retry timer, starting the next attempt.
  *
- * @param is_conn `true` to mark as connected, `false` otherwise.
+ * @param arg Timer argument (unused).
  */
-void set_is_wifi_connected(bool is_conn)
+static void retry_timer_cb(void *arg)
 {
-    wifi_connected = is_conn;
+    start_attempt();
 }
 
 /**
  * @brief Handles Wi-Fi and IP events.
  *
- * This function is called by the ESP-IDF event loop upon various Wi-Fi and IP events.
- * It manages connection attempts, retries, and updates the connection status accordingly.
+ * Runs in the default event loop task. A lost or failed connection schedules the
+ * next attempt on the retry timer, so no task waits for the network.
  *
  * @param arg Argument passed to the handler.
  * @param event_base The base of the event (e.g., WIFI_EVENT, IP_EVENT).
@@ -59,46 +117,67 @@ static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data)
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        esp_wifi_connect();
-        s_connect_attempt = true;
+        start_attempt();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        connectivity_set(CONNECTIVITY_LINK_UP);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "Attempting to reconnect to AP (%d)", s_retry_num);
-        } else {
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
-        }
-        ESP_LOGI(TAG,"Connection fail");
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *) event_data;
+        connectivity_clear(CONNECTIVITY_LINK_UP | CONNECTIVITY_IP_ACQUIRED);
+        uint32_t attempts = schedule_retry();
+        ESP_LOGW(TAG, "Disconnected (reason %d), %lu failed attempts", event->reason, (unsigned long)attempts);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "IP: " IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        s_connected = true;
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+
+        taskENTER_CRITICAL(&state_lock);
+        failed_attempts = 0;
+        state = WIFI_STATE_CONNECTED;
+        taskEXIT_CRITICAL(&state_lock);
+        connectivity_set(CONNECTIVITY_IP_ACQUIRED);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        // Still associated; DHCP gets a new address without reconnecting
+        ESP_LOGW(TAG, "IP address lost");
+        connectivity_clear(CONNECTIVITY_IP_ACQUIRED);
     }
 }
 
 /**
- * @brief Initializes the Wi-Fi in station mode and attempts to connect to the specified network.
- *
- * This function initializes NVS flash, sets up the Wi-Fi event handlers, configures the Wi-Fi
- * settings (SSID and password), and starts the Wi-Fi connection process. It waits for a
- * successful connection or a failure based on the maximum number of retries.
+ * @brief Asks for a connection attempt now instead of at the end of the backoff delay.
+ */
+void wifi_reconnect(void)
+{
+    taskENTER_CRITICAL(&state_lock);
+    bool waiting = (state == WIFI_STATE_BACKOFF);
+    if (waiting) {
+        failed_attempts = 0;
+    }
+    taskEXIT_CRITICAL(&state_lock);
+
+    if (waiting) {
+        ESP_LOGI(TAG, "Trying to connect to Wi-Fi again");
+        // Attempt from the timer task, like scheduled attempts
+        esp_timer_stop(retry_timer);
+        esp_timer_start_once(retry_timer, 0);
+    }
+}
+
+/**
+ * @brief Starts the Wi-Fi station and its connection manager.
  *
- * @return `true` if the connection was successful, `false` otherwise.
+ * Returns at once; the connection is made in the background and retried forever.
  */
-bool wifi_init_sta(void)
+void wifi_init(void)
 {
-    esp_err_t ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES ||
-        ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
+    if (retry_timer != NULL) {
+        ESP_LOGW(TAG, "Wi-Fi already started");
+        return;
     }
-    ESP_ERROR_CHECK(ret);
 
-    s_wifi_event_group = xEventGroupCreate();
+    const esp_timer_create_args_t timer_args = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &retry_timer));
 
     ESP_ERROR_CHECK(esp_netif_init());
 
@@ -110,19 +189,21 @@ bool wifi_init_sta(void)
 
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
                                                         ESP_EVENT_ANY_ID,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_any_id));
+                                                        NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
                                                         IP_EVENT_STA_GOT_IP,
                                                         &event_handler,
                                                         NULL,
-                                                        &instance_got_ip));
+                                                        NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_LOST_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        NULL));
 
     wifi_config_t wifi_config = {
         .sta = {
@@ -134,83 +215,8 @@ bool wifi_init_sta(void)
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA) );
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config) );
+    // The first attempt starts on WIFI_EVENT_STA_START
     ESP_ERROR_CHECK(esp_wifi_start() );
 
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    // Wait for connection
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            pdMS_TO_TICKS(10000)); // Timeout 10 seconds
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Wi-Fi connected!");
-        return true;
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to Wi-Fi");
-        return false;
-    } else {
-        ESP_LOGE(TAG, "Timeout waiting for a Wi-Fi connection");
-        return false;
-    }
-}
-
-/**
- * @brief Attempts to reconnect to the Wi-Fi network.
- *
- * This function resets the retry counter and initiates a new connection attempt.
- * It waits for a successful connection or a failure based on the maximum number of retries.
- *
- * @return `true` if the reconnection was successful, `false` otherwise.
- */
-bool wifi_reconnect(void)
-{
-    ESP_LOGI(TAG, "Trying to connect to Wi-Fi again");
-    s_retry_num = 0;
-    esp_wifi_connect();
-
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-            pdFALSE,
-            pdFALSE,
-            pdMS_TO_TICKS(10000)); // Timeout 10 seconds
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "Connected to Wi-Fi (retrying)");
-        return true;
-    } else {
-        ESP_LOGI(TAG, "Failed to connect to Wi-Fi (retrying)");
-        return false;
-    }
-}
-
-/**
- * @brief Initializes the Wi-Fi connection process.
- *
- * This function attempts to initialize and connect to the Wi-Fi network. If the initial
- * connection fails, it enters a loop to retry the connection, blinking the LED as feedback.
- * After a certain number of failed attempts, it halts the system.
- */
-void wifi_init(void){        
-    set_is_wifi_connected( wifi_init_sta() );
-    
-    int i=0;
-    // Check if Wi-Fi connection was successful
-    while(!is_wifi_connected())
-    {
-        ESP_LOGW(TAG, "Connection not established, trying again...");
-        set_is_wifi_connected( wifi_init_sta() );
-        
-        vTaskDelay(pdMS_TO_TICKS(1000));
-        led_blink_once();
-        if(i > 10)
-        {
-            i++;
-            while(1){
-                ; // Halt the system
-            }
-        }
-    }
+    ESP_LOGI(TAG, "Wi-Fi started, connecting to %s", EXAMPLE_ESP_WIFI_SSID);
 }
@@ -4,47 +4,23 @@
 #include <stdbool.h>
 
 /**
- * @brief Initializes the Wi-Fi in station mode and attempts to connect to the specified network.
+ * @brief Starts the Wi-Fi station and its connection manager.
  *
- * This function initializes NVS flash, sets up the Wi-Fi event handlers, configures the Wi-Fi
- * settings (SSID and password), and starts the Wi-Fi connection process. It waits for a
- * successful connection or a failure based on the maximum number of retries.
- *
- * @return `true` if the connection was successful, `false` otherwise.
- */
-bool wifi_init_sta(void);
-
-/**
- * @brief Attempts to reconnect to the Wi-Fi network.
- *
- * This function resets the retry counter and initiates a new connection attempt.
- * It waits for a successful connection or a failure based on the maximum number of retries.
- *
- * @return `true` if the reconnection was successful, `false` otherwise.
- */
-bool wifi_reconnect(void);
-
-/**
- * @brief Checks if the device is currently connected to Wi-Fi.
- *
- * @return `true` if connected, `false` otherwise.
- */
-bool is_wifi_connected(void);
-
-/**
- * @brief Sets the Wi-Fi connection status.
- *
- * @param is_conn `true` to mark as connected, `false` otherwise.
+ * Initializes the network interface, the default event loop and the Wi-Fi driver
+ * once, and returns at once without waiting for a connection. The connection is
+ * made in the background; after each failure the next attempt waits an exponential
+ * backoff delay between `WIFI_RETRY_MIN_MS` and `WIFI_RETRY_MAX_MS` with random
+ * jitter, forever. The state is published through the `CONNECTIVITY_LINK_UP` and
+ * `CONNECTIVITY_IP_ACQUIRED` bits. Expects NVS and `connectivity_init()` to be initialized.
  */
-void set_is_wifi_connected(bool is_conn);
+void wifi_init(void);
 
 /**
- * @brief Initializes the Wi-Fi connection process.
+ * @brief Asks for a connection attempt now instead of at the end of the backoff delay.
  *
- * This function attempts to initialize and connect to the Wi-Fi network. If the initial
- * connection fails, it enters a loop to retry the connection, blinking the LED as feedback.
- * After a certain number of failed attempts, it halts the system.
+ * Does not wait for the attempt; wait for `CONNECTIVITY_IP_ACQUIRED` with
+ * `connectivity_wait()` instead.
  */
-void wifi_init(void);
+void wifi_reconnect(void);
 
 #endif // WIFI_H
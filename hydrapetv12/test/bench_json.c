@@ -0,0 +1,142 @@
+// bench_json.c
+//
+// Benchmark of the JSON tokenizer against the sscanf pattern it replaced in the
+// command handlers. Both read the same `set_alarm` payload; the results are checked
+// to agree before timing, and the tokenizer is checked to accept the reordered and
+// spaced payloads the pattern rejects. Timings are printed, not asserted; build with
+// -DHOST_TEST_SANITIZE=OFF -DCMAKE_BUILD_TYPE=Release for meaningful numbers. Usage:
+//   bench_json [iterations]
+
+#include "host_test.h"
+#include "json.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Default number of parses timed per parser */
+#define BENCH_DEFAULT_ITERATIONS 1000000
+
+/** @brief Size of the token pool, as `MQTT_JSON_MAX_TOKENS` bounds the handler's */
+#define BENCH_MAX_TOKENS 32
+
+/** @brief Payload both parsers read, in the only layout the pattern accepts */
+static const char payload[] = "{\"timestamp\": \"2025-01-20T07:30:00\", \"target_weight\": 200}";
+
+/** @brief Payloads only the tokenizer reads: keys reordered, spaced or with extra fields */
+static const char *const variants[] = {
+    "{\"target_weight\": 200, \"timestamp\": \"2025-01-20T07:30:00\"}",
+    "{ \"timestamp\" : \"2025-01-20T07:30:00\" ,\n  \"target_weight\" : 200 }",
+    "{\"id\":\"r7\",\"timestamp\":\"2025-01-20T07:30:00\",\"target_weight\":200,\"repeat_days\":0}",
+};
+
+/** @brief Sink for the results, so the timed loops are not optimized out */
+static volatile int64_t sink;
+
+/**
+ * @brief Reads the fields of a payload with the sscanf pattern of the former handler.
+ *
+ * @param json The payload, NUL-terminated as the pattern requires.
+ * @param timestamp Buffer of 25 bytes receiving the timestamp.
+ * @param weight Pointer where the target weight is stored.
+ * @return `true` if both fields were read.
+ */
+static bool read_sscanf(const char *json, char *timestamp, int64_t *weight)
+{
+    int value;
+    if (sscanf(json, "{\"timestamp\": \"%24[^\"]\", \"target_weight\": %d}", timestamp, &value) != 2) {
+        return false;
+    }
+    *weight = value;
+    return true;
+}
+
+/**
+ * @brief Reads the fields of a payload with the tokenizer, as the command handlers do.
+ *
+ * @param json The payload.
+ * @param len Length of the payload.
+ * @param timestamp Buffer of 25 bytes receiving the timestamp.
+ * @param weight Pointer where the target weight is stored.
+ * @return `true` if both fields were read.
+ */
+static bool read_tokenizer(const char *json, size_t len, char *timestamp, int64_t *weight)
+{
+    json_token_t tokens[BENCH_MAX_TOKENS];
+    json_doc_t doc;
+    const char *str;
+    size_t str_len;
+    if (json_parse(&doc, json, len, tokens, BENCH_MAX_TOKENS) < 0
+        || !json_object_get_string(&doc, 0, "timestamp", &str, &str_len) || str_len > 24
+        || !json_object_get_int(&doc, 0, "target_weight", weight)) {
+        return false;
+    }
+    memcpy(timestamp, str, str_len);
+    timestamp[str_len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Returns the monotonic time.
+ *
+ * @return Time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** @brief Number of parses timed per parser */
+static unsigned long iterations = BENCH_DEFAULT_ITERATIONS;
+
+static void test_parsers_agree(void)
+{
+    char expected[25];
+    char timestamp[25];
+    int64_t expected_weight;
+    int64_t weight;
+
+    TEST_CHECK(read_sscanf(payload, expected, &expected_weight));
+    TEST_CHECK(read_tokenizer(payload, strlen(payload), timestamp, &weight));
+    TEST_CHECK(strcmp(timestamp, expected) == 0 && weight == expected_weight);
+
+    for (size_t i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+        TEST_CHECK(!read_sscanf(variants[i], timestamp, &weight));
+        TEST_CHECK(read_tokenizer(variants[i], strlen(variants[i]), timestamp, &weight));
+        TEST_CHECK(strcmp(timestamp, expected) == 0 && weight == expected_weight);
+    }
+}
+
+static void bench_parsers(void)
+{
+    char timestamp[25];
+    int64_t weight;
+    size_t len = strlen(payload);
+
+    double start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += read_sscanf(payload, timestamp, &weight) + weight;
+    }
+    double sscanf_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += read_tokenizer(payload, len, timestamp, &weight) + weight;
+    }
+    double tokenizer_ns = (now_ns() - start) / iterations;
+
+    printf("set_alarm payload: sscanf %.0f ns, tokenizer and lookups %.0f ns per parse\n",
+           sscanf_ns, tokenizer_ns);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+
+    RUN_TEST(test_parsers_agree);
+    RUN_TEST(bench_parsers);
+    return 0;
+}
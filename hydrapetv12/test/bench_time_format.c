@@ -0,0 +1,157 @@
+// bench_time_format.c
+//
+// Benchmark of the cached ISO-8601 formatter and parser against localtime_r() plus
+// snprintf() and sscanf(), which they replaced. The formatter output is checked
+// against snprintf() over 400 days in a zone with daylight saving time, and the
+// parser against the fields it came from, before timing. Timings are printed, not
+// asserted; build with -DHOST_TEST_SANITIZE=OFF -DCMAKE_BUILD_TYPE=Release for
+// meaningful numbers. Usage:
+//   bench_time_format [iterations]
+
+#include "host_test.h"
+#include "time_format.h"
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/** @brief Default number of calls timed per implementation */
+#define BENCH_DEFAULT_ITERATIONS 2000000
+
+/** @brief Zone of the tests, with daylight saving changes */
+#define BENCH_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
+/** @brief First time checked and timed */
+#define BENCH_START_TIME 1700000000
+
+/** @brief Size of the snprintf() buffers, room for any `int` fields as the compiler checks */
+#define BENCH_SNPRINTF_SIZE 80
+
+/** @brief Timestamp parsed by the timed loops */
+static const char timestamp[] = "2025-01-20T07:30:15";
+
+/** @brief Sink for the results, so the timed loops are not optimized out */
+static volatile size_t sink;
+
+/**
+ * @brief Formats a time with localtime_r() and snprintf(), as done before the formatter.
+ *
+ * @param t Time in seconds since the epoch.
+ * @param buf Output buffer of `BENCH_SNPRINTF_SIZE` bytes.
+ * @return Number of characters written, excluding the terminating NUL.
+ */
+static size_t format_snprintf(time_t t, char *buf)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    return (size_t)snprintf(buf, BENCH_SNPRINTF_SIZE, "%04d-%02d-%02dT%02d:%02d:%02d",
+                            tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+                            tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+/**
+ * @brief Returns the monotonic time.
+ *
+ * @return Time in nanoseconds.
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/** @brief Number of calls timed per implementation */
+static unsigned long iterations = BENCH_DEFAULT_ITERATIONS;
+
+static void test_format_matches_snprintf(void)
+{
+    char expected[BENCH_SNPRINTF_SIZE];
+    char buf[TIME_FORMAT_ISO_SIZE];
+
+    // Every 37 s over 400 days crosses both daylight saving changes and a new year
+    for (time_t t = BENCH_START_TIME; t < BENCH_START_TIME + 400 * 86400; t += 37) {
+        struct tm tm;
+        localtime_r(&t, &tm);
+        format_snprintf(t, expected);
+        TEST_CHECK(time_format_iso(t, buf) == TIME_FORMAT_ISO_LEN);
+        TEST_CHECK(strcmp(buf, expected) == 0);
+
+        struct tm parsed;
+        const char *end;
+        TEST_CHECK(time_parse_iso(buf, TIME_FORMAT_ISO_LEN, &parsed, &end));
+        TEST_CHECK(end == buf + TIME_FORMAT_ISO_LEN);
+        TEST_CHECK(parsed.tm_year == tm.tm_year && parsed.tm_mon == tm.tm_mon);
+        TEST_CHECK(parsed.tm_mday == tm.tm_mday && parsed.tm_hour == tm.tm_hour);
+        TEST_CHECK(parsed.tm_min == tm.tm_min && parsed.tm_sec == tm.tm_sec);
+    }
+}
+
+static void test_parse_like_sscanf(void)
+{
+    static const char loose[] = "2025-1-5T7:0:0\"";
+    struct tm tm;
+    const char *end;
+
+    // Fields without leading zeros are still accepted, out-of-range ones are not
+    TEST_CHECK(time_parse_iso(loose, sizeof(loose) - 1, &tm, &end));
+    TEST_CHECK(tm.tm_year == 125 && tm.tm_mon == 0 && tm.tm_mday == 5 && tm.tm_hour == 7);
+    TEST_CHECK(*end == '"');
+    TEST_CHECK(!time_parse_iso("2025-13-05T07:00:00", 19, &tm, NULL));
+    TEST_CHECK(!time_parse_iso("abc", 3, &tm, NULL));
+}
+
+static void bench_format(void)
+{
+    char buf[BENCH_SNPRINTF_SIZE];
+
+    // 50 calls per second of clock, as when a burst of telemetry is stamped
+    double start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += format_snprintf(BENCH_START_TIME + i / 50, buf);
+    }
+    double snprintf_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += time_format_iso(BENCH_START_TIME + i / 50, buf);
+    }
+    double cached_ns = (now_ns() - start) / iterations;
+
+    printf("format: localtime_r and snprintf %.0f ns, time_format_iso %.0f ns per call\n",
+           snprintf_ns, cached_ns);
+}
+
+static void bench_parse(void)
+{
+    struct tm tm;
+
+    double start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += sscanf(timestamp, "%d-%d-%dT%d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                       &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+    }
+    double sscanf_ns = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (unsigned long i = 0; i < iterations; i++) {
+        sink += time_parse_iso(timestamp, sizeof(timestamp) - 1, &tm, NULL);
+    }
+    double parser_ns = (now_ns() - start) / iterations;
+
+    printf("parse: sscanf %.0f ns, time_parse_iso %.0f ns per call\n", sscanf_ns, parser_ns);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    setenv("TZ", BENCH_TZ, 1);
+    tzset();
+
+    RUN_TEST(test_format_matches_snprintf);
+    RUN_TEST(test_parse_like_sscanf);
+    RUN_TEST(bench_format);
+    RUN_TEST(bench_parse);
+    return 0;
+}
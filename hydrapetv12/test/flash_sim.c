@@ -0,0 +1,69 @@
+// flash_sim.c
+
+#include "flash_sim.h"
+#include "esp_partition.h"
+#include "host_test.h"
+#include <string.h>
+
+/** @brief Contents of the simulated partition */
+static uint8_t flash[FLASH_SIM_MAX_SIZE];
+
+/** @brief The simulated partition */
+static esp_partition_t partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_ANY,
+    .label = "telemetry",
+};
+
+/** @brief Number of sector erases since the last reset */
+static uint32_t erase_count = 0;
+
+void flash_sim_reset(size_t size)
+{
+    TEST_CHECK(size <= sizeof(flash) && size % FLASH_SIM_SECTOR_SIZE == 0);
+    memset(flash, 0xFF, sizeof(flash));
+    partition.size = size;
+    erase_count = 0;
+}
+
+uint8_t *flash_sim_data(void)
+{
+    return flash;
+}
+
+uint32_t flash_sim_erase_count(void)
+{
+    return erase_count;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    return (partition.size > 0 && strcmp(label, partition.label) == 0) ? &partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    TEST_CHECK(part == &partition && offset + size <= partition.size);
+    memcpy(dst, flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    TEST_CHECK(part == &partition && offset + size <= partition.size);
+    const uint8_t *bytes = src;
+    for (size_t i = 0; i < size; i++) {
+        flash[offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    TEST_CHECK(part == &partition && offset % FLASH_SIM_SECTOR_SIZE == 0 && size % FLASH_SIM_SECTOR_SIZE == 0);
+    TEST_CHECK(offset + size <= partition.size);
+    memset(flash + offset, 0xFF, size);
+    erase_count += size / FLASH_SIM_SECTOR_SIZE;
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+// flash_sim.h
+
+#ifndef TEST_FLASH_SIM_H_
+#define TEST_FLASH_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Size of a simulated flash sector */
+#define FLASH_SIM_SECTOR_SIZE 4096
+
+/** @brief Largest simulated partition */
+#define FLASH_SIM_MAX_SIZE (16 * FLASH_SIM_SECTOR_SIZE)
+
+/**
+ * @brief Erases the simulated partition and sets its size.
+ *
+ * The partition behaves like NOR flash: erasing sets whole sectors to 0xFF and
+ * writing can only clear bits.
+ *
+ * @param size Size of the partition in bytes, a multiple of the sector size.
+ */
+void flash_sim_reset(size_t size);
+
+/**
+ * @brief Gives direct access to the simulated flash, e.g. to tear a record.
+ *
+ * @return Pointer to the first byte of the partition.
+ */
+uint8_t *flash_sim_data(void);
+
+/**
+ * @brief Returns the number of sector erases since the last reset.
+ *
+ * @return Number of erased sectors.
+ */
+uint32_t flash_sim_erase_count(void);
+
+#endif /* TEST_FLASH_SIM_H_ */
@@ -0,0 +1,25 @@
+// host_test.h
+
+#ifndef TEST_HOST_TEST_H_
+#define TEST_HOST_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/** @brief Fails the test with the location and condition unless `cond` holds */
+#define TEST_CHECK(cond)                                                            \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE);                                                     \
+        }                                                                           \
+    } while (0)
+
+/** @brief Runs one test case, announcing it so a failure points to it */
+#define RUN_TEST(fn)                     \
+    do {                                 \
+        printf("=== %s\n", #fn);         \
+        fn();                            \
+    } while (0)
+
+#endif /* TEST_HOST_TEST_H_ */
@@ -0,0 +1,11 @@
+// esp_bit_defs.h
+
+#ifndef TEST_STUBS_ESP_BIT_DEFS_H_
+#define TEST_STUBS_ESP_BIT_DEFS_H_
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+
+#endif /* TEST_STUBS_ESP_BIT_DEFS_H_ */
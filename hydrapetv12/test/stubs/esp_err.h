@@ -0,0 +1,28 @@
+// esp_err.h
+
+#ifndef TEST_STUBS_ESP_ERR_H_
+#define TEST_STUBS_ESP_ERR_H_
+
+#include <stdint.h>
+
+/** @brief Error code of the ESP-IDF APIs */
+typedef int esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_NVS_BASE        0x1100
+#define ESP_ERR_NVS_NOT_FOUND   (ESP_ERR_NVS_BASE + 0x02)
+
+/**
+ * @brief Returns the name of an error code.
+ *
+ * @param code Error code.
+ * @return Name of the code.
+ */
+const char *esp_err_to_name(esp_err_t code);
+
+#endif /* TEST_STUBS_ESP_ERR_H_ */
@@ -0,0 +1,14 @@
+// esp_event.h
+
+#ifndef TEST_STUBS_ESP_EVENT_H_
+#define TEST_STUBS_ESP_EVENT_H_
+
+#include <stdint.h>
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id,
+                                    void *event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+#endif /* TEST_STUBS_ESP_EVENT_H_ */
@@ -0,0 +1,18 @@
+// esp_log.h
+
+#ifndef TEST_STUBS_ESP_LOG_H_
+#define TEST_STUBS_ESP_LOG_H_
+
+#include <stdio.h>
+#include "esp_err.h"
+
+/** @brief Logs to stdout with the level and tag, like the ESP-IDF console */
+#define HOST_LOG(level, tag, fmt, ...) printf(level " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) HOST_LOG("I", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+#define ESP_LOGV(tag, fmt, ...) ((void)(tag))
+
+#endif /* TEST_STUBS_ESP_LOG_H_ */
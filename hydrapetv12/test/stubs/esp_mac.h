@@ -0,0 +1,11 @@
+// esp_mac.h
+
+#ifndef TEST_STUBS_ESP_MAC_H_
+#define TEST_STUBS_ESP_MAC_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac);
+
+#endif /* TEST_STUBS_ESP_MAC_H_ */
@@ -0,0 +1,23 @@
+// esp_netif_sntp.h
+
+#ifndef TEST_STUBS_ESP_NETIF_SNTP_H_
+#define TEST_STUBS_ESP_NETIF_SNTP_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "esp_sntp.h"
+
+/**
+ * @brief Configuration of the SNTP client, with the fields set by the firmware.
+ */
+typedef struct {
+    bool smooth_sync;              /**< @brief Slew the clock with `adjtime()` rather than step it */
+    sntp_sync_time_cb_t sync_cb;   /**< @brief Called after each sync */
+    const char *servers[1];        /**< @brief Time servers */
+} esp_sntp_config_t;
+
+#define ESP_NETIF_SNTP_DEFAULT_CONFIG(server) { .smooth_sync = false, .sync_cb = NULL, .servers = { server } }
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config);
+
+#endif /* TEST_STUBS_ESP_NETIF_SNTP_H_ */
@@ -0,0 +1,36 @@
+// esp_partition.h
+
+#ifndef TEST_STUBS_ESP_PARTITION_H_
+#define TEST_STUBS_ESP_PARTITION_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+/**
+ * @brief Partition found by `esp_partition_find_first()`.
+ */
+typedef struct {
+    esp_partition_type_t type;        /**< @brief Partition type */
+    esp_partition_subtype_t subtype;  /**< @brief Partition subtype */
+    uint32_t address;                 /**< @brief Offset in flash */
+    uint32_t size;                    /**< @brief Size in bytes */
+    char label[17];                   /**< @brief Label */
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+#endif /* TEST_STUBS_ESP_PARTITION_H_ */
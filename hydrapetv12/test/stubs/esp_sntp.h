@@ -0,0 +1,20 @@
+// esp_sntp.h
+
+#ifndef TEST_STUBS_ESP_SNTP_H_
+#define TEST_STUBS_ESP_SNTP_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+typedef enum {
+    SNTP_SYNC_STATUS_RESET,        /**< @brief No sync, or the last one was reported */
+    SNTP_SYNC_STATUS_COMPLETED,    /**< @brief Clock stepped or slew finished */
+    SNTP_SYNC_STATUS_IN_PROGRESS,  /**< @brief Clock being slewed */
+} sntp_sync_status_t;
+
+typedef void (*sntp_sync_time_cb_t)(struct timeval *tv);
+
+sntp_sync_status_t sntp_get_sync_status(void);
+void sntp_set_sync_interval(uint32_t interval_ms);
+
+#endif /* TEST_STUBS_ESP_SNTP_H_ */
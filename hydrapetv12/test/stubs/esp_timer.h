@@ -0,0 +1,30 @@
+// esp_timer.h
+//
+// The part of the esp_timer API used by the firmware. The functions are defined by
+// each test, which drives the monotonic clock and the timers itself.
+
+#ifndef TEST_STUBS_ESP_TIMER_H_
+#define TEST_STUBS_ESP_TIMER_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_timer *esp_timer_handle_t;
+
+typedef void (*esp_timer_cb_t)(void *arg);
+
+/**
+ * @brief Arguments of `esp_timer_create()`.
+ */
+typedef struct {
+    esp_timer_cb_t callback;  /**< @brief Function called when the timer expires */
+    void *arg;                /**< @brief Argument of the callback */
+    const char *name;         /**< @brief Name of the timer, for debugging */
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time(void);
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif /* TEST_STUBS_ESP_TIMER_H_ */
@@ -0,0 +1,8 @@
+// esp_transport.h
+
+#ifndef TEST_STUBS_ESP_TRANSPORT_H_
+#define TEST_STUBS_ESP_TRANSPORT_H_
+
+typedef struct esp_transport_item_t *esp_transport_handle_t;
+
+#endif /* TEST_STUBS_ESP_TRANSPORT_H_ */
@@ -0,0 +1,10 @@
+// event_groups.h
+
+#ifndef TEST_STUBS_FREERTOS_EVENT_GROUPS_H_
+#define TEST_STUBS_FREERTOS_EVENT_GROUPS_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef uint32_t EventBits_t;
+
+#endif /* TEST_STUBS_FREERTOS_EVENT_GROUPS_H_ */
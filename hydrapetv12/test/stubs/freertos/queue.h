@@ -0,0 +1,19 @@
+// queue.h
+//
+// The part of the FreeRTOS queue API used by the firmware. The functions are defined
+// by each test, which decides what a queue holds.
+
+#ifndef TEST_STUBS_FREERTOS_QUEUE_H_
+#define TEST_STUBS_FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct QueueDefinition *QueueHandle_t;
+typedef unsigned int UBaseType_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *buffer, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif /* TEST_STUBS_FREERTOS_QUEUE_H_ */
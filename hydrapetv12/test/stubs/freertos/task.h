@@ -0,0 +1,14 @@
+// task.h
+
+#ifndef TEST_STUBS_FREERTOS_TASK_H_
+#define TEST_STUBS_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct tskTaskControlBlock *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *parameters);
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *parameters,
+                       unsigned int priority, TaskHandle_t *created_task);
+
+#endif /* TEST_STUBS_FREERTOS_TASK_H_ */
@@ -0,0 +1,81 @@
+// host_stubs.c
+
+#include "esp_err.h"
+#include "nvs.h"
+#include "esp_mac.h"
+#include <string.h>
+
+/**
+ * @brief Returns the name of an error code.
+ *
+ * @param code Error code.
+ * @return Name of the code.
+ */
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        default:
+            return "ESP_FAIL";
+    }
+}
+
+/**
+ * @brief Opens an NVS namespace; host tests start without any stored settings.
+ */
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+/**
+ * @brief Reads a stored setting; none is ever found.
+ */
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+/**
+ * @brief Reads a stored string; none is ever found.
+ */
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+/**
+ * @brief Stores a setting; always fails, as no namespace can be opened.
+ */
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Commits stored settings; always fails.
+ */
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Closes an NVS handle.
+ */
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+/**
+ * @brief Reads the factory MAC address; host tests use a fixed one.
+ */
+esp_err_t esp_efuse_mac_get_default(uint8_t *mac)
+{
+    static const uint8_t host_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
@@ -0,0 +1,123 @@
+// mqtt_client.h
+//
+// The part of the esp-mqtt API used by mqtt.c. The client functions are defined by
+// each test, which records what the firmware hands to the client.
+
+#ifndef TEST_STUBS_MQTT_CLIENT_H_
+#define TEST_STUBS_MQTT_CLIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_transport.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+} esp_mqtt_event_id_t;
+
+typedef enum {
+    MQTT_PROTOCOL_UNDEFINED,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+    MQTT_PROTOCOL_V_5,
+} esp_mqtt_protocol_ver_t;
+
+/**
+ * @brief MQTT 5 properties of a received message.
+ */
+typedef struct {
+    char *response_topic;           /**< @brief Response topic, not NUL-terminated */
+    int response_topic_len;         /**< @brief Length of the response topic */
+    char *correlation_data;         /**< @brief Correlation data */
+    uint16_t correlation_data_len;  /**< @brief Length of the correlation data */
+} esp_mqtt5_event_property_t;
+
+/**
+ * @brief Event passed to the handler registered with `esp_mqtt_client_register_event()`.
+ */
+typedef struct {
+    esp_mqtt_event_id_t event_id;          /**< @brief Type of the event */
+    esp_mqtt_client_handle_t client;       /**< @brief Client of the event */
+    char *data;                            /**< @brief Payload of this fragment */
+    int data_len;                          /**< @brief Length of this fragment */
+    int total_data_len;                    /**< @brief Length of the whole payload */
+    int current_data_offset;               /**< @brief Offset of this fragment in the payload */
+    char *topic;                           /**< @brief Topic, only in the first fragment */
+    int topic_len;                         /**< @brief Length of the topic */
+    int msg_id;                            /**< @brief Message ID */
+    int session_present;                   /**< @brief Session present flag of CONNACK */
+    esp_mqtt5_event_property_t *property;  /**< @brief MQTT 5 properties, or NULL */
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+/**
+ * @brief Configuration of the client, with the fields set by mqtt.c.
+ */
+typedef struct {
+    struct {
+        struct {
+            const char *uri;
+        } address;
+    } broker;
+    struct {
+        const char *client_id;
+    } credentials;
+    struct {
+        struct {
+            const char *topic;
+            const char *msg;
+            int msg_len;
+            int qos;
+            int retain;
+        } last_will;
+        bool disable_clean_session;
+        int keepalive;
+        esp_mqtt_protocol_ver_t protocol_ver;
+    } session;
+    struct {
+        esp_transport_handle_t transport;
+    } network;
+} esp_mqtt_client_config_t;
+
+/**
+ * @brief MQTT 5 properties of the next published message.
+ */
+typedef struct {
+    const char *response_topic;     /**< @brief Response topic */
+    const char *correlation_data;   /**< @brief Correlation data */
+    uint16_t correlation_data_len;  /**< @brief Length of the correlation data */
+} esp_mqtt5_publish_property_config_t;
+
+/**
+ * @brief MQTT 5 properties of the CONNECT packet.
+ */
+typedef struct {
+    uint32_t session_expiry_interval;  /**< @brief Seconds the broker keeps the session after a disconnection */
+} esp_mqtt5_connection_property_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain);
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_publish_property_config_t *property);
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t client,
+                                                const esp_mqtt5_connection_property_config_t *property);
+
+#endif /* TEST_STUBS_MQTT_CLIENT_H_ */
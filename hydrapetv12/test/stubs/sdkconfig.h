@@ -0,0 +1,9 @@
+// sdkconfig.h
+
+#ifndef TEST_STUBS_SDKCONFIG_H_
+#define TEST_STUBS_SDKCONFIG_H_
+
+// Options the host tests depend on, such as CONFIG_MQTT_PROTOCOL_5, are set per
+// target in CMakeLists.txt
+
+#endif /* TEST_STUBS_SDKCONFIG_H_ */
@@ -0,0 +1,303 @@
+// test_mqtt5.c
+//
+// Host test of the MQTT 5 handling of mqtt.c and commands.c, built with
+// CONFIG_MQTT_PROTOCOL_5: the client is set up for MQTT 5 with a session expiry
+// interval, and the response topic and correlation data of a request reach the
+// client with its response, however the request was fragmented, without leaking
+// into the answers of later requests.
+
+#include "host_test.h"
+#include "mqtt.h"
+#include "mqtt_client.h"
+#include "mqtt_tls.h"
+#include "connectivity.h"
+#include "commands.h"
+#include "publisher.h"
+#include "alarms.h"
+#include "topics.h"
+#include "config.h"
+#include "hx711.h"
+#include "led.h"
+#include "buttons.h"
+#include "motor.h"
+#include "time_sync.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include <stdint.h>
+#include <string.h>
+
+#if !CONFIG_MQTT_PROTOCOL_5
+#error "test_mqtt5 must be built with CONFIG_MQTT_PROTOCOL_5"
+#endif
+
+/** @brief Largest payload recorded from a publish */
+#define PAYLOAD_MAX 512
+
+/**
+ * @brief MQTT client stand-in, recording what the firmware hands to it.
+ */
+static struct {
+    esp_mqtt_client_config_t config;                   /**< @brief Configuration of `esp_mqtt_client_init()` */
+    esp_mqtt5_connection_property_config_t connect;    /**< @brief Properties of the CONNECT packet */
+    bool connect_set;                                  /**< @brief Whether the CONNECT properties were set */
+    esp_event_handler_t handler;                       /**< @brief Registered event handler */
+    esp_mqtt5_publish_property_config_t publish;       /**< @brief Properties of the next publish */
+    char topic[COMMAND_RESPONSE_TOPIC_MAX_LEN + 1];    /**< @brief Topic of the last publish */
+    char payload[PAYLOAD_MAX];                         /**< @brief Payload of the last publish, NUL-terminated */
+    uint8_t correlation[COMMAND_CORRELATION_MAX_LEN];  /**< @brief Correlation data of the last publish */
+    size_t correlation_len;                            /**< @brief Length of `correlation` */
+    int published;                                     /**< @brief Number of publishes */
+} client;
+
+/**
+ * @brief Commands queue stand-in, holding the last command posted.
+ */
+static struct {
+    command_t command;  /**< @brief Command posted */
+    bool full;          /**< @brief Whether a command was posted and not yet taken */
+} queue;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    client.config = *config;
+    return (esp_mqtt_client_handle_t)&client;
+}
+
+esp_err_t esp_mqtt5_client_set_connect_property(esp_mqtt_client_handle_t handle,
+                                                const esp_mqtt5_connection_property_config_t *property)
+{
+    client.connect = *property;
+    client.connect_set = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t handle, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client.handler = event_handler;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt5_client_set_publish_property(esp_mqtt_client_handle_t handle,
+                                                const esp_mqtt5_publish_property_config_t *property)
+{
+    client.publish = *property;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t handle, const char *topic, const char *data, int len,
+                            int qos, int retain)
+{
+    TEST_CHECK(strlen(topic) < sizeof(client.topic) && len < PAYLOAD_MAX);
+    strcpy(client.topic, topic);
+    memcpy(client.payload, data, len);
+    client.payload[len] = '\0';
+    // The properties are consumed by the publish
+    client.correlation_len = client.publish.correlation_data_len;
+    if (client.correlation_len > 0) {
+        memcpy(client.correlation, client.publish.correlation_data, client.correlation_len);
+    }
+    memset(&client.publish, 0, sizeof(client.publish));
+    client.published++;
+    return client.published;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t handle) { return ESP_OK; }
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t handle, const char *topic, int qos) { return 0; }
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t handle) { return 0; }
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    TEST_CHECK(item_size == sizeof(command_t));
+    return (QueueHandle_t)&queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks_to_wait)
+{
+    if (queue.full) {
+        return pdFALSE;
+    }
+    memcpy(&queue.command, item, sizeof(command_t));
+    queue.full = true;
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *buffer, TickType_t ticks_to_wait) { return pdFALSE; }
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) { return queue.full ? 1 : 0; }
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *parameters,
+                       unsigned int priority, TaskHandle_t *created_task)
+{
+    // The test executes the commands itself
+    return pdPASS;
+}
+
+/**
+ * @brief Sends a response at once, as the publisher task does with the response class.
+ */
+bool publisher_send_correlated(publish_class_t cls, const char *topic, const void *data, size_t len,
+                               const void *correlation, size_t correlation_len)
+{
+    TEST_CHECK(cls == PUBLISH_CLASS_RESPONSE);
+    return mqtt_send(topic, data, len, 1, false, correlation, correlation_len);
+}
+
+bool publisher_send(publish_class_t cls, const char *topic, const void *data, size_t len) { return true; }
+bool publisher_send_retained(publish_class_t cls, const char *topic, const void *data, size_t len) { return true; }
+void publisher_get_stats(publish_class_t cls, publisher_stats_t *stats_out) { memset(stats_out, 0, sizeof(*stats_out)); }
+const char *publisher_class_name(publish_class_t cls) { return "class"; }
+
+// Connectivity, transport, clocks and the hardware behind the commands, not executed by the test
+void connectivity_set(EventBits_t bits) {}
+void connectivity_clear(EventBits_t bits) {}
+bool connectivity_is(EventBits_t bits) { return true; }
+esp_transport_handle_t mqtt_tls_transport(void) { return NULL; }
+void mqtt_tls_get_stats(mqtt_tls_stats_t *stats_out) { memset(stats_out, 0, sizeof(*stats_out)); }
+int64_t timebase_now_us(void) { return 0; }
+int64_t timebase_to_wall_us(int64_t mono_us) { return mono_us; }
+esp_err_t time_sync_set_time(time_t t) { return ESP_OK; }
+int32_t get_water_weight(void) { return 0; }
+void tare(void) {}
+bool user_button_state(void) { return false; }
+bool led_get_state(void) { return false; }
+void led_blink_once(void) {}
+bool get_motor_state(void) { return false; }
+void fill_water_to(int32_t target_weight) {}
+esp_err_t telemetry_set_encoding(telemetry_encoding_t encoding) { return ESP_OK; }
+size_t alarms_apply(const alarm_op_t *ops, size_t count, uint32_t *ids) { return 0; }
+uint32_t add_alarm(const Alarm_t *alarm) { return ALARM_ID_NONE; }
+bool update_alarm(uint32_t id, const Alarm_t *alarm) { return false; }
+bool delete_alarm_by_id(uint32_t id) { return false; }
+bool delete_alarm(const struct tm *timestamp) { return false; }
+void get_alarms(int64_t cursor, int limit) {}
+
+/**
+ * @brief Delivers a fragment of a message as the client does, with an `MQTT_EVENT_DATA` event.
+ *
+ * @param suffix Command topic after the prefix, e.g. "get/time".
+ * @param data Payload of the whole message.
+ * @param offset Offset of the fragment in the payload.
+ * @param len Length of the fragment.
+ * @param total_len Length of the whole payload.
+ * @param property MQTT 5 properties, only carried by the first fragment, or NULL.
+ */
+static void receive(const char *suffix, const char *data, int offset, int len, int total_len,
+                    esp_mqtt5_event_property_t *property)
+{
+    char topic[TOPIC_MAX_LEN + 16];
+    snprintf(topic, sizeof(topic), "%s%s", topic_get(TOPIC_UPDATE_PREFIX), suffix);
+    esp_mqtt_event_t event = {
+        .event_id = MQTT_EVENT_DATA,
+        .client = (esp_mqtt_client_handle_t)&client,
+        .data = (char *)data + offset,
+        .data_len = len,
+        .total_data_len = total_len,
+        .current_data_offset = offset,
+        .topic = (offset == 0) ? topic : NULL,
+        .topic_len = (offset == 0) ? (int)strlen(topic) : 0,
+        .property = property,
+    };
+    client.handler(NULL, "MQTT_EVENTS", MQTT_EVENT_DATA, &event);
+}
+
+/**
+ * @brief Takes the command posted by the last message and answers it as executed.
+ */
+static void execute_posted(void)
+{
+    TEST_CHECK(queue.full);
+    queue.full = false;
+    commands_respond(&queue.command.reply, COMMAND_STATUS_OK);
+}
+
+/** @brief Response topic of the requests, followed by bytes that are not part of it */
+static char response_topic[] = "app/replies/7GARBAGE";
+
+/** @brief Correlation data of the requests, binary */
+static char correlation[] = { 0x01, 0x00, (char)0xfe, 0x42 };
+
+/** @brief Properties of the requests */
+static esp_mqtt5_event_property_t request_property = {
+    .response_topic = response_topic,
+    .response_topic_len = 13,
+    .correlation_data = correlation,
+    .correlation_data_len = sizeof(correlation),
+};
+
+static void test_session_setup(void)
+{
+    mqtt_set_message_callback(mqtt_message_handler);
+    mqtt_init();
+    commands_init();
+
+    TEST_CHECK(client.config.session.protocol_ver == MQTT_PROTOCOL_V_5);
+    TEST_CHECK(client.config.session.disable_clean_session);
+    TEST_CHECK(client.connect_set && client.connect.session_expiry_interval == MQTT_SESSION_EXPIRY_S);
+    TEST_CHECK(client.handler != NULL);
+}
+
+static void test_response_topic_and_correlation(void)
+{
+    // No "id": the response topic alone asks for a response
+    receive("get/time", "", 0, 0, 0, &request_property);
+    TEST_CHECK(queue.full && strcmp(queue.command.reply.response_topic, "app/replies/7") == 0);
+    TEST_CHECK(queue.command.reply.correlation_len == sizeof(correlation));
+
+    execute_posted();
+    TEST_CHECK(client.published == 1);
+    TEST_CHECK(strcmp(client.topic, "app/replies/7") == 0);
+    TEST_CHECK(client.correlation_len == sizeof(correlation));
+    TEST_CHECK(memcmp(client.correlation, correlation, sizeof(correlation)) == 0);
+    TEST_CHECK(strstr(client.payload, "\"command\": \"get/time\", \"status\": \"ok\"") != NULL);
+
+    // Answered by the handler itself, still with the properties
+    receive("get/nothing", "", 0, 0, 0, &request_property);
+    TEST_CHECK(!queue.full && client.published == 2);
+    TEST_CHECK(strcmp(client.topic, "app/replies/7") == 0 && client.correlation_len == sizeof(correlation));
+    TEST_CHECK(strstr(client.payload, "\"status\": \"unknown\"") != NULL);
+}
+
+static void test_properties_not_reused(void)
+{
+    // A request without properties is answered on the response topic of the device
+    static const char with_id[] = "{\"id\": \"7\"}";
+    receive("get/time", with_id, 0, sizeof(with_id) - 1, sizeof(with_id) - 1, NULL);
+    TEST_CHECK(queue.full && queue.command.reply.response_topic[0] == '\0');
+    TEST_CHECK(queue.command.reply.correlation_len == 0);
+    execute_posted();
+    TEST_CHECK(client.published == 3);
+    TEST_CHECK(strcmp(client.topic, topic_get(TOPIC_INFO_RESPONSE)) == 0 && client.correlation_len == 0);
+
+    // Nor without an "id" at all
+    receive("get/time", "", 0, 0, 0, NULL);
+    execute_posted();
+    TEST_CHECK(client.published == 3);
+}
+
+static void test_fragmented_request(void)
+{
+    static const char message[] = "{\"id\": \"frag\", \"target_weight\": 150}";
+    int total = sizeof(message) - 1;
+
+    // Only the first fragment carries the properties
+    receive("put/pourwater", message, 0, 10, total, &request_property);
+    TEST_CHECK(!queue.full);
+    receive("put/pourwater", message, 10, total - 10, total, NULL);
+    TEST_CHECK(queue.full && queue.command.type == COMMAND_POUR_WATER);
+    TEST_CHECK(queue.command.args.target_weight == 150);
+    execute_posted();
+    TEST_CHECK(client.published == 4);
+    TEST_CHECK(strcmp(client.topic, "app/replies/7") == 0 && client.correlation_len == sizeof(correlation));
+    TEST_CHECK(strstr(client.payload, "\"id\": \"frag\"") != NULL);
+}
+
+int main(void)
+{
+    topics_init();
+
+    RUN_TEST(test_session_setup);
+    RUN_TEST(test_response_topic_and_correlation);
+    RUN_TEST(test_properties_not_reused);
+    RUN_TEST(test_fragmented_request);
+    return 0;
+}
@@ -0,0 +1,278 @@
+// test_mqtt_commands.c
+//
+// Host test of the command parsing of mqtt.c: bulk alarm messages of up to
+// `ALARMS_BATCH_MAX` entries are queued whole, longer ones are rejected with the
+// `invalid` status and nothing of them queued, in JSON as in CBOR. Stats requests
+// are queued like the other commands.
+
+#include "host_test.h"
+#include "mqtt.h"
+#include "mqtt_client.h"
+#include "mqtt_tls.h"
+#include "connectivity.h"
+#include "commands.h"
+#include "alarms.h"
+#include "topics.h"
+#include "cbor.h"
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Size of the messages built by the tests */
+#define MESSAGE_SIZE 4096
+
+/** @brief Timestamp of the alarms of the tests */
+#define ALARM_TIMESTAMP "2025-01-20T07:30:00"
+
+/**
+ * @brief What the handler handed on, reset before each message.
+ */
+static struct {
+    bool posted;              /**< @brief Whether a command was queued */
+    command_t command;        /**< @brief Command queued */
+    bool responded;           /**< @brief Whether the handler answered itself */
+    command_status_t status;  /**< @brief Status of that answer */
+} handled;
+
+bool commands_post(const command_t *command)
+{
+    TEST_CHECK(!handled.posted);
+    handled.posted = true;
+    handled.command = *command;
+    return true;
+}
+
+void commands_respond(const command_reply_t *reply, command_status_t status)
+{
+    TEST_CHECK(!handled.responded);
+    handled.responded = true;
+    handled.status = status;
+}
+
+// Client, transport and scheduling, not used by the parsers
+void connectivity_set(EventBits_t bits) {}
+void connectivity_clear(EventBits_t bits) {}
+bool connectivity_is(EventBits_t bits) { return true; }
+bool get_motor_state(void) { return false; }
+int64_t timebase_now_us(void) { return 0; }
+int64_t timebase_to_wall_us(int64_t mono_us) { return mono_us; }
+esp_transport_handle_t mqtt_tls_transport(void) { return NULL; }
+bool publisher_send(publish_class_t cls, const char *topic, const void *data, size_t len) { return true; }
+bool publisher_send_retained(publish_class_t cls, const char *topic, const void *data, size_t len) { return true; }
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) { return NULL; }
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg) { return ESP_OK; }
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) { return ESP_OK; }
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos) { return 0; }
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain) { return 0; }
+int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client) { return 0; }
+
+/**
+ * @brief Passes a message to the handler on a command topic.
+ *
+ * @param suffix Command topic after the prefix, e.g. "set/alarms".
+ * @param message The message.
+ * @param len Length of the message.
+ */
+static void handle(const char *suffix, const void *message, size_t len)
+{
+    char topic[TOPIC_MAX_LEN + 16];
+    snprintf(topic, sizeof(topic), "%s%s", topic_get(TOPIC_UPDATE_PREFIX), suffix);
+    memset(&handled, 0, sizeof(handled));
+    mqtt_message_handler(topic, strlen(topic), message, len);
+}
+
+/**
+ * @brief Checks that the last message was queued as a batch of `count` valid operations.
+ *
+ * @param op Name of the operation, "set" or "del".
+ * @param count Number of operations expected.
+ */
+static void check_batch(const char *op, size_t count)
+{
+    TEST_CHECK(handled.posted && !handled.responded);
+    TEST_CHECK(handled.command.type == COMMAND_ALARMS_BATCH);
+    TEST_CHECK(strcmp(handled.command.args.alarms_batch.op, op) == 0);
+    TEST_CHECK(handled.command.args.alarms_batch.count == count);
+    for (size_t i = 0; i < count; i++) {
+        TEST_CHECK(handled.command.args.alarms_batch.ops[i].type != ALARM_OP_INVALID);
+    }
+    free(handled.command.args.alarms_batch.ops);
+}
+
+/**
+ * @brief Checks that the last message was rejected as a whole.
+ */
+static void check_rejected(void)
+{
+    TEST_CHECK(!handled.posted);
+    TEST_CHECK(handled.responded && handled.status == COMMAND_STATUS_INVALID);
+}
+
+/**
+ * @brief Builds a JSON "set/alarms" message of `count` alarms.
+ *
+ * @param buf Buffer of `MESSAGE_SIZE` bytes.
+ * @param count Number of alarms.
+ * @return Length of the message.
+ */
+static size_t set_alarms_json(char *buf, int count)
+{
+    size_t len = snprintf(buf, MESSAGE_SIZE, "{\"id\": \"r1\", \"alarms\": [");
+    for (int i = 0; i < count; i++) {
+        len += snprintf(buf + len, MESSAGE_SIZE - len, "%s{\"timestamp\": \"" ALARM_TIMESTAMP "\"}",
+                        (i > 0) ? ", " : "");
+    }
+    len += snprintf(buf + len, MESSAGE_SIZE - len, "]}");
+    TEST_CHECK(len < MESSAGE_SIZE);
+    return len;
+}
+
+/**
+ * @brief Builds a CBOR "set/alarms" message of `count` alarms.
+ *
+ * @param buf Buffer of `MESSAGE_SIZE` bytes.
+ * @param count Number of alarms.
+ * @return Length of the message.
+ */
+static size_t set_alarms_cbor(uint8_t *buf, int count)
+{
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, MESSAGE_SIZE);
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "id");
+    cbor_put_text(&writer, "r1");
+    cbor_put_text(&writer, "alarms");
+    cbor_put_array(&writer, count);
+    for (int i = 0; i < count; i++) {
+        cbor_put_map(&writer, 1);
+        cbor_put_text(&writer, "timestamp");
+        cbor_put_text(&writer, ALARM_TIMESTAMP);
+    }
+    TEST_CHECK(!writer.overflow);
+    return writer.len;
+}
+
+/**
+ * @brief Builds a JSON "del/alarms" message of IDs 1 to `count`.
+ *
+ * @param buf Buffer of `MESSAGE_SIZE` bytes.
+ * @param count Number of IDs.
+ * @return Length of the message.
+ */
+static size_t del_alarms_json(char *buf, int count)
+{
+    size_t len = snprintf(buf, MESSAGE_SIZE, "{\"id\": \"r1\", \"alarm_ids\": [");
+    for (int i = 0; i < count; i++) {
+        len += snprintf(buf + len, MESSAGE_SIZE - len, "%s%d", (i > 0) ? ", " : "", i + 1);
+    }
+    len += snprintf(buf + len, MESSAGE_SIZE - len, "]}");
+    TEST_CHECK(len < MESSAGE_SIZE);
+    return len;
+}
+
+/**
+ * @brief Builds a CBOR "del/alarms" message of IDs 1 to `count`.
+ *
+ * @param buf Buffer of `MESSAGE_SIZE` bytes.
+ * @param count Number of IDs.
+ * @return Length of the message.
+ */
+static size_t del_alarms_cbor(uint8_t *buf, int count)
+{
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, buf, MESSAGE_SIZE);
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "id");
+    cbor_put_text(&writer, "r1");
+    cbor_put_text(&writer, "alarm_ids");
+    cbor_put_array(&writer, count);
+    for (int i = 0; i < count; i++) {
+        cbor_put_uint(&writer, i + 1);
+    }
+    TEST_CHECK(!writer.overflow);
+    return writer.len;
+}
+
+static void test_set_alarms_limit(void)
+{
+    static char json[MESSAGE_SIZE];
+    static uint8_t cbor[MESSAGE_SIZE];
+
+    handle("set/alarms", json, set_alarms_json(json, ALARMS_BATCH_MAX));
+    check_batch("set", ALARMS_BATCH_MAX);
+    handle("set/alarms", json, set_alarms_json(json, ALARMS_BATCH_MAX + 1));
+    check_rejected();
+
+    handle("set/alarms", cbor, set_alarms_cbor(cbor, ALARMS_BATCH_MAX));
+    check_batch("set", ALARMS_BATCH_MAX);
+    handle("set/alarms", cbor, set_alarms_cbor(cbor, ALARMS_BATCH_MAX + 1));
+    check_rejected();
+}
+
+static void test_del_alarms_limit(void)
+{
+    static char json[MESSAGE_SIZE];
+    static uint8_t cbor[MESSAGE_SIZE];
+
+    handle("del/alarms", json, del_alarms_json(json, ALARMS_BATCH_MAX));
+    check_batch("del", ALARMS_BATCH_MAX);
+    handle("del/alarms", json, del_alarms_json(json, ALARMS_BATCH_MAX + 1));
+    check_rejected();
+
+    handle("del/alarms", cbor, del_alarms_cbor(cbor, ALARMS_BATCH_MAX));
+    check_batch("del", ALARMS_BATCH_MAX);
+    handle("del/alarms", cbor, del_alarms_cbor(cbor, ALARMS_BATCH_MAX + 1));
+    check_rejected();
+}
+
+static void test_invalid_entries_keep_position(void)
+{
+    static const char json[] = "{\"alarm_ids\": [5, \"x\", -1, 7]}";
+    static const uint8_t expected[] = { ALARM_OP_DELETE, ALARM_OP_INVALID, ALARM_OP_INVALID, ALARM_OP_DELETE };
+    uint8_t cbor[64];
+
+    handle("del/alarms", json, sizeof(json) - 1);
+    TEST_CHECK(handled.posted && handled.command.args.alarms_batch.count == 4);
+    for (size_t i = 0; i < 4; i++) {
+        TEST_CHECK(handled.command.args.alarms_batch.ops[i].type == expected[i]);
+    }
+    free(handled.command.args.alarms_batch.ops);
+
+    // A CBOR item that is not an integer is skipped whole, the next ID still read
+    cbor_writer_t writer;
+    cbor_writer_init(&writer, cbor, sizeof(cbor));
+    cbor_put_map(&writer, 1);
+    cbor_put_text(&writer, "alarm_ids");
+    cbor_put_array(&writer, 4);
+    cbor_put_uint(&writer, 5);
+    cbor_put_text(&writer, "x");
+    cbor_put_int(&writer, -1);
+    cbor_put_uint(&writer, 7);
+    handle("del/alarms", cbor, writer.len);
+    TEST_CHECK(handled.posted && handled.command.args.alarms_batch.count == 4);
+    for (size_t i = 0; i < 4; i++) {
+        TEST_CHECK(handled.command.args.alarms_batch.ops[i].type == expected[i]);
+    }
+    TEST_CHECK(handled.command.args.alarms_batch.ops[3].id == 7);
+    free(handled.command.args.alarms_batch.ops);
+}
+
+static void test_get_stats_routed(void)
+{
+    // Queued without a payload, as the response carries the counters
+    handle("get/stats", "", 0);
+    TEST_CHECK(handled.posted && handled.command.type == COMMAND_GET_STATS);
+    TEST_CHECK(strcmp(handled.command.reply.name, "get/stats") == 0);
+}
+
+int main(void)
+{
+    topics_init();
+
+    RUN_TEST(test_set_alarms_limit);
+    RUN_TEST(test_del_alarms_limit);
+    RUN_TEST(test_invalid_entries_keep_position);
+    RUN_TEST(test_get_stats_routed);
+    return 0;
+}
@@ -0,0 +1,411 @@
+// test_parsers_fuzz.c
+//
+// Seeded fuzz test of the command parsers: the JSON tokenizer and its helpers, the
+// CBOR reader and the ISO-8601 timestamp parser are fed random and mutated command
+// payloads, and every result is checked to stay within the input. Run under ASan and
+// UBSan, any out-of-bounds access aborts the test. Usage:
+//   test_parsers_fuzz [iterations [seed]]
+
+#include "host_test.h"
+#include "json.h"
+#include "cbor.h"
+#include "time_format.h"
+#include <stdint.h>
+#include <string.h>
+
+/** @brief Default number of mutated inputs per parser */
+#define FUZZ_DEFAULT_ITERATIONS 200000
+
+/** @brief Longest input generated */
+#define FUZZ_MAX_LEN 512
+
+/** @brief Size of the token pool, small enough for `JSON_ERROR_NOMEM` to be hit too */
+#define FUZZ_MAX_TOKENS 48
+
+/** @brief Keys looked up in every parsed payload, as the command handlers do */
+static const char *const keys[] = {
+    "cmd", "id", "alarm_id", "alarm_ids", "alarms", "commands", "cursor", "limit",
+    "timestamp", "target_weight", "repeat_days", "repeat_interval", "time",
+};
+
+/** @brief JSON payloads the mutations start from */
+static const char *const json_seeds[] = {
+    "{\"cmd\":\"set_alarm\",\"id\":\"r1\",\"timestamp\":\"2025-01-20T07:30:00\",\"target_weight\":200}",
+    "{ \"cmd\" : \"get_alarms\", \"cursor\": 12, \"limit\": 10 }",
+    "{\"cmd\":\"del_alarms\",\"alarm_ids\":[1,2,3,4294967295]}",
+    "{\"alarms\":[{\"timestamp\":\"2025-1-5T7:0:0\",\"target_weight\":-5,\"repeat_days\":127},"
+    "{\"alarm_id\":9,\"repeat_interval\":3600,\"timestamp\":\"2025-12-31T23:59:59\"}]}",
+    "{\"commands\":[{\"cmd\":\"pour_water\",\"target_weight\":150},{\"cmd\":\"get_status\"}],\"id\":\"b\"}",
+    "{\"time\":\"2025-06-01T12:00:00\",\"nested\":{\"a\":[true,false,null,1.5e3,\"\\u00e9\\\"\"]}}",
+    "[[[[[[[[1]]]]]]]]",
+};
+
+/** @brief Timestamps the mutations of the timestamp parser start from */
+static const char *const time_seeds[] = {
+    "2025-01-20T07:30:15",
+    "2025-1-5T7:0:0\"",
+    "1970-01-01T00:00:00",
+    "2038-01-19T03:14:07",
+};
+
+/** @brief State of the xorshift generator, so a seed always replays the same inputs */
+static uint64_t rng_state;
+
+/**
+ * @brief Returns the next pseudo-random number.
+ *
+ * @return 32 random bits.
+ */
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+/**
+ * @brief Returns a byte likely to matter to a parser.
+ *
+ * @return A structural character, a digit or a random byte.
+ */
+static uint8_t interesting_byte(void)
+{
+    static const char special[] = "{}[]\":,\\-+.eE0123456789 \ttrufalsn\x80\xa0\xbf\xff";
+    if (rng() % 4 == 0) {
+        return (uint8_t)rng();
+    }
+    return (uint8_t)special[rng() % (sizeof(special) - 1)];
+}
+
+/**
+ * @brief Mutates an input in place: flips, inserts, deletes, truncates or duplicates bytes.
+ *
+ * @param buf The input, of capacity `FUZZ_MAX_LEN`.
+ * @param len Length of the input.
+ * @return New length of the input.
+ */
+static size_t mutate(uint8_t *buf, size_t len)
+{
+    int rounds = 1 + rng() % 4;
+    for (int i = 0; i < rounds; i++) {
+        size_t pos = len > 0 ? rng() % len : 0;
+        switch (rng() % 6) {
+        case 0:
+            if (len > 0) {
+                buf[pos] ^= (uint8_t)(1u << (rng() % 8));
+            }
+            break;
+        case 1:
+            if (len > 0) {
+                buf[pos] = interesting_byte();
+            }
+            break;
+        case 2:
+            if (len < FUZZ_MAX_LEN) {
+                memmove(&buf[pos + 1], &buf[pos], len - pos);
+                buf[pos] = interesting_byte();
+                len++;
+            }
+            break;
+        case 3:
+            if (len > 0) {
+                memmove(&buf[pos], &buf[pos + 1], len - pos - 1);
+                len--;
+            }
+            break;
+        case 4:
+            len = pos;
+            break;
+        default: {
+            // Duplicates a slice, repeating keys and nesting containers
+            size_t span = len > pos ? 1 + rng() % (len - pos) : 0;
+            if (len + span <= FUZZ_MAX_LEN) {
+                memmove(&buf[pos + span], &buf[pos], len - pos);
+                len += span;
+            }
+            break;
+        }
+        }
+    }
+    return len;
+}
+
+/**
+ * @brief Fills an input with random bytes.
+ *
+ * @param buf The input, of capacity `FUZZ_MAX_LEN`.
+ * @return Length of the input.
+ */
+static size_t random_input(uint8_t *buf)
+{
+    size_t len = rng() % 64;
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = interesting_byte();
+    }
+    return len;
+}
+
+/**
+ * @brief Parses one JSON input and checks the tokens and the helpers on it.
+ *
+ * @param json The input, exactly `len` bytes long so any over-read is caught.
+ * @param len Length of the input.
+ * @return `true` if the input was valid JSON.
+ */
+static bool check_json(const char *json, size_t len)
+{
+    json_token_t tokens[FUZZ_MAX_TOKENS];
+    json_doc_t doc;
+    int count = json_parse(&doc, json, len, tokens, FUZZ_MAX_TOKENS);
+    if (count < 0) {
+        TEST_CHECK(count == JSON_ERROR_NOMEM || count == JSON_ERROR_INVALID);
+        return false;
+    }
+    TEST_CHECK(count > 0 && count <= FUZZ_MAX_TOKENS);
+    TEST_CHECK(json_next(&doc, 0) == count);
+
+    for (int i = 0; i < count; i++) {
+        const json_token_t *token = &tokens[i];
+        TEST_CHECK(token->type <= JSON_TYPE_PRIMITIVE);
+        TEST_CHECK(token->start <= token->end && token->end <= len);
+        int next = json_next(&doc, i);
+        TEST_CHECK(next > i && next <= count);
+
+        int64_t value;
+        const char *str;
+        size_t str_len;
+        json_get_int(&doc, i, &value);
+        if (json_get_string(&doc, i, &str, &str_len)) {
+            TEST_CHECK(str >= json && str + str_len <= json + len);
+        }
+        for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+            int found = json_object_get(&doc, i, keys[k]);
+            TEST_CHECK(found == -1 || (token->type == JSON_TYPE_OBJECT && found > i && found < next));
+            json_object_get_int(&doc, i, keys[k], &value);
+            if (json_object_get_string(&doc, i, keys[k], &str, &str_len)) {
+                TEST_CHECK(str >= json && str + str_len <= json + len);
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one CBOR input through every reader entry point and checks the bounds.
+ *
+ * @param data The input, exactly `len` bytes long so any over-read is caught.
+ * @param len Length of the input.
+ * @return `true` if the input was one well-formed data item.
+ */
+static bool check_cbor(const uint8_t *data, size_t len)
+{
+    const uint8_t *end = data + len;
+    cbor_reader_t reader;
+    cbor_item_t item;
+
+    cbor_reader_init(&reader, data, len);
+    while (cbor_read(&reader, &item)) {
+        TEST_CHECK(reader.ptr > data && reader.ptr <= end);
+        if (item.type == CBOR_TYPE_BYTES || item.type == CBOR_TYPE_TEXT) {
+            TEST_CHECK(item.data >= data && item.value <= (uint64_t)(end - item.data));
+        }
+    }
+
+    cbor_reader_init(&reader, data, len);
+    bool well_formed = cbor_skip(&reader) && reader.ptr == end;
+    TEST_CHECK(reader.ptr >= data && reader.ptr <= end);
+
+    for (size_t k = 0; k < sizeof(keys) / sizeof(keys[0]); k++) {
+        cbor_reader_init(&reader, data, len);
+        if (cbor_map_find(&reader, keys[k])) {
+            TEST_CHECK(reader.ptr >= data && reader.ptr <= end);
+            int64_t value;
+            cbor_read_int(&reader, &value);
+            TEST_CHECK(reader.ptr >= data && reader.ptr <= end);
+        }
+    }
+    return well_formed;
+}
+
+/**
+ * @brief Parses one timestamp input and checks the fields and the end pointer.
+ *
+ * @param str The input, exactly `len` bytes long so any over-read is caught.
+ * @param len Length of the input.
+ * @return `true` if a timestamp was parsed.
+ */
+static bool check_time(const char *str, size_t len)
+{
+    struct tm tm;
+    const char *end = NULL;
+    if (!time_parse_iso(str, len, &tm, &end)) {
+        return false;
+    }
+    TEST_CHECK(end > str && end <= str + len);
+    TEST_CHECK(tm.tm_mon >= 0 && tm.tm_mon <= 11);
+    TEST_CHECK(tm.tm_mday >= 1 && tm.tm_mday <= 31);
+    TEST_CHECK(tm.tm_hour >= 0 && tm.tm_hour <= 23);
+    TEST_CHECK(tm.tm_min >= 0 && tm.tm_min <= 59);
+    TEST_CHECK(tm.tm_sec >= 0 && tm.tm_sec <= 60);
+    TEST_CHECK(tm.tm_isdst == -1);
+    return true;
+}
+
+/**
+ * @brief Copies an input to a heap block of exactly its length, so ASan catches over-reads.
+ *
+ * @param buf The input.
+ * @param len Length of the input.
+ * @return The copy, to be freed by the caller.
+ */
+static void *exact_copy(const uint8_t *buf, size_t len)
+{
+    void *copy = malloc(len > 0 ? len : 1);
+    TEST_CHECK(copy != NULL);
+    memcpy(copy, buf, len);
+    return copy;
+}
+
+/**
+ * @brief Encodes the CBOR payloads the mutations start from.
+ *
+ * @param seeds Array of 3 buffers of `FUZZ_MAX_LEN` bytes.
+ * @param lens Array of 3 entries receiving the lengths.
+ */
+static void encode_cbor_seeds(uint8_t seeds[][FUZZ_MAX_LEN], size_t *lens)
+{
+    cbor_writer_t writer;
+
+    cbor_writer_init(&writer, seeds[0], FUZZ_MAX_LEN);
+    cbor_put_map(&writer, 3);
+    cbor_put_text(&writer, "cmd");
+    cbor_put_text(&writer, "set_alarm");
+    cbor_put_text(&writer, "timestamp");
+    cbor_put_text(&writer, "2025-01-20T07:30:00");
+    cbor_put_text(&writer, "target_weight");
+    cbor_put_int(&writer, 200);
+    lens[0] = writer.len;
+
+    cbor_writer_init(&writer, seeds[1], FUZZ_MAX_LEN);
+    cbor_put_map(&writer, 2);
+    cbor_put_text(&writer, "alarm_ids");
+    cbor_put_array(&writer, 3);
+    cbor_put_uint(&writer, 1);
+    cbor_put_uint(&writer, 70000);
+    cbor_put_uint(&writer, UINT32_MAX);
+    cbor_put_text(&writer, "cursor");
+    cbor_put_int(&writer, -1);
+    lens[1] = writer.len;
+
+    cbor_writer_init(&writer, seeds[2], FUZZ_MAX_LEN);
+    cbor_put_map(&writer, 1);
+    cbor_put_text(&writer, "alarms");
+    cbor_put_array(&writer, 2);
+    for (int i = 0; i < 2; i++) {
+        cbor_put_map(&writer, 3);
+        cbor_put_text(&writer, "timestamp");
+        cbor_put_text(&writer, "2025-12-31T23:59:59");
+        cbor_put_text(&writer, "repeat_days");
+        cbor_put_uint(&writer, 0x41);
+        cbor_put_text(&writer, "repeat_interval");
+        cbor_put_bool(&writer, i == 0);
+    }
+    lens[2] = writer.len;
+    TEST_CHECK(!writer.overflow);
+}
+
+/** @brief Number of mutated inputs per parser */
+static unsigned long iterations = FUZZ_DEFAULT_ITERATIONS;
+
+static void test_fuzz_json(void)
+{
+    uint8_t buf[FUZZ_MAX_LEN];
+    size_t seed_count = sizeof(json_seeds) / sizeof(json_seeds[0]);
+    unsigned long valid = 0;
+
+    for (size_t s = 0; s < seed_count; s++) {
+        TEST_CHECK(check_json(json_seeds[s], strlen(json_seeds[s])));
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        size_t len;
+        if (i % 8 == 0) {
+            len = random_input(buf);
+        } else {
+            const char *seed = json_seeds[rng() % seed_count];
+            len = strlen(seed);
+            memcpy(buf, seed, len);
+            len = mutate(buf, len);
+        }
+        char *copy = exact_copy(buf, len);
+        valid += check_json(copy, len);
+        free(copy);
+    }
+    printf("%lu of %lu inputs were valid JSON\n", valid, iterations);
+}
+
+static void test_fuzz_cbor(void)
+{
+    uint8_t seeds[3][FUZZ_MAX_LEN];
+    size_t lens[3];
+    uint8_t buf[FUZZ_MAX_LEN];
+    unsigned long valid = 0;
+
+    encode_cbor_seeds(seeds, lens);
+    for (size_t s = 0; s < 3; s++) {
+        TEST_CHECK(check_cbor(seeds[s], lens[s]));
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        size_t len;
+        if (i % 8 == 0) {
+            len = random_input(buf);
+        } else {
+            size_t s = rng() % 3;
+            memcpy(buf, seeds[s], lens[s]);
+            len = mutate(buf, lens[s]);
+        }
+        uint8_t *copy = exact_copy(buf, len);
+        valid += check_cbor(copy, len);
+        free(copy);
+    }
+    printf("%lu of %lu inputs were well-formed CBOR\n", valid, iterations);
+}
+
+static void test_fuzz_time(void)
+{
+    uint8_t buf[FUZZ_MAX_LEN];
+    size_t seed_count = sizeof(time_seeds) / sizeof(time_seeds[0]);
+    unsigned long valid = 0;
+
+    for (size_t s = 0; s < seed_count; s++) {
+        TEST_CHECK(check_time(time_seeds[s], strlen(time_seeds[s])));
+    }
+    for (unsigned long i = 0; i < iterations; i++) {
+        const char *seed = time_seeds[rng() % seed_count];
+        size_t len = strlen(seed);
+        memcpy(buf, seed, len);
+        len = mutate(buf, len);
+        char *copy = exact_copy(buf, len);
+        valid += check_time(copy, len);
+        free(copy);
+    }
+    printf("%lu of %lu inputs were timestamps\n", valid, iterations);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t seed = 0x48595052414e4554ULL;
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        seed = strtoull(argv[2], NULL, 0);
+    }
+    rng_state = seed != 0 ? seed : 1;
+    printf("Seed 0x%llx, %lu iterations\n", (unsigned long long)seed, iterations);
+
+    RUN_TEST(test_fuzz_json);
+    RUN_TEST(test_fuzz_cbor);
+    RUN_TEST(test_fuzz_time);
+    return 0;
+}
@@ -0,0 +1,280 @@
+// test_telemetry_outage.c
+//
+// Host test of telemetry across a broker outage: readings reported while the broker
+// is unreachable are stored, then flushed after reconnecting, paced by the bulk queue
+// and the outbox, and delivered exactly once and in order before live telemetry resumes.
+
+#include "host_test.h"
+#include "flash_sim.h"
+#include "telemetry.h"
+#include "telemetry_store.h"
+#include "mqtt.h"
+#include "topics.h"
+#include "json.h"
+#include "config.h"
+#include <string.h>
+
+/** @brief Offset between the monotonic and the wall-clock time of the tests */
+#define WALL_OFFSET_US 1700000000000000LL
+
+/** @brief Interval between readings in microseconds */
+#define READING_INTERVAL_US 5000000LL
+
+/** @brief Largest number of readings the test delivers */
+#define MAX_DELIVERED 4096
+
+/**
+ * @brief Broker stand-in, recording what the device publishes.
+ */
+static struct {
+    bool connected;                    /**< @brief Whether the client is connected */
+    size_t outbox;                     /**< @brief Bytes not acknowledged by the broker */
+    size_t bulk_space;                 /**< @brief Free places in the bulk queue */
+    bool refuse;                       /**< @brief Whether the client rejects the next publish */
+    int32_t delivered[MAX_DELIVERED];  /**< @brief Numbers of the readings received, in order */
+    size_t delivered_count;            /**< @brief Number of readings received */
+    size_t live_messages;              /**< @brief Number of live telemetry messages */
+    size_t batch_messages;             /**< @brief Number of batch messages */
+    size_t state_messages;             /**< @brief Number of retained state snapshots */
+    size_t legacy_messages;            /**< @brief Number of tank level messages on the legacy topic */
+} broker;
+
+/** @brief Number of the next reading reported, its weight being that many deadbands */
+static int32_t next_reading = 0;
+
+/**
+ * @brief Records the readings of the telemetry messages of a payload, a message or an array of them.
+ *
+ * @param payload JSON payload.
+ * @param len Length of the payload.
+ */
+static void deliver(const char *payload, size_t len)
+{
+    static json_token_t tokens[512];
+    json_doc_t doc;
+
+    TEST_CHECK(json_parse(&doc, payload, len, tokens, 512) > 0);
+    int count = (tokens[0].type == JSON_TYPE_ARRAY) ? tokens[0].size : 1;
+    int message = (tokens[0].type == JSON_TYPE_ARRAY) ? 1 : 0;
+    for (int i = 0; i < count; i++) {
+        int64_t weight;
+        TEST_CHECK(json_object_get_int(&doc, message, "weight", &weight));
+        TEST_CHECK(weight % TELEMETRY_WEIGHT_DEADBAND_G == 0);
+        TEST_CHECK(broker.delivered_count < MAX_DELIVERED);
+        broker.delivered[broker.delivered_count++] = (int32_t)(weight / TELEMETRY_WEIGHT_DEADBAND_G);
+        message = json_next(&doc, message);
+    }
+}
+
+bool mqtt_is_connected(void)
+{
+    return broker.connected;
+}
+
+size_t mqtt_outbox_size(void)
+{
+    return broker.outbox;
+}
+
+size_t publisher_space(publish_class_t cls)
+{
+    return (cls == PUBLISH_CLASS_BULK) ? broker.bulk_space : 8;
+}
+
+void mqtt_publish(publish_class_t cls, const char *topic, const char *payload)
+{
+    TEST_CHECK(broker.connected);
+    if (strcmp(topic, "watertanklevel") == 0) {
+        broker.legacy_messages++;
+        return;
+    }
+    TEST_CHECK(strcmp(topic, "telemetry") == 0);
+    broker.live_messages++;
+    deliver(payload, strlen(payload));
+}
+
+bool mqtt_publish_data(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    TEST_CHECK(cls == PUBLISH_CLASS_BULK && strcmp(topic, "telemetry/batch") == 0);
+    TEST_CHECK(broker.connected && broker.bulk_space > 0);
+    if (broker.refuse) {
+        broker.refuse = false;
+        return false;
+    }
+    broker.bulk_space--;
+    broker.batch_messages++;
+    deliver(data, len);
+    return true;
+}
+
+bool mqtt_publish_retained(publish_class_t cls, const char *topic, const void *data, size_t len)
+{
+    TEST_CHECK(broker.connected && strcmp(topic, "state") == 0);
+    broker.state_messages++;
+    return true;
+}
+
+const char *topic_get(topic_id_t id)
+{
+    switch (id) {
+        case TOPIC_INFO_TELEMETRY:
+            return "telemetry";
+        case TOPIC_INFO_TELEMETRY_BATCH:
+            return "telemetry/batch";
+        case TOPIC_INFO_STATE:
+            return "state";
+        case TOPIC_INFO_WATERTANKLEVEL:
+            return "watertanklevel";
+        default:
+            return "other";
+    }
+}
+
+int64_t timebase_now_us(void)
+{
+    return next_reading * READING_INTERVAL_US;
+}
+
+int64_t timebase_to_wall_us(int64_t mono_us)
+{
+    return mono_us + WALL_OFFSET_US;
+}
+
+// Hardware, and the legacy topics other than the tank level
+void mqtt_publish_all(publish_class_t cls, int32_t weight, int64_t timestamp_us, bool button_state, bool led_state,
+                      bool motor_state) {}
+void mqtt_publish_water_state(publish_class_t cls, int water_state) {}
+void mqtt_publish_current_time(publish_class_t cls, int64_t timestamp_us) {}
+int32_t get_water_weight(void) { return 0; }
+bool user_button_state(void) { return false; }
+bool led_get_state(void) { return false; }
+bool get_motor_state(void) { return false; }
+bool water_level_sensor_state(void) { return false; }
+
+/**
+ * @brief Reports readings whose weight changes by a deadband every time, so each one is a message.
+ *
+ * @param count Number of readings.
+ */
+static void report(int count)
+{
+    for (int i = 0; i < count; i++, next_reading++) {
+        telemetry_sample_t sample = {
+            .timestamp_us = next_reading * READING_INTERVAL_US,
+            .weight = next_reading * TELEMETRY_WEIGHT_DEADBAND_G,
+        };
+        TEST_CHECK(telemetry_report(&sample));
+    }
+}
+
+/**
+ * @brief Checks that the broker received readings `first` onwards exactly once and in order.
+ *
+ * @param first Number of the first reading expected.
+ */
+static void check_delivered_in_order(int32_t first)
+{
+    for (size_t i = 0; i < broker.delivered_count; i++) {
+        TEST_CHECK(broker.delivered[i] == first + (int32_t)i);
+    }
+}
+
+/**
+ * @brief Flushes with a bulk queue taking `per_round` messages at a time until the store is empty.
+ *
+ * @param per_round Free places in the bulk queue at each round.
+ * @return Number of rounds.
+ */
+static int flush_all(size_t per_round)
+{
+    int rounds = 0;
+    do {
+        broker.bulk_space = per_round;
+        rounds++;
+        TEST_CHECK(rounds < 1000);
+    } while (!telemetry_flush());
+    return rounds;
+}
+
+/**
+ * @brief Readings of an outage are stored, then flushed in order before live telemetry resumes.
+ */
+static void test_outage_and_reconnect(void)
+{
+    broker.connected = true;
+    broker.bulk_space = 8;
+    report(5);
+    TEST_CHECK(broker.live_messages == 5 && telemetry_store_count() == 0);
+    TEST_CHECK(broker.legacy_messages == (TELEMETRY_LEGACY_TOPICS ? 5 : 0));
+    TEST_CHECK(broker.state_messages > 0);
+
+    // Outage: nothing reaches the broker
+    broker.connected = false;
+    report(100);
+    TEST_CHECK(telemetry_store_count() == 100);
+    TEST_CHECK(!telemetry_flush());
+    TEST_CHECK(broker.delivered_count == 5);
+
+    // Reconnected, but the broker still acknowledges earlier messages
+    broker.connected = true;
+    broker.outbox = TELEMETRY_FLUSH_OUTBOX_MAX + 1;
+    TEST_CHECK(!telemetry_flush());
+    TEST_CHECK(broker.batch_messages == 0);
+    broker.outbox = 0;
+
+    // The bulk queue takes two batches, the rest waits
+    broker.bulk_space = 2;
+    TEST_CHECK(!telemetry_flush());
+    TEST_CHECK(broker.batch_messages == 2);
+    TEST_CHECK(broker.delivered_count == 5 + 2 * TELEMETRY_FLUSH_BATCH_SIZE);
+
+    // Live readings queue up behind the stored ones
+    size_t live_before = broker.live_messages;
+    report(3);
+    TEST_CHECK(broker.live_messages == live_before);
+
+    // A publish the client rejects is retried, not lost
+    broker.refuse = true;
+    size_t state_before = broker.state_messages;
+    flush_all(2);
+    TEST_CHECK(!broker.refuse);
+    TEST_CHECK(telemetry_store_count() == 0);
+    TEST_CHECK(broker.state_messages == state_before + 1);
+    check_delivered_in_order(0);
+    TEST_CHECK(broker.delivered_count == 108);
+
+    // Live telemetry resumes
+    report(1);
+    TEST_CHECK(broker.live_messages == live_before + 1);
+    check_delivered_in_order(0);
+}
+
+/**
+ * @brief An outage longer than the store holds delivers the newest readings, contiguous.
+ */
+static void test_long_outage(void)
+{
+    broker.connected = false;
+    memset(broker.delivered, 0, sizeof(broker.delivered));
+    broker.delivered_count = 0;
+    int32_t first = next_reading;
+    report(2000);
+
+    size_t kept = telemetry_store_count();
+    TEST_CHECK(kept < 2000);
+    broker.connected = true;
+    flush_all(4);
+    TEST_CHECK(broker.delivered_count == kept);
+    check_delivered_in_order(first + 2000 - (int32_t)kept);
+}
+
+int main(void)
+{
+    flash_sim_reset(3 * FLASH_SIM_SECTOR_SIZE);
+    telemetry_init();
+
+    RUN_TEST(test_outage_and_reconnect);
+    RUN_TEST(test_long_outage);
+    printf("All telemetry outage tests passed\n");
+    return EXIT_SUCCESS;
+}
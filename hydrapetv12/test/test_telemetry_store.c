@@ -0,0 +1,210 @@
+// test_telemetry_store.c
+//
+// Host test of the offline telemetry store against a simulated NOR flash partition:
+// order of the readings, spilling from RAM to flash, recovery after a reset, wrapping
+// of the ring and accounting of the dropped readings.
+
+#include "host_test.h"
+#include "flash_sim.h"
+
+// Included to reset the state of the store as a reboot does
+#include "telemetry_store.c"
+
+/** @brief Offset between the monotonic and the wall-clock time of the tests */
+#define WALL_OFFSET_US 1700000000000000LL
+
+/** @brief Number of readings the simulated ring of 3 sectors holds */
+#define RING_RECORDS (3 * RECORDS_PER_SECTOR)
+
+int64_t timebase_to_wall_us(int64_t mono_us)
+{
+    return mono_us + WALL_OFFSET_US;
+}
+
+/** @brief Weight of the next reading pushed, readings are numbered by their weight */
+static int32_t next_pushed = 0;
+
+/** @brief Weight of the next reading expected out of the store */
+static int32_t next_expected = 0;
+
+/**
+ * @brief Forgets everything held in RAM and opens the store again, like a reset.
+ */
+static void reboot(void)
+{
+    ram_head = 0;
+    ram_count = 0;
+    partition = NULL;
+    sector_count = 0;
+    write_pos = (ring_pos_t){ 0 };
+    read_pos = (ring_pos_t){ 0 };
+    write_ready = false;
+    flash_count = 0;
+    next_seq = 0;
+    telemetry_store_init();
+}
+
+/**
+ * @brief Erases the flash and starts an empty store.
+ */
+static void fresh_store(void)
+{
+    flash_sim_reset(3 * FLASH_SIM_SECTOR_SIZE);
+    dropped = 0;
+    next_pushed = 0;
+    next_expected = 0;
+    reboot();
+}
+
+/**
+ * @brief Pushes readings numbered by their weight, 10 ms apart.
+ *
+ * @param count Number of readings.
+ */
+static void push(int count)
+{
+    for (int i = 0; i < count; i++, next_pushed++) {
+        telemetry_sample_t sample = {
+            .timestamp_us = next_pushed * 10000LL,
+            .weight = next_pushed,
+            .led_on = (next_pushed & 1) != 0,
+            .tank_low = (next_pushed % 3) == 0,
+        };
+        telemetry_store_push(&sample, TELEMETRY_FIELD_ALL);
+    }
+}
+
+/**
+ * @brief Reads and removes readings in batches, checking they come out in order and intact.
+ *
+ * @param count Number of readings to take.
+ */
+static void drain(size_t count)
+{
+    telemetry_record_t records[7];
+
+    while (count > 0) {
+        size_t n = telemetry_store_peek(records, (count < 7) ? count : 7);
+        TEST_CHECK(n > 0);
+        for (size_t i = 0; i < n; i++) {
+            TEST_CHECK(records[i].sample.weight == next_expected);
+            TEST_CHECK(records[i].wall_us == next_expected * 10000LL + WALL_OFFSET_US);
+            TEST_CHECK(records[i].fields == TELEMETRY_FIELD_ALL);
+            TEST_CHECK(records[i].sample.led_on == ((next_expected & 1) != 0));
+            TEST_CHECK(records[i].sample.tank_low == ((next_expected % 3) == 0));
+            next_expected++;
+        }
+        telemetry_store_consume(n);
+        count -= n;
+    }
+}
+
+/**
+ * @brief Readings beyond the RAM buffer spill to flash and come back oldest first.
+ */
+static void test_spill_and_order(void)
+{
+    fresh_store();
+    push(300);
+    TEST_CHECK(telemetry_store_count() == 300);
+    TEST_CHECK(flash_count == 300 - TELEMETRY_STORE_RAM_RECORDS);
+    drain(300);
+    TEST_CHECK(telemetry_store_count() == 0);
+    TEST_CHECK(dropped == 0);
+}
+
+/**
+ * @brief A reset keeps the unpublished readings in flash and forgets the published ones.
+ */
+static void test_recovery_after_reset(void)
+{
+    fresh_store();
+    push(300);
+    drain(100);
+
+    // The readings still in RAM are lost
+    reboot();
+    TEST_CHECK(telemetry_store_count() == 300 - TELEMETRY_STORE_RAM_RECORDS - 100);
+    drain(telemetry_store_count());
+
+    // Appending continues after the recovered end of the ring
+    next_expected = next_pushed;
+    push(TELEMETRY_STORE_RAM_RECORDS + 10);
+    reboot();
+    TEST_CHECK(telemetry_store_count() == 10);
+    drain(10);
+}
+
+/**
+ * @brief A full ring drops its oldest sector and counts every reading lost.
+ */
+static void test_wrap_and_drop_accounting(void)
+{
+    fresh_store();
+    const int total = 2000;
+    push(total);
+
+    size_t kept = telemetry_store_count();
+    TEST_CHECK(kept <= RING_RECORDS + TELEMETRY_STORE_RAM_RECORDS);
+    TEST_CHECK(kept >= RING_RECORDS - RECORDS_PER_SECTOR + TELEMETRY_STORE_RAM_RECORDS);
+    TEST_CHECK(dropped + kept == (size_t)total);
+
+    // The newest readings survive, contiguous up to the last one pushed
+    next_expected = total - (int32_t)kept;
+    drain(kept);
+    TEST_CHECK(next_expected == total);
+}
+
+/**
+ * @brief A record cut short by a reset is skipped, and the ones around it are kept.
+ */
+static void test_torn_record(void)
+{
+    fresh_store();
+    push(TELEMETRY_STORE_RAM_RECORDS + 3);
+    TEST_CHECK(flash_count == 3);
+
+    // Tear the last record written to flash, before its marker was programmed
+    ring_pos_t torn = { .sector = write_pos.sector, .index = write_pos.index - 1 };
+    flash_sim_data()[record_offset(torn) + offsetof(flash_record_t, marker)] = 0xFF;
+
+    reboot();
+    TEST_CHECK(telemetry_store_count() == 2);
+    drain(2);
+
+    // The torn slot is not reused
+    next_expected = next_pushed;
+    push(TELEMETRY_STORE_RAM_RECORDS + 1);
+    reboot();
+    TEST_CHECK(telemetry_store_count() == 1);
+    drain(1);
+}
+
+/**
+ * @brief Without a partition the store keeps the newest readings in RAM and counts the others.
+ */
+static void test_ram_only(void)
+{
+    flash_sim_reset(0);
+    dropped = 0;
+    next_pushed = 0;
+    reboot();
+    TEST_CHECK(partition == NULL);
+
+    push(TELEMETRY_STORE_RAM_RECORDS + 20);
+    TEST_CHECK(telemetry_store_count() == TELEMETRY_STORE_RAM_RECORDS);
+    TEST_CHECK(dropped == 20);
+    next_expected = 20;
+    drain(TELEMETRY_STORE_RAM_RECORDS);
+}
+
+int main(void)
+{
+    RUN_TEST(test_spill_and_order);
+    RUN_TEST(test_recovery_after_reset);
+    RUN_TEST(test_wrap_and_drop_accounting);
+    RUN_TEST(test_torn_record);
+    RUN_TEST(test_ram_only);
+    printf("All telemetry store tests passed\n");
+    return EXIT_SUCCESS;
+}
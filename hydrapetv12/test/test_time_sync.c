@@ -0,0 +1,270 @@
+// test_time_sync.c
+//
+// Host test of the SNTP handling of time_sync.c and timebase.c against a fake SNTP
+// client: the first sync steps the clock, later ones slew it and measure the drift of
+// the local oscillator, and while the clock is slewed the timebase follows what the
+// clock shows within one resample interval.
+
+#include "host_test.h"
+#include "time_sync.h"
+#include "timebase.h"
+#include "alarms.h"
+#include "config.h"
+#include "esp_timer.h"
+#include "esp_netif_sntp.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+/** @brief Server time at monotonic time zero, in microseconds since the epoch */
+#define SERVER_EPOCH_US 1700000000000000LL
+
+/** @brief Drift of the local oscillator, slow by this many parts per million */
+#define OSCILLATOR_SLOW_PPM 50
+
+/** @brief Rate at which the fake `adjtime()` slews the clock, in parts per million */
+#define SLEW_RATE_PPM 1000
+
+/** @brief Step of the simulated time in microseconds */
+#define TICK_US 100000LL
+
+/**
+ * @brief Fake SNTP client, system clock and monotonic clock of the device.
+ */
+static struct {
+    int64_t mono_us;              /**< @brief Monotonic time, counted by the local oscillator */
+    int64_t clock_offset_us;      /**< @brief System clock minus the monotonic time */
+    int64_t slew_pending_us;      /**< @brief Correction `adjtime()` still has to apply */
+    sntp_sync_time_cb_t sync_cb;  /**< @brief Callback registered by `time_sync_init()` */
+    bool smooth_sync;             /**< @brief Whether smooth sync was requested */
+    uint32_t sync_interval_ms;    /**< @brief Sync interval requested */
+} device;
+
+/**
+ * @brief The slew timer created by `time_sync_init()`.
+ */
+static struct {
+    esp_timer_cb_t callback;  /**< @brief Callback of the timer */
+    void *arg;                /**< @brief Argument of the callback */
+    bool running;             /**< @brief Whether the timer is started */
+    int64_t period_us;        /**< @brief Period of the timer */
+    int64_t next_us;          /**< @brief Monotonic time of the next expiry */
+} timer;
+
+/**
+ * @brief Last clock change reported to the alarms.
+ */
+static struct {
+    int count;     /**< @brief Number of changes reported */
+    time_t before; /**< @brief Time before the last change */
+    time_t after;  /**< @brief Time after the last change */
+} clock_changes;
+
+/**
+ * @brief Returns the time of the server, which runs on an accurate clock.
+ *
+ * @return Server time in microseconds since the epoch.
+ */
+static int64_t server_us(void)
+{
+    return SERVER_EPOCH_US + device.mono_us + device.mono_us * OSCILLATOR_SLOW_PPM / 1000000LL;
+}
+
+/**
+ * @brief Returns what the system clock of the device shows.
+ *
+ * @return System time in microseconds since the epoch.
+ */
+static int64_t clock_us(void)
+{
+    return device.mono_us + device.clock_offset_us;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return device.mono_us;
+}
+
+int gettimeofday(struct timeval *tv, void *tz)
+{
+    int64_t now_us = clock_us();
+    tv->tv_sec = now_us / 1000000LL;
+    tv->tv_usec = now_us % 1000000LL;
+    return 0;
+}
+
+time_t time(time_t *t)
+{
+    time_t now = clock_us() / 1000000LL;
+    if (t != NULL) {
+        *t = now;
+    }
+    return now;
+}
+
+int settimeofday(const struct timeval *tv, const struct timezone *tz)
+{
+    device.clock_offset_us = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec - device.mono_us;
+    device.slew_pending_us = 0;
+    return 0;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    TEST_CHECK(timer.callback == NULL);
+    timer.callback = create_args->callback;
+    timer.arg = create_args->arg;
+    *out_handle = (esp_timer_handle_t)&timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t handle, uint64_t period)
+{
+    TEST_CHECK(handle == (esp_timer_handle_t)&timer && !timer.running);
+    timer.running = true;
+    timer.period_us = (int64_t)period;
+    timer.next_us = device.mono_us + timer.period_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle)
+{
+    TEST_CHECK(handle == (esp_timer_handle_t)&timer);
+    if (!timer.running) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer.running = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_sntp_init(const esp_sntp_config_t *config)
+{
+    device.sync_cb = config->sync_cb;
+    device.smooth_sync = config->smooth_sync;
+    return ESP_OK;
+}
+
+void sntp_set_sync_interval(uint32_t interval_ms)
+{
+    device.sync_interval_ms = interval_ms;
+}
+
+sntp_sync_status_t sntp_get_sync_status(void)
+{
+    return (device.slew_pending_us != 0) ? SNTP_SYNC_STATUS_IN_PROGRESS : SNTP_SYNC_STATUS_COMPLETED;
+}
+
+void alarms_clock_changed(time_t before, time_t after)
+{
+    clock_changes.count++;
+    clock_changes.before = before;
+    clock_changes.after = after;
+}
+
+/**
+ * @brief Delivers the server time as the SNTP client does after a sync.
+ *
+ * @param step Whether the clock is stepped, as for the first sync, rather than slewed.
+ */
+static void sntp_sync(bool step)
+{
+    struct timeval tv;
+    int64_t now_us = server_us();
+    tv.tv_sec = now_us / 1000000LL;
+    tv.tv_usec = now_us % 1000000LL;
+    if (step) {
+        settimeofday(&tv, NULL);
+    } else {
+        device.slew_pending_us = now_us - clock_us();
+    }
+    device.sync_cb(&tv);
+}
+
+/**
+ * @brief Runs the device for a while, slewing the clock and firing the slew timer.
+ *
+ * @param duration_us Time to run, in microseconds of the monotonic clock.
+ * @param max_error_us Largest difference allowed between the timebase and the clock.
+ */
+static void run(int64_t duration_us, int64_t max_error_us)
+{
+    for (int64_t end_us = device.mono_us + duration_us; device.mono_us < end_us;) {
+        device.mono_us += TICK_US;
+        int64_t step_us = TICK_US * SLEW_RATE_PPM / 1000000LL;
+        step_us = (llabs(device.slew_pending_us) < step_us) ? device.slew_pending_us
+                : (device.slew_pending_us > 0) ? step_us : -step_us;
+        device.clock_offset_us += step_us;
+        device.slew_pending_us -= step_us;
+
+        if (timer.running && device.mono_us >= timer.next_us) {
+            timer.next_us += timer.period_us;
+            timer.callback(timer.arg);
+        }
+        TEST_CHECK(llabs(timebase_to_wall_us(timebase_now_us()) - clock_us()) <= max_error_us);
+    }
+}
+
+static void test_first_sync_steps(void)
+{
+    time_sync_init();
+    TEST_CHECK(device.smooth_sync && device.sync_cb != NULL);
+    TEST_CHECK(device.sync_interval_ms == SNTP_SYNC_INTERVAL_MS);
+    TEST_CHECK(!time_sync_is_valid());
+
+    run(5000000LL, 0);
+    sntp_sync(true);
+    TEST_CHECK(time_sync_is_valid());
+    TEST_CHECK(clock_us() == server_us());
+    TEST_CHECK(timebase_to_wall_us(timebase_now_us()) == clock_us());
+    TEST_CHECK(!timer.running);
+    TEST_CHECK(time_sync_drift_ppm() == 0.0f);
+    TEST_CHECK(clock_changes.count == 1);
+}
+
+static void test_slew_and_drift(void)
+{
+    // Without syncs the timebase follows the clock, both on the local oscillator
+    run((int64_t)SNTP_SYNC_INTERVAL_MS * 1000, 0);
+    int64_t offset_us = server_us() - clock_us();
+    TEST_CHECK(offset_us == (int64_t)SNTP_SYNC_INTERVAL_MS * OSCILLATOR_SLOW_PPM / 1000);
+
+    int64_t before_us = clock_us();
+    sntp_sync(false);
+    TEST_CHECK(time_sync_drift_ppm() > OSCILLATOR_SLOW_PPM - 0.01f);
+    TEST_CHECK(time_sync_drift_ppm() < OSCILLATOR_SLOW_PPM + 0.01f);
+    TEST_CHECK(clock_changes.count == 2);
+    TEST_CHECK(clock_changes.before == before_us / 1000000LL && clock_changes.after == before_us / 1000000LL);
+
+    // The clock only reaches the server time gradually, the timebase follows it to
+    // within what the clock slews in one resample interval, far less than the offset
+    TEST_CHECK(timer.running && timer.period_us == (int64_t)SNTP_SLEW_RESAMPLE_MS * 1000);
+    TEST_CHECK(timebase_to_wall_us(timebase_now_us()) == clock_us());
+    int64_t max_error_us = (int64_t)SNTP_SLEW_RESAMPLE_MS * SLEW_RATE_PPM / 1000;
+    TEST_CHECK(max_error_us < offset_us);
+    int64_t slew_us = offset_us * 1000000LL / SLEW_RATE_PPM;
+    run(slew_us + (int64_t)SNTP_SLEW_RESAMPLE_MS * 1000, max_error_us);
+
+    // Once the slew is finished the timer stops and the timebase matches the clock again
+    TEST_CHECK(device.slew_pending_us == 0);
+    TEST_CHECK(!timer.running);
+    run(60000000LL, 0);
+}
+
+static void test_manual_set(void)
+{
+    time_t before = clock_us() / 1000000LL;
+    time_t t = before + 3600;
+
+    TEST_CHECK(time_sync_set_time(t) == ESP_OK);
+    TEST_CHECK(clock_us() == (int64_t)t * 1000000LL);
+    TEST_CHECK(timebase_to_wall_us(timebase_now_us()) == clock_us());
+    TEST_CHECK(clock_changes.count == 3 && clock_changes.before == before && clock_changes.after == t);
+}
+
+int main(void)
+{
+    RUN_TEST(test_first_sync_steps);
+    RUN_TEST(test_slew_and_drift);
+    RUN_TEST(test_manual_set);
+    return 0;
+}
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+# cbor_decode.py
+"""Reference decoder for the CBOR telemetry of the device, and encoder for CBOR commands.
+
+Decode telemetry received on <device_id>/hydrapetinfo/telemetry/cbor, or a batch of
+stored telemetry received on <device_id>/hydrapetinfo/telemetry/cbor/batch:
+
+    mosquitto_sub -t 'hydrapet0001/hydrapetinfo/telemetry/cbor' -C 1 -N | python3 cbor_decode.py
+    python3 cbor_decode.py --hex a7000101...
+
+Encode a JSON command as CBOR for the command topics:
+
+    python3 cbor_decode.py --encode '{"alarm_ids": [17, 42]}' | mosquitto_pub -t 'hydrapet0001/update/del/alarms' -s
+
+Only the subset of CBOR used by the device is supported: integers, strings, arrays,
+maps, booleans and null, with definite lengths.
+"""
+import argparse
+import json
+import struct
+import sys
+
+# Keys of the telemetry map, see telemetry_key_t in main/telemetry.h
+TELEMETRY_KEYS = {
+    0: 'v',
+    1: 'timestamp',
+    2: 'weight',
+    3: 'button',
+    4: 'led',
+    5: 'motor',
+    6: 'tank_low',
+}
+
+
+class CborError(ValueError):
+    pass
+
+
+def _read_head(data, pos):
+    if pos >= len(data):
+        raise CborError('truncated input')
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+    if info < 24:
+        return major, info, pos
+    if info > 27:
+        raise CborError('unsupported additional info %d' % info)
+    size = 1 << (info - 24)
+    if pos + size > len(data):
+        raise CborError('truncated input')
+    return major, int.from_bytes(data[pos:pos + size], 'big'), pos + size
+
+
+def decode_item(data, pos=0):
+    """Decodes one data item, returning the value and the position after it."""
+    major, value, pos = _read_head(data, pos)
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major in (2, 3):
+        if pos + value > len(data):
+            raise CborError('truncated string')
+        raw = data[pos:pos + value]
+        return (raw.decode('utf-8') if major == 3 else bytes(raw)), pos + value
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, pos = decode_item(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        result = {}
+        for _ in range(value):
+            key, pos = decode_item(data, pos)
+            result[key], pos = decode_item(data, pos)
+        return result, pos
+    if major == 6:
+        return decode_item(data, pos)
+    simple = {20: False, 21: True, 22: None}
+    if value not in simple:
+        raise CborError('unsupported simple value %d' % value)
+    return simple[value], pos
+
+
+def decode(data):
+    value, pos = decode_item(data)
+    if pos != len(data):
+        raise CborError('%d trailing bytes' % (len(data) - pos))
+    return value
+
+
+def _name_keys(message):
+    if not isinstance(message, dict):
+        raise CborError('telemetry is not a map')
+    return {TELEMETRY_KEYS.get(key, key): value for key, value in message.items()}
+
+
+def decode_telemetry(data):
+    """Decodes a telemetry message, or a batch of them, with the field names of the JSON telemetry."""
+    message = decode(data)
+    if isinstance(message, list):
+        return [_name_keys(item) for item in message]
+    return _name_keys(message)
+
+
+def _head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for info, fmt in ((24, '>B'), (25, '>H'), (26, '>I'), (27, '>Q')):
+        if value < 1 << (8 * struct.calcsize(fmt)):
+            return bytes([major << 5 | info]) + struct.pack(fmt, value)
+    raise CborError('integer too large')
+
+
+def encode(value):
+    """Encodes a JSON-compatible value as CBOR."""
+    if value is None:
+        return b'\xf6'
+    if isinstance(value, bool):
+        return b'\xf5' if value else b'\xf4'
+    if isinstance(value, int):
+        return _head(0, value) if value >= 0 else _head(1, -1 - value)
+    if isinstance(value, str):
+        raw = value.encode('utf-8')
+        return _head(3, len(raw)) + raw
+    if isinstance(value, list):
+        return _head(4, len(value)) + b''.join(encode(item) for item in value)
+    if isinstance(value, dict):
+        return _head(5, len(value)) + b''.join(encode(k) + encode(v) for k, v in value.items())
+    raise CborError('cannot encode %r' % type(value))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--hex', help='decode this hex string instead of reading stdin')
+    parser.add_argument('--raw', action='store_true', help='do not map telemetry keys to names')
+    parser.add_argument('--encode', metavar='JSON', help='encode a JSON command to stdout as CBOR')
+    args = parser.parse_args()
+
+    if args.encode is not None:
+        sys.stdout.buffer.write(encode(json.loads(args.encode)))
+        return
+
+    data = bytes.fromhex(args.hex) if args.hex else sys.stdin.buffer.read()
+    message = decode(data) if args.raw else decode_telemetry(data)
+    print(json.dumps(message, default=str))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+# tls_resume_bench.py
+"""Measures the reconnection latency to a TLS MQTT broker, full handshake against resumed session.
+
+Each connection is timed from the TCP connect to the CONNACK, as the device waits for it
+before publishing. Full connections offer no session; resumed ones offer the session of
+the previous connection, as mqtt_tls.c does, and are checked to have been resumed by the
+broker. TLS is capped at 1.2, the version the device negotiates with the default mbedTLS
+configuration.
+
+Against a local mosquitto with throwaway certificates (mosquitto must be on the PATH):
+
+    python3 tls_resume_bench.py --mosquitto
+
+Against a running broker:
+
+    python3 tls_resume_bench.py --broker broker.local:8883 --cafile ca.crt
+
+Without either, a stand-in broker answering CONNECT with CONNACK is started in-process, on
+the loopback interface with the throwaway certificates. The numbers measure the host and
+the TLS library only; on the device, read the "tls" counters of update/get/stats.
+"""
+import argparse
+import os
+import shutil
+import socket
+import ssl
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# MQTT 3.1.1 CONNECT, clean session, keep-alive 60 s, client ID "bench"
+CONNECT = bytes([0x10, 17, 0, 4]) + b'MQTT' + bytes([4, 0x02, 0, 60, 0, 5]) + b'bench'
+CONNACK = bytes([0x20, 2, 0, 0])
+DISCONNECT = bytes([0xe0, 0])
+
+
+def make_certificates(directory):
+    """Creates a CA and a server certificate for localhost, returns their paths."""
+    paths = {name: os.path.join(directory, name) for name in ('ca.key', 'ca.crt', 'server.key', 'server.csr',
+                                                              'server.crt', 'server.ext')}
+    with open(paths['server.ext'], 'w') as f:
+        f.write('subjectAltName=DNS:localhost,IP:127.0.0.1\n')
+    commands = [
+        ['req', '-x509', '-newkey', 'rsa:2048', '-nodes', '-days', '1', '-subj', '/CN=bench CA',
+         '-keyout', paths['ca.key'], '-out', paths['ca.crt']],
+        ['req', '-newkey', 'rsa:2048', '-nodes', '-subj', '/CN=localhost',
+         '-keyout', paths['server.key'], '-out', paths['server.csr']],
+        ['x509', '-req', '-in', paths['server.csr'], '-CA', paths['ca.crt'], '-CAkey', paths['ca.key'],
+         '-CAcreateserial', '-days', '1', '-extfile', paths['server.ext'], '-out', paths['server.crt']],
+    ]
+    for command in commands:
+        subprocess.run(['openssl'] + command, check=True, capture_output=True)
+    return paths
+
+
+def read_exactly(sock, size):
+    data = b''
+    while len(data) < size:
+        chunk = sock.recv(size - len(data))
+        if not chunk:
+            raise ConnectionError('connection closed')
+        data += chunk
+    return data
+
+
+def read_packet(sock):
+    """Reads one MQTT packet, returns its fixed header byte and body."""
+    header = read_exactly(sock, 1)[0]
+    length = 0
+    for shift in range(0, 28, 7):
+        byte = read_exactly(sock, 1)[0]
+        length |= (byte & 0x7f) << shift
+        if not byte & 0x80:
+            break
+    return header, read_exactly(sock, length)
+
+
+def stand_in_broker(paths):
+    """Starts a broker answering CONNECT with CONNACK, returns its port."""
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(paths['server.crt'], paths['server.key'])
+    listener = socket.create_server(('127.0.0.1', 0))
+
+    def serve():
+        while True:
+            conn, _ = listener.accept()
+            try:
+                with context.wrap_socket(conn, server_side=True) as tls:
+                    header, _ = read_packet(tls)
+                    if header >> 4 == 1:
+                        tls.sendall(CONNACK)
+                        read_packet(tls)
+            except (OSError, ConnectionError):
+                pass
+
+    threading.Thread(target=serve, daemon=True).start()
+    return listener.getsockname()[1]
+
+
+def start_mosquitto(paths, directory):
+    """Starts mosquitto on a free loopback port, returns the process and the port."""
+    with socket.create_server(('127.0.0.1', 0)) as probe:
+        port = probe.getsockname()[1]
+    config = os.path.join(directory, 'mosquitto.conf')
+    with open(config, 'w') as f:
+        f.write(f'listener {port} 127.0.0.1\nallow_anonymous true\n'
+                f'cafile {paths["ca.crt"]}\ncertfile {paths["server.crt"]}\nkeyfile {paths["server.key"]}\n')
+    process = subprocess.Popen(['mosquitto', '-c', config], stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    for _ in range(50):
+        try:
+            socket.create_connection(('127.0.0.1', port), timeout=0.1).close()
+            return process, port
+        except OSError:
+            time.sleep(0.1)
+    process.kill()
+    sys.exit('mosquitto did not start')
+
+
+def connect(context, host, port, session):
+    """Connects, waits for the CONNACK and disconnects; returns the duration, whether resumed and the session."""
+    start = time.perf_counter()
+    sock = socket.create_connection((host, port))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    with context.wrap_socket(sock, server_hostname=host, session=session) as tls:
+        tls.sendall(CONNECT)
+        header, body = read_packet(tls)
+        duration_ms = (time.perf_counter() - start) * 1000
+        if header != CONNACK[0] or body[-1] != 0:
+            sys.exit(f'connection refused by the broker: {header:#x} {body.hex()}')
+        tls.sendall(DISCONNECT)
+        return duration_ms, tls.session_reused, tls.session
+
+
+def report(name, durations):
+    print(f'{name:8} {len(durations):4} connections, median {statistics.median(durations):7.2f} ms, '
+          f'mean {statistics.mean(durations):7.2f} ms, min {min(durations):7.2f} ms')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--broker', metavar='HOST:PORT', help='measure a running broker')
+    parser.add_argument('--cafile', help='CA certificate of the broker given with --broker')
+    parser.add_argument('--mosquitto', action='store_true', help='start a local mosquitto to measure')
+    parser.add_argument('--count', type=int, default=200, help='connections per mode (default 200)')
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        process = None
+        if args.broker:
+            host, port = args.broker.rsplit(':', 1)
+            port = int(port)
+            cafile = args.cafile
+            broker = args.broker
+        else:
+            paths = make_certificates(directory)
+            host, cafile = 'localhost', paths['ca.crt']
+            if args.mosquitto:
+                if shutil.which('mosquitto') is None:
+                    sys.exit('mosquitto not found')
+                process, port = start_mosquitto(paths, directory)
+                broker = 'local mosquitto'
+            else:
+                port = stand_in_broker(paths)
+                broker = 'stand-in broker'
+
+        context = ssl.create_default_context(cafile=cafile)
+        context.maximum_version = ssl.TLSVersion.TLSv1_2
+        try:
+            full = [connect(context, host, port, None)[0] for _ in range(args.count)]
+
+            resumed = []
+            refused = 0
+            _, _, session = connect(context, host, port, None)
+            for _ in range(args.count):
+                duration_ms, reused, session = connect(context, host, port, session)
+                if reused:
+                    resumed.append(duration_ms)
+                else:
+                    refused += 1
+        finally:
+            if process is not None:
+                process.terminate()
+                process.wait()
+
+    print(f'{broker}, {ssl.OPENSSL_VERSION}, TLS 1.2')
+    report('full', full)
+    if resumed:
+        report('resumed', resumed)
+        print(f'resumed/full median: {statistics.median(resumed) / statistics.median(full):.2f}')
+    if refused:
+        print(f'{refused} offered sessions refused by the broker')
+
+
+if __name__ == '__main__':
+    main()